@@ -33,11 +33,15 @@
 #include <algorithm>
 #include <atomic>
 #include <cctype>
+#include <cmath>
 #include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <regex>
 #include <string>
@@ -46,22 +50,38 @@
 
 #if LOGURU_SYSLOG
 #include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #else
 #define LOG_USER 0
 #endif
 
 #ifdef _WIN32
 	#include <direct.h>
+	#include <process.h> // _getpid
 
 	#define localtime_r(a, b) localtime_s(b, a) // No localtime_r with MSVC, but arguments are swapped for localtime_s
+	#define gmtime_r(a, b) gmtime_s(b, a) // Same for gmtime_r
 #else
+	#include <fcntl.h>    // O_NONBLOCK
+	#include <netdb.h>    // getaddrinfo
+	#include <netinet/in.h>
+	#include <netinet/tcp.h> // TCP_NODELAY
+	#include <poll.h>
 	#include <signal.h>
+	#include <spawn.h>    // posix_spawn
+	#include <sys/socket.h>
 	#include <sys/stat.h> // mkdir
+	#include <sys/wait.h> // waitpid
 	#include <unistd.h>   // STDERR_FILENO
+
+	extern char** environ;
 #endif
 
 #ifdef __linux__
 	#include <linux/limits.h> // PATH_MAX
+	#include <sys/mman.h>     // memfd_create
+	#include <sys/syscall.h>  // SYS_gettid
 #elif !defined(_WIN32)
 	#include <limits.h> // PATH_MAX
 #endif
@@ -102,6 +122,13 @@
 	#include <execinfo.h>  // for backtrace
 #endif // LOGURU_STACKTRACES
 
+#if LOGURU_PTHREADS && LOGURU_STACKTRACES
+	// The scope watchdog (see set_scope_watchdog) sends this signal to a thread to capture its stack.
+	#ifndef LOGURU_WATCHDOG_SIGNAL
+		#define LOGURU_WATCHDOG_SIGNAL SIGUSR2
+	#endif
+#endif
+
 #if LOGURU_PTHREADS
 	#include <pthread.h>
 	#if defined(__FreeBSD__)
@@ -122,6 +149,18 @@
 	#endif
 #endif
 
+#ifndef LOGURU_SHM
+	#if LOGURU_PTHREADS && !defined(__ANDROID__) && !defined(__EMSCRIPTEN__)
+		#define LOGURU_SHM 1
+	#else
+		#define LOGURU_SHM 0
+	#endif
+#endif
+
+#if LOGURU_SHM
+	#include <sys/mman.h> // shm_open, mmap
+#endif
+
 #if LOGURU_WINTHREADS
 	#ifndef _WIN32_WINNT
 		#define _WIN32_WINNT 0x0502
@@ -135,6 +174,32 @@
    #define LOGURU_PTLS_NAMES 0
 #endif
 
+#ifndef LOGURU_SSE2
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define LOGURU_SSE2 1
+	#else
+		#define LOGURU_SSE2 0
+	#endif
+#endif
+
+#ifndef LOGURU_AVX2
+	#if defined(__AVX2__)
+		#define LOGURU_AVX2 1
+	#else
+		#define LOGURU_AVX2 0
+	#endif
+#endif
+
+#if LOGURU_AVX2
+	#include <immintrin.h> // for _mm256_*
+#elif LOGURU_SSE2
+	#include <emmintrin.h> // for _mm_*
+#endif
+
+#if defined(_MSC_VER)
+	#include <intrin.h> // for _BitScanForward
+#endif
+
 LOGURU_ANONYMOUS_NAMESPACE_BEGIN
 
 namespace loguru
@@ -156,15 +221,18 @@ namespace loguru
 	typedef FILE* FileAbs;
 #endif
 
+	struct AsyncSink;
+
 	struct Callback
 	{
 		std::string     id;
+		SinkHandle      handle;
 		log_handler_t   callback;
 		void*           user_data;
-		Verbosity       verbosity; // Does not change!
+		Verbosity       verbosity; // See set_sink_verbosity.
 		close_handler_t close;
 		flush_handler_t flush;
-		unsigned        indentation;
+		AsyncSink*      async;     // nullptr unless set_callback_async was called.
 	};
 
 	using CallbackVec = std::vector<Callback>;
@@ -192,24 +260,43 @@ namespace loguru
 	bool      g_preamble_pipe     = true;
 
 	static std::recursive_mutex  s_mutex;
-	static Verbosity             s_max_out_verbosity = Verbosity_OFF;
+	static Verbosity             s_max_out_verbosity = Verbosity_OFF; // Including the ring buffer.
+	static std::atomic<int>      s_max_callback_verbosity { Verbosity_OFF }; // Read without s_mutex, see log_message.
 	static std::string           s_argv0_filename;
 	static std::string           s_arguments;
 	static char                  s_current_dir[PATH_MAX];
 	static CallbackVec           s_callbacks;
+	static SinkHandle            s_next_sink_handle = 1;
 	static fatal_handler_t       s_fatal_handler   = nullptr;
 	static verbosity_to_name_t   s_verbosity_to_name_callback = nullptr;
 	static name_to_verbosity_t   s_name_to_verbosity_callback = nullptr;
 	static StringPairList        s_user_stack_cleanups;
 	static bool                  s_strip_file_path = true;
-	static std::atomic<unsigned> s_stderr_indentation { 0 };
 
 	// For periodic flushing:
-	static std::thread* s_flush_thread   = nullptr;
 	static bool         s_needs_flushing = false;
+	static bool         s_batch_in_progress = false; // A LogBatch flushes once at the end instead.
 
 	static SignalOptions s_signal_options = SignalOptions::none();
 
+	// Background threads, created with s_mutex locked. Stopped by shutdown().
+	static std::thread* s_flush_thread        = nullptr; // For periodic flushing.
+	static std::thread* s_scope_report_thread = nullptr; // See set_scope_profiling.
+	static std::thread* s_watchdog_thread     = nullptr; // See set_scope_watchdog.
+	static std::thread* s_stderr_thread       = nullptr; // See set_stderr_nonblocking.
+
+	// Never destroyed, since the threads outlive static destruction unless shutdown() is called.
+	static std::mutex&              s_background_mutex = *new std::mutex();
+	static std::condition_variable& s_background_cv    = *new std::condition_variable();
+	static bool                     s_background_quit  = false; // Protected by s_background_mutex.
+
+	// What the background threads sleep in. Returns false when it is time to quit.
+	static bool background_sleep(unsigned ms)
+	{
+		std::unique_lock<std::mutex> lock(s_background_mutex);
+		return !s_background_cv.wait_for(lock, std::chrono::milliseconds(ms), []{ return s_background_quit; });
+	}
+
 	static const bool s_terminal_has_color = [](){
 		#ifdef _WIN32
 			#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
@@ -248,6 +335,72 @@ namespace loguru
 
 	static void print_preamble_header(char* out_buff, size_t out_buff_size);
 
+	// Everything Loguru keeps per thread.
+	struct FormatBuffer;
+	class LogStream;
+	struct TraceBuffer;
+	struct ScopeBudgets;
+
+	struct ThreadLocals
+	{
+		EcEntryBase*        ec_head;           // Innermost ERROR_CONTEXT, unless LOGURU_INLINE_ERROR_CONTEXT.
+		const ContextScope* context_head;      // Innermost ContextScope.
+		const char*         thread_name;       // Reported by get_thread_name instead of our own, if set.
+		long long           log_time_us;       // When the message being delivered was logged, if set. See message_time_us.
+		long long           log_uptime_us;     // The same, but since s_start_time.
+		long                log_thread_id;     // Which thread logged it, if set. See message_thread_id.
+		const Message*      fields_text_message; // Whose fields fields_text holds. See fields_text.
+		std::string*        fields_text;
+		std::string*        hex_text;          // See log_hex.
+		FormatBuffer*       format_buffer;     // See FormattedText.
+		BatchLines*         batch_lines;       // See LogBatch.
+		std::vector<Verbosity>* open_scopes;   // Of the LogScopeRAII:s open on this thread, innermost last.
+		TraceBuffer*        trace_buffer;      // See add_trace_file.
+		ScopeBudgets*       scope_budgets;     // See set_scope_watchdog.
+		LogStream*          log_stream;        // See acquire_log_stream.
+	};
+
+	ThreadLocals& thread_locals();
+
+	// How indented a message from this thread is in an output of the given verbosity:
+	// the number of scopes open on the thread that the output saw the start of.
+	static unsigned thread_scope_depth(const ThreadLocals& locals, Verbosity verbosity)
+	{
+		unsigned depth = 0;
+		if (locals.open_scopes) {
+			for (const Verbosity scope_verbosity : *locals.open_scopes) {
+				if (scope_verbosity <= verbosity) {
+					++depth;
+				}
+			}
+		}
+		return depth;
+	}
+
+	// When the message being written was logged, in microseconds since the epoch: now, unless an
+	// async worker is delivering it (see async_deliver).
+	static long long message_time_us()
+	{
+		const long long time_us = thread_locals().log_time_us;
+		return time_us != 0 ? time_us : duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+	}
+
+	// Like message_time_us, but since s_start_time.
+	static long long message_uptime_us()
+	{
+		const long long uptime_us = thread_locals().log_uptime_us;
+		return uptime_us != 0 ? uptime_us : duration_cast<microseconds>(steady_clock::now() - s_start_time).count();
+	}
+
+#ifdef __linux__
+	// The kernel id of the thread that logged the message being written.
+	static long message_thread_id()
+	{
+		const long thread_id = thread_locals().log_thread_id;
+		return thread_id != 0 ? thread_id : static_cast<long>(syscall(SYS_gettid));
+	}
+#endif
+
 	// ------------------------------------------------------------------------------
 	// Colors
 
@@ -280,6 +433,105 @@ namespace loguru
 	// You should end each line with this!
 	const char* terminal_reset()      { return s_terminal_has_color ? VTSEQ(0) : ""; }
 
+	// ------------------------------------------------------------------------------
+	// Key-value fields (LOG_KV)
+
+	static void write_field_string_text(std::string& out, const char* str, unsigned long long len)
+	{
+		bool needs_quotes = (len == 0);
+		for (unsigned long long i = 0; i < len && !needs_quotes; ++i) {
+			const unsigned char c = static_cast<unsigned char>(str[i]);
+			needs_quotes = (c <= ' ' || c == '=' || c == '"');
+		}
+		if (!needs_quotes) {
+			out.append(str, static_cast<size_t>(len));
+			return;
+		}
+		out += '"';
+		for (unsigned long long i = 0; i < len; ++i) {
+			const char c = str[i];
+			/**/ if (c == '"')  { out += "\\\""; }
+			else if (c == '\\') { out += "\\\\"; }
+			else if (c == '\n') { out += "\\n";  }
+			else { out += c; }
+		}
+		out += '"';
+	}
+
+	static void write_fields_text(std::string& out, const Field* fields, unsigned num_fields)
+	{
+		char buff[32];
+		for (unsigned i = 0; i < num_fields; ++i) {
+			const Field& field = fields[i];
+			out += ' ';
+			out += field.key;
+			out += '=';
+			switch (field.type) {
+				case FieldType_Int:
+					snprintf(buff, sizeof(buff), "%lld", field.int_value);
+					out += buff;
+					break;
+				case FieldType_Unsigned:
+					snprintf(buff, sizeof(buff), "%llu", field.unsigned_value);
+					out += buff;
+					break;
+				case FieldType_Double:
+					snprintf(buff, sizeof(buff), "%g", field.double_value);
+					out += buff;
+					break;
+				case FieldType_Bool:
+					out += field.bool_value ? "true" : "false";
+					break;
+				case FieldType_String:
+					write_field_string_text(out, field.string_value, field.string_length);
+					break;
+			}
+		}
+	}
+
+	// Outermost first.
+	static void write_context_text(std::string& out, const ContextScope* context)
+	{
+		if (context) {
+			write_context_text(out, context->previous());
+			write_fields_text(out, &context->field(), 1);
+		}
+	}
+
+	Text fields_as_text(const Field* fields, unsigned num_fields)
+	{
+		std::string str;
+		write_fields_text(str, fields, num_fields);
+		return Text(STRDUP(str.c_str()));
+	}
+
+	Text context_as_text(const ContextScope* context)
+	{
+		std::string str;
+		write_context_text(str, context);
+		return Text(STRDUP(str.c_str()));
+	}
+
+	// The fields and context of the message being logged, rendered at most once for all text outputs.
+	// Per thread, since asynchronous callbacks run on their own threads.
+	// Invalidated by log_message and before each asynchronous callback.
+	static const char* fields_text(const Message& message)
+	{
+		if (message.num_fields == 0 && message.context == nullptr) { return ""; }
+		ThreadLocals& locals = thread_locals();
+		if (!locals.fields_text) {
+			locals.fields_text = new std::string();
+		}
+		// Keyed on the message, since a callback may log another one while this one is being delivered.
+		if (locals.fields_text_message != &message) {
+			locals.fields_text->clear();
+			write_fields_text(*locals.fields_text, message.fields, message.num_fields);
+			write_context_text(*locals.fields_text, message.context);
+			locals.fields_text_message = &message;
+		}
+		return locals.fields_text->c_str();
+	}
+
 	// ------------------------------------------------------------------------------
 #if LOGURU_WITH_FILEABS
 	void file_reopen(void* user_data);
@@ -310,8 +562,8 @@ namespace loguru
 #else
 		FILE* file = to_file(user_data);
 #endif
-		fprintf(file, "%s%s%s%s\n",
-			message.preamble, message.indentation, message.prefix, message.message);
+		fprintf(file, "%s%s%s%s%s\n",
+			message.preamble, message.indentation, message.prefix, message.message, fields_text(message));
 		if (g_flush_interval_ms == 0) {
 			fflush(file);
 		}
@@ -371,31 +623,32 @@ namespace loguru
 	// ------------------------------------------------------------------------------
 	// ------------------------------------------------------------------------------
 #if LOGURU_SYSLOG
-	void syslog_log(void* /*user_data*/, const Message& message)
+	static int syslog_level(Verbosity verbosity)
 	{
 		/*
 			Level 0: Is reserved for kernel panic type situations.
 			Level 1: Is for Major resource failure.
 			Level 2->7 Application level failures
 		*/
-		int level;
-		if (message.verbosity < Verbosity_FATAL) {
-			level = 1; // System Alert
-		} else {
-			switch(message.verbosity) {
-				case Verbosity_FATAL:   level = 2; break;	// System Critical
-				case Verbosity_ERROR:   level = 3; break;	// System Error
-				case Verbosity_WARNING: level = 4; break;	// System Warning
-				case Verbosity_INFO:    level = 5; break;	// System Notice
-				case Verbosity_1:       level = 6; break;	// System Info
-				default:                level = 7; break;	// System Debug
-			}
+		if (verbosity < Verbosity_FATAL) {
+			return 1; // System Alert
 		}
+		switch(verbosity) {
+			case Verbosity_FATAL:   return 2;	// System Critical
+			case Verbosity_ERROR:   return 3;	// System Error
+			case Verbosity_WARNING: return 4;	// System Warning
+			case Verbosity_INFO:    return 5;	// System Notice
+			case Verbosity_1:       return 6;	// System Info
+			default:                return 7;	// System Debug
+		}
+	}
 
+	void syslog_log(void* /*user_data*/, const Message& message)
+	{
 		// Note: We don't add the time info.
 		// This is done automatically by the syslog deamon.
 		// Otherwise log all information that the file log does.
-		syslog(level, "%s%s%s", message.indentation, message.prefix, message.message);
+		syslog(syslog_level(message.verbosity), "%s%s%s%s", message.indentation, message.prefix, message.message, fields_text(message));
 	}
 
 	void syslog_close(void* /*user_data*/)
@@ -405,592 +658,3379 @@ namespace loguru
 
 	void syslog_flush(void* /*user_data*/)
 	{}
-#endif
-// ------------------------------------------------------------------------------
-	// Helpers:
 
-	Text::~Text() { free(_str); }
+	// ------------------------------------------------------------------------------
+	// Native syslog, see add_syslog_socket.
 
-#if LOGURU_USE_FMTLIB
-	Text vtextprintf(const char* format, fmt::format_args args)
-	{
-		return Text(STRDUP(fmt::vformat(format, args).c_str()));
-	}
-#else
-	LOGURU_PRINTF_LIKE(1, 0)
-	static Text vtextprintf(const char* format, va_list vlist)
+	static const size_t SYSLOG_MAX_QUEUED      = 4096; // Messages beyond this are dropped...
+	static const size_t SYSLOG_FATAL_RESERVED  = 16;   // ...but the last few slots are kept for FATAL messages.
+	static const size_t SYSLOG_BATCH_SIZE      = 64;
+	static const int    SYSLOG_SEND_TIMEOUT_MS = 1000; // How long the sender waits for a full daemon.
+
+	struct SyslogSocketSink
 	{
-#ifdef _WIN32
-		int bytes_needed = _vscprintf(format, vlist);
-		CHECK_F(bytes_needed >= 0, "Bad string format: '%s'", format);
-		char* buff = (char*)malloc(bytes_needed+1);
-		vsnprintf(buff, bytes_needed+1, format, vlist);
-		return Text(buff);
-#else
-		char* buff = nullptr;
-		int result = vasprintf(&buff, format, vlist);
-		CHECK_F(result >= 0, "Bad string format: '" LOGURU_FMT(s) "'", format);
-		return Text(buff);
-#endif
-	}
+		int                      fd;
+		std::string              path;
+		std::string              header;   // " HOSTNAME APP-NAME PROCID - - ", everything after the timestamp.
+		int                      facility;
+		long long                timestamp_sec;
+		char                     timestamp[64]; // Up to the milliseconds, for timestamp_sec.
+		std::mutex               mutex;    // Protects the fields below.
+		std::condition_variable  cv;
+		std::vector<std::string> queue;    // The first `queued` are waiting to be sent.
+		size_t                   queued;
+		unsigned long long       dropped;  // Because the queue was full.
+		unsigned long long       reported_dropped;
+		bool                     quit;
+		std::mutex               send_mutex; // Protects fd and `sending`.
+		std::vector<std::string> sending;
+		std::thread              thread;
+	};
 
-	Text textprintf(const char* format, ...)
+	// Appends an RFC 5424 header field: printable ASCII without spaces, or "-" if empty.
+	static void append_syslog_field(std::string& out, const char* value)
 	{
-		va_list vlist;
-		va_start(vlist, format);
-		auto result = vtextprintf(format, vlist);
-		va_end(vlist);
-		return result;
+		if (!value || value[0] == '\0') {
+			out += '-';
+			return;
+		}
+		for (const char* c = value; *c; ++c) {
+			out += (*c > ' ' && *c < 127) ? *c : '_';
+		}
 	}
-#endif
 
-	// Overloaded for variadic template matching.
-	Text textprintf()
+	// Returns -1 on failure, with errno set.
+	static int connect_unix_datagram(const char* path)
 	{
-		return Text(static_cast<char*>(calloc(1, 1)));
+		const int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (fd == -1) {
+			return -1;
+		}
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+		if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+			const int connect_errno = errno;
+			close(fd);
+			errno = connect_errno;
+			return -1;
+		}
+		return fd;
 	}
 
-	static const char* indentation(unsigned depth)
+	static bool syslog_socket_connect(SyslogSocketSink* sink)
 	{
-		static const char buff[] =
-		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
-		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
-		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
-		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
-		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   ";
-		static const size_t INDENTATION_WIDTH = 4;
-		static const size_t NUM_INDENTATIONS = (sizeof(buff) - 1) / INDENTATION_WIDTH;
-		depth = std::min<unsigned>(depth, NUM_INDENTATIONS);
-		return buff + INDENTATION_WIDTH * (NUM_INDENTATIONS - depth);
+		if (sink->fd != -1) {
+			close(sink->fd);
+		}
+		sink->fd = connect_unix_datagram(sink->path.c_str());
+		if (sink->fd == -1) {
+			return false;
+		}
+		// So that a stuck daemon can't hang us, see syslog_socket_send.
+		fcntl(sink->fd, F_SETFL, fcntl(sink->fd, F_GETFL) | O_NONBLOCK);
+		return true;
 	}
 
-	static void parse_args(int& argc, char* argv[], const char* verbosity_flag)
+	// Sends the first `count` lines, one datagram each. When the daemon is full, waits up to `wait_ms`
+	// at a time for it to make room, then gives up. Returns how many lines were not sent.
+	// Called with send_mutex locked.
+	static size_t syslog_socket_send(SyslogSocketSink* sink, const std::vector<std::string>& lines, size_t count, int wait_ms)
 	{
-		int arg_dest = 1;
-		int out_argc = argc;
-
-		for (int arg_it = 1; arg_it < argc; ++arg_it) {
-			auto cmd = argv[arg_it];
-			auto arg_len = strlen(verbosity_flag);
-
-			bool last_is_alpha = false;
-			#if LOGURU_USE_LOCALE
-			try {  // locale variant of isalpha will throw on error
-				last_is_alpha = std::isalpha(cmd[arg_len], std::locale(""));
-			}
-			catch (...) {
-				last_is_alpha = std::isalpha(static_cast<int>(cmd[arg_len]));
+		bool reconnected = false;
+		size_t sent = 0;
+		while (sent < count) {
+	#ifdef __linux__
+			mmsghdr messages[SYSLOG_BATCH_SIZE];
+			iovec   iovecs[SYSLOG_BATCH_SIZE];
+			const size_t batch_size = std::min(SYSLOG_BATCH_SIZE, count - sent);
+			memset(messages, 0, sizeof(messages[0]) * batch_size);
+			for (size_t i = 0; i < batch_size; ++i) {
+				iovecs[i].iov_base = const_cast<char*>(lines[sent + i].data());
+				iovecs[i].iov_len  = lines[sent + i].size();
+				messages[i].msg_hdr.msg_iov    = &iovecs[i];
+				messages[i].msg_hdr.msg_iovlen = 1;
 			}
-			#else
-			last_is_alpha = std::isalpha(static_cast<int>(cmd[arg_len]));
-			#endif
-
-			if (strncmp(cmd, verbosity_flag, arg_len) == 0 && !last_is_alpha) {
-				out_argc -= 1;
-				auto value_str = cmd + arg_len;
-				if (value_str[0] == '\0') {
-					// Value in separate argument
-					arg_it += 1;
-					CHECK_LT_F(arg_it, argc, "Missing verbosiy level after " LOGURU_FMT(s) "", verbosity_flag);
-					value_str = argv[arg_it];
-					out_argc -= 1;
-				}
-				if (*value_str == '=') { value_str += 1; }
-
-				auto req_verbosity = get_verbosity_from_name(value_str);
-				if (req_verbosity != Verbosity_INVALID) {
-					g_stderr_verbosity = req_verbosity;
-				} else {
-					char* end = 0;
-					g_stderr_verbosity = static_cast<int>(strtol(value_str, &end, 10));
-					CHECK_F(end && *end == '\0',
-						"Invalid verbosity. Expected integer, INFO, WARNING, ERROR or OFF, got '" LOGURU_FMT(s) "'", value_str);
+			const int result = sendmmsg(sink->fd, messages, static_cast<unsigned>(batch_size), 0);
+	#else
+			const int result = send(sink->fd, lines[sent].data(), lines[sent].size(), 0) < 0 ? -1 : 1;
+	#endif
+			if (result > 0) {
+				sent += static_cast<size_t>(result);
+			} else if (errno == EINTR) {
+				continue;
+			} else if (errno == EMSGSIZE) {
+				++sent; // Skip it.
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				pollfd poll_fd = {sink->fd, POLLOUT, 0};
+				if (wait_ms <= 0 || poll(&poll_fd, 1, wait_ms) <= 0) {
+					break; // The daemon is stuck. Drop the rest.
 				}
+			} else if (!reconnected && syslog_socket_connect(sink)) {
+				reconnected = true; // The daemon may have restarted.
 			} else {
-				argv[arg_dest++] = argv[arg_it];
+				break; // Drop the rest.
 			}
 		}
+		return count - sent;
+	}
 
-		argc = out_argc;
-		argv[argc] = nullptr;
+	// Sends everything queued. Unless `may_wait`, it gives up right away if the sender thread
+	// is busy sending or the daemon is full, since we are about to abort.
+	static void syslog_socket_send_queued(SyslogSocketSink* sink, bool may_wait)
+	{
+		std::unique_lock<std::mutex> send_lock(sink->send_mutex, std::defer_lock);
+		if (may_wait) {
+			send_lock.lock();
+		} else if (!send_lock.try_lock()) {
+			return;
+		}
+		size_t count;
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			std::swap(sink->queue, sink->sending);
+			count = sink->queued;
+			sink->queued = 0;
+		}
+		const size_t unsent = syslog_socket_send(sink, sink->sending, count, may_wait ? SYSLOG_SEND_TIMEOUT_MS : 0);
+		if (unsent != 0) {
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			sink->dropped += unsent;
+		}
 	}
 
-	static long long now_ns()
+	// Whether there is room to queue a message. Called with sink->mutex locked.
+	static bool syslog_socket_has_room(const SyslogSocketSink* sink, Verbosity verbosity)
 	{
-		return duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+		return sink->queued < (verbosity <= Verbosity_FATAL ? SYSLOG_MAX_QUEUED : SYSLOG_MAX_QUEUED - SYSLOG_FATAL_RESERVED);
 	}
 
-	// Returns the part of the path after the last / or \ (if any).
-	const char* filename(const char* path)
+	// Queues a line with everything up to the message, or returns nullptr if the queue is full.
+	// Called with sink->mutex locked.
+	static std::string* syslog_socket_queue_line(SyslogSocketSink* sink, Verbosity verbosity)
 	{
-		for (auto ptr = path; *ptr; ++ptr) {
-			if (*ptr == '/' || *ptr == '\\') {
-				path = ptr + 1;
+		if (!syslog_socket_has_room(sink, verbosity)) {
+			++sink->dropped;
+			return nullptr;
+		}
+		if (sink->queued == sink->queue.size()) {
+			sink->queue.emplace_back();
+		}
+		std::string& line = sink->queue[sink->queued++];
+
+		const long long ms_since_epoch = message_time_us() / 1000;
+		if (ms_since_epoch / 1000 != sink->timestamp_sec) {
+			sink->timestamp_sec = ms_since_epoch / 1000;
+			time_t sec_since_epoch = time_t(sink->timestamp_sec);
+			tm time_info;
+			gmtime_r(&sec_since_epoch, &time_info);
+			snprintf(sink->timestamp, sizeof(sink->timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.",
+				1900 + time_info.tm_year, 1 + time_info.tm_mon, time_info.tm_mday,
+				time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
+		}
+		char buff[128];
+		snprintf(buff, sizeof(buff), "<%d>1 %s%03lldZ",
+			sink->facility | syslog_level(verbosity), sink->timestamp, ms_since_epoch % 1000);
+		line = buff;
+		line += sink->header;
+		return &line;
+	}
+
+	// Queues a single "N messages dropped" line for everything dropped since the last one.
+	static void syslog_socket_report_drops(SyslogSocketSink* sink)
+	{
+		std::lock_guard<std::mutex> lock(sink->mutex);
+		if (sink->dropped == sink->reported_dropped || !syslog_socket_has_room(sink, Verbosity_WARNING)) { return; }
+		const unsigned long long dropped = sink->dropped - sink->reported_dropped;
+		std::string* line = syslog_socket_queue_line(sink, Verbosity_WARNING);
+		*line += std::to_string(dropped);
+		*line += " messages dropped because the syslog daemon was not keeping up";
+		sink->reported_dropped += dropped;
+	}
+
+	void syslog_socket_log(void* user_data, const Message& message)
+	{
+		SyslogSocketSink* sink = reinterpret_cast<SyslogSocketSink*>(user_data);
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			std::string* line_ptr = syslog_socket_queue_line(sink, message.verbosity);
+			if (!line_ptr) {
+				return;
 			}
+			std::string& line = *line_ptr;
+			line += message.indentation;
+			line += message.prefix;
+			line += message.message;
+			line += fields_text(message);
 		}
-		return path;
+
+		if (message.verbosity == Verbosity_FATAL) {
+			// We are about to abort, so send it now, but don't hang on a stuck daemon.
+			syslog_socket_send_queued(sink, false);
+		} else {
+			sink->cv.notify_one();
+		}
+	}
+
+	void syslog_socket_close(void* user_data)
+	{
+		SyslogSocketSink* sink = reinterpret_cast<SyslogSocketSink*>(user_data);
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			sink->quit = true;
+		}
+		sink->cv.notify_one();
+		sink->thread.join();
+		close(sink->fd);
+		delete sink;
 	}
 
+#ifdef __linux__
 	// ------------------------------------------------------------------------------
+	// journald native protocol, see add_journald.
 
-	static void on_atexit()
+	struct JournaldSink
 	{
-		VLOG_F(g_internal_verbosity, "atexit");
-		flush();
+		int         fd;
+		std::string identifier;
+		std::string message; // Scratch space, we are called with s_mutex locked.
+		std::string datagram;
+	};
+
+	// Appends one KEY=value field. Values with newlines use the binary form: KEY\n<64-bit LE size>value\n
+	static void journal_append(std::string& out, const char* key, const char* value, size_t size)
+	{
+		out += key;
+		if (memchr(value, '\n', size)) {
+			out += '\n';
+			for (int i = 0; i < 8; ++i) {
+				out += static_cast<char>((static_cast<unsigned long long>(size) >> (8 * i)) & 0xff);
+			}
+		} else {
+			out += '=';
+		}
+		out.append(value, size);
+		out += '\n';
 	}
 
-	static void install_signal_handlers(const SignalOptions& signal_options);
+	static void journal_append(std::string& out, const char* key, const char* value)
+	{
+		journal_append(out, key, value, strlen(value));
+	}
 
-	static void write_hex_digit(std::string& out, unsigned num)
+	// journald field names are uppercase letters, digits and underscores, not starting with a digit or underscore.
+	static void journal_append_field(std::string& out, const Field& field)
 	{
-		DCHECK_LT_F(num, 16u);
-		if (num < 10u) { out.push_back(char('0' + num)); }
-		else { out.push_back(char('A' + num - 10)); }
+		char key[65];
+		size_t length = 0;
+		for (const char* c = field.key; *c && length < sizeof(key) - 1; ++c) {
+			if (length == 0 && (*c == '_' || isdigit(static_cast<unsigned char>(*c)))) { continue; }
+			key[length++] = isalnum(static_cast<unsigned char>(*c)) ? static_cast<char>(toupper(static_cast<unsigned char>(*c))) : '_';
+		}
+		if (length == 0) { return; }
+		key[length] = '\0';
+
+		char buff[32];
+		switch (field.type) {
+			case FieldType_Int:
+				snprintf(buff, sizeof(buff), "%lld", field.int_value);
+				journal_append(out, key, buff);
+				break;
+			case FieldType_Unsigned:
+				snprintf(buff, sizeof(buff), "%llu", field.unsigned_value);
+				journal_append(out, key, buff);
+				break;
+			case FieldType_Double:
+				snprintf(buff, sizeof(buff), "%g", field.double_value);
+				journal_append(out, key, buff);
+				break;
+			case FieldType_Bool:
+				journal_append(out, key, field.bool_value ? "true" : "false");
+				break;
+			case FieldType_String:
+				journal_append(out, key, field.string_value, static_cast<size_t>(field.string_length));
+				break;
+		}
 	}
 
-	static void write_hex_byte(std::string& out, uint8_t n)
+	// Too big for a datagram: pass it in a sealed memfd instead, like sd_journal_send does.
+	static bool journal_send_memfd(int socket_fd, const std::string& datagram)
 	{
-		write_hex_digit(out, n >> 4u);
-		write_hex_digit(out, n & 0x0f);
+		const int fd = memfd_create("loguru-journal", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (fd == -1) {
+			return false;
+		}
+		size_t written = 0;
+		while (written < datagram.size()) {
+			const auto bytes = write(fd, datagram.data() + written, datagram.size() - written);
+			if (bytes <= 0) {
+				if (bytes < 0 && errno == EINTR) { continue; }
+				close(fd);
+				return false;
+			}
+			written += static_cast<size_t>(bytes);
+		}
+		fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+		char control[CMSG_SPACE(sizeof(int))];
+		memset(control, 0, sizeof(control));
+		msghdr header;
+		memset(&header, 0, sizeof(header));
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+		const bool ok = sendmsg(socket_fd, &header, MSG_NOSIGNAL) >= 0;
+		close(fd);
+		return ok;
 	}
 
-	static void escape(std::string& out, const std::string& str)
+	void journald_log(void* user_data, const Message& message)
 	{
-		for (char c : str) {
-			/**/ if (c == '\a') { out += "\\a";  }
+		JournaldSink* sink = reinterpret_cast<JournaldSink*>(user_data);
+		std::string& out = sink->datagram;
+		out.clear();
+
+		sink->message.clear();
+		sink->message += message.indentation;
+		sink->message += message.prefix;
+		sink->message += message.message;
+		sink->message += fields_text(message);
+		journal_append(out, "MESSAGE", sink->message.data(), sink->message.size());
+
+		char buff[32];
+		snprintf(buff, sizeof(buff), "%d", syslog_level(message.verbosity));
+		journal_append(out, "PRIORITY", buff);
+		journal_append(out, "CODE_FILE", message.filename);
+		snprintf(buff, sizeof(buff), "%u", message.line);
+		journal_append(out, "CODE_LINE", buff);
+		snprintf(buff, sizeof(buff), "%ld", message_thread_id());
+		journal_append(out, "TID", buff);
+		snprintf(buff, sizeof(buff), "%d", message.verbosity);
+		journal_append(out, "LOGURU_VERBOSITY", buff);
+		char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+		get_thread_name(thread_name, LOGURU_THREADNAME_WIDTH + 1, false);
+		journal_append(out, "LOGURU_THREAD", thread_name);
+		if (!sink->identifier.empty()) {
+			journal_append(out, "SYSLOG_IDENTIFIER", sink->identifier.data(), sink->identifier.size());
+		}
+		for (unsigned i = 0; i < message.num_fields; ++i) {
+			journal_append_field(out, message.fields[i]);
+		}
+
+		if (send(sink->fd, out.data(), out.size(), MSG_NOSIGNAL) < 0 && (errno == EMSGSIZE || errno == ENOBUFS)) {
+			journal_send_memfd(sink->fd, out);
+		}
+	}
+
+	void journald_close(void* user_data)
+	{
+		JournaldSink* sink = reinterpret_cast<JournaldSink*>(user_data);
+		close(sink->fd);
+		delete sink;
+	}
+#endif // __linux__
+#endif
+	// ------------------------------------------------------------------------------
+	// JSON Lines
+
+	struct JsonSink
+	{
+		FILE*       file;
+		std::string buffer; // Reused between messages to avoid allocations.
+	};
+
+	static unsigned lowest_set_bit(unsigned mask)
+	{
+	#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<unsigned>(index);
+	#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+	#endif
+	}
+
+	// Returns the number of leading bytes of `str` that can be copied verbatim into a JSON string,
+	// i.e. the index of the first quote, backslash or control character (or `len` if there is none).
+	static size_t json_plain_prefix(const char* str, size_t len)
+	{
+		size_t i = 0;
+	#if LOGURU_AVX2
+		const __m256i quote_32     = _mm256_set1_epi8('"');
+		const __m256i backslash_32 = _mm256_set1_epi8('\\');
+		const __m256i max_ctrl_32  = _mm256_set1_epi8(0x1F);
+		for (; i + 32 <= len; i += 32) {
+			const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+			const __m256i special = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote_32), _mm256_cmpeq_epi8(chunk, backslash_32)),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(chunk, max_ctrl_32), chunk)); // chunk <= 0x1F
+			const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+			if (mask != 0) { return i + lowest_set_bit(mask); }
+		}
+	#endif
+	#if LOGURU_SSE2
+		const __m128i quote_16     = _mm_set1_epi8('"');
+		const __m128i backslash_16 = _mm_set1_epi8('\\');
+		const __m128i max_ctrl_16  = _mm_set1_epi8(0x1F);
+		for (; i + 16 <= len; i += 16) {
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+			const __m128i special = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, quote_16), _mm_cmpeq_epi8(chunk, backslash_16)),
+				_mm_cmpeq_epi8(_mm_min_epu8(chunk, max_ctrl_16), chunk)); // chunk <= 0x1F
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+			if (mask != 0) { return i + lowest_set_bit(mask); }
+		}
+	#endif
+		for (; i < len; ++i) {
+			const unsigned char c = static_cast<unsigned char>(str[i]);
+			if (c < 0x20 || c == '"' || c == '\\') { break; }
+		}
+		return i;
+	}
+
+	// Appends `str` to `out` as the contents of a JSON string (without the surrounding quotes).
+	static void json_escape(std::string& out, const char* str, size_t len)
+	{
+		static const char hex_digits[] = "0123456789abcdef";
+		size_t pos = 0;
+		for (;;) {
+			const size_t plain = json_plain_prefix(str + pos, len - pos);
+			out.append(str + pos, plain);
+			pos += plain;
+			if (pos == len) { break; }
+
+			const unsigned char c = static_cast<unsigned char>(str[pos++]);
+			/**/ if (c == '"')  { out += "\\\""; }
+			else if (c == '\\') { out += "\\\\"; }
 			else if (c == '\b') { out += "\\b";  }
 			else if (c == '\f') { out += "\\f";  }
 			else if (c == '\n') { out += "\\n";  }
 			else if (c == '\r') { out += "\\r";  }
 			else if (c == '\t') { out += "\\t";  }
-			else if (c == '\v') { out += "\\v";  }
-			else if (c == '\\') { out += "\\\\"; }
-			else if (c == '\'') { out += "\\\'"; }
-			else if (c == '\"') { out += "\\\""; }
-			else if (c == ' ')  { out += "\\ ";  }
-			else if (0 <= c && c < 0x20) { // ASCI control character:
-			// else if (c < 0x20 || c != (c & 127)) { // ASCII control character or UTF-8:
-				out += "\\x";
-				write_hex_byte(out, static_cast<uint8_t>(c));
-			} else { out += c; }
+			else {
+				out += "\\u00";
+				out += hex_digits[c >> 4];
+				out += hex_digits[c & 0x0f];
+			}
 		}
 	}
 
-	Text errno_as_text()
+	static void json_escape(std::string& out, const char* str)
 	{
-		char buff[256];
-	#if defined(__GLIBC__) && defined(_GNU_SOURCE)
-		// GNU Version
-		return Text(STRDUP(strerror_r(errno, buff, sizeof(buff))));
-	#elif defined(__APPLE__) || _POSIX_C_SOURCE >= 200112L
-		// XSI Version
-		strerror_r(errno, buff, sizeof(buff));
-		return Text(strdup(buff));
-	#elif defined(_WIN32)
-		strerror_s(buff, sizeof(buff), errno);
-		return Text(STRDUP(buff));
-	#else
-		// Not thread-safe.
-		return Text(STRDUP(strerror(errno)));
-	#endif
+		json_escape(out, str, strlen(str));
 	}
 
-	void init(int& argc, char* argv[], const Options& options)
+	// Writes "key":value
+	static void json_write_field(std::string& out, const Field& field)
 	{
-		CHECK_GT_F(argc,       0,       "Expected proper argc/argv");
-		CHECK_EQ_F(argv[argc], nullptr, "Expected proper argc/argv");
+		char buff[32];
+		out += '"';
+		json_escape(out, field.key);
+		out += "\":";
+		switch (field.type) {
+			case FieldType_Int:
+				snprintf(buff, sizeof(buff), "%lld", field.int_value);
+				out += buff;
+				break;
+			case FieldType_Unsigned:
+				snprintf(buff, sizeof(buff), "%llu", field.unsigned_value);
+				out += buff;
+				break;
+			case FieldType_Double:
+				if (std::isfinite(field.double_value)) {
+					snprintf(buff, sizeof(buff), "%.17g", field.double_value);
+					out += buff;
+				} else {
+					out += "null";
+				}
+				break;
+			case FieldType_Bool:
+				out += field.bool_value ? "true" : "false";
+				break;
+			case FieldType_String:
+				out += '"';
+				json_escape(out, field.string_value, static_cast<size_t>(field.string_length));
+				out += '"';
+				break;
+		}
+	}
 
-		s_argv0_filename = filename(argv[0]);
+	// Outermost first.
+	static void json_write_context(std::string& out, const ContextScope* context)
+	{
+		if (context->previous()) {
+			json_write_context(out, context->previous());
+			out += ',';
+		}
+		json_write_field(out, context->field());
+	}
 
-		#ifdef _WIN32
-			#define getcwd _getcwd
-		#endif
+	void json_log(void* user_data, const Message& message)
+	{
+		JsonSink* sink = reinterpret_cast<JsonSink*>(user_data);
+		std::string& out = sink->buffer;
+		out.clear();
 
-		if (!getcwd(s_current_dir, sizeof(s_current_dir))) {
-			const auto error_text = errno_as_text();
-			LOG_F(WARNING, "Failed to get current working directory: " LOGURU_FMT(s) "", error_text.c_str());
-		}
+		long long ms_since_epoch = message_time_us() / 1000;
+		time_t sec_since_epoch = time_t(ms_since_epoch / 1000);
+		tm time_info;
+		gmtime_r(&sec_since_epoch, &time_info);
+		auto uptime_ms = message_uptime_us() / 1000;
 
-		s_arguments = "";
-		for (int i = 0; i < argc; ++i) {
-			escape(s_arguments, argv[i]);
-			if (i + 1 < argc) {
-				s_arguments += " ";
+		char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+		get_thread_name(thread_name, LOGURU_THREADNAME_WIDTH + 1, false);
+
+		char buff[160];
+		snprintf(buff, sizeof(buff),
+			"{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03lldZ\",\"uptime\":%.3f,\"verbosity\":%d,\"level\":\"",
+			1900 + time_info.tm_year, 1 + time_info.tm_mon, time_info.tm_mday,
+			time_info.tm_hour, time_info.tm_min, time_info.tm_sec, ms_since_epoch % 1000,
+			static_cast<double>(uptime_ms) / 1000.0, message.verbosity);
+		out += buff;
+		if (const char* level_name = get_verbosity_name(message.verbosity)) {
+			json_escape(out, level_name);
+		} else {
+			out += std::to_string(message.verbosity);
+		}
+		out += "\",\"thread\":\"";
+		json_escape(out, thread_name);
+		out += "\",\"file\":\"";
+		json_escape(out, s_strip_file_path ? filename(message.filename) : message.filename);
+		snprintf(buff, sizeof(buff), "\",\"line\":%u,\"depth\":%u,\"message\":\"", message.line, message.depth);
+		out += buff;
+		json_escape(out, message.prefix);
+		json_escape(out, message.message);
+		out += '"';
+		if (message.num_fields != 0) {
+			out += ",\"fields\":{";
+			for (unsigned i = 0; i < message.num_fields; ++i) {
+				if (i != 0) { out += ','; }
+				json_write_field(out, message.fields[i]);
 			}
+			out += '}';
 		}
-
-		if (options.verbosity_flag) {
-			parse_args(argc, argv, options.verbosity_flag);
+		if (message.context) {
+			out += ",\"context\":{";
+			json_write_context(out, message.context);
+			out += '}';
 		}
+		out += "}\n";
 
-		if (const auto main_thread_name = options.main_thread_name) {
-			#if LOGURU_PTLS_NAMES || LOGURU_WINTHREADS
-				set_thread_name(main_thread_name);
-			#elif LOGURU_PTHREADS
-				char old_thread_name[16] = {0};
-				auto this_thread = pthread_self();
-				#if defined(__APPLE__) || defined(__linux__) || defined(__sun)
-					pthread_getname_np(this_thread, old_thread_name, sizeof(old_thread_name));
-				#endif
-				if (old_thread_name[0] == 0) {
-					#ifdef __APPLE__
-						pthread_setname_np(main_thread_name);
-					#elif defined(__FreeBSD__) || defined(__OpenBSD__)
-						pthread_set_name_np(this_thread, main_thread_name);
-					#elif defined(__linux__) || defined(__sun)
-						pthread_setname_np(this_thread, main_thread_name);
-					#endif
-				}
-			#endif // LOGURU_PTHREADS
+		fwrite(out.data(), 1, out.size(), sink->file);
+		if (g_flush_interval_ms == 0) {
+			fflush(sink->file);
 		}
+	}
 
-		if (g_stderr_verbosity >= Verbosity_INFO) {
-			if (g_preamble_header) {
-				char preamble_explain[LOGURU_PREAMBLE_WIDTH];
-				print_preamble_header(preamble_explain, sizeof(preamble_explain));
-				if (g_colorlogtostderr && s_terminal_has_color) {
-					fprintf(stderr, "%s%s%s\n", terminal_reset(), terminal_dim(), preamble_explain);
-				} else {
-					fprintf(stderr, "%s\n", preamble_explain);
-				}
-			}
-			fflush(stderr);
-		}
-		VLOG_F(g_internal_verbosity, "arguments: " LOGURU_FMT(s) "", s_arguments.c_str());
-		if (strlen(s_current_dir) != 0)
-		{
-			VLOG_F(g_internal_verbosity, "Current dir: " LOGURU_FMT(s) "", s_current_dir);
-		}
-		VLOG_F(g_internal_verbosity, "stderr verbosity: " LOGURU_FMT(d) "", g_stderr_verbosity);
-		VLOG_F(g_internal_verbosity, "-----------------------------------");
+	void json_close(void* user_data)
+	{
+		JsonSink* sink = reinterpret_cast<JsonSink*>(user_data);
+		fclose(sink->file);
+		delete sink;
+	}
 
-		install_signal_handlers(options.signal_options);
+	void json_flush(void* user_data)
+	{
+		fflush(reinterpret_cast<JsonSink*>(user_data)->file);
+	}
 
-		atexit(on_atexit);
+	// ------------------------------------------------------------------------
+	// Shared-memory ring, see add_shm_sink and ShmReader.
+	//
+	// The mapping is a ShmHeader followed by `capacity` bytes of ring. Each record is an 8-byte
+	// commit word followed by its payload, padded to 8 bytes. A writer reserves space by advancing
+	// write_pos with a CAS, marks the commit word as reserved by its process with the span of the record,
+	// copies in the payload and then stores the payload size in the commit word.
+	// The reader waits for the commit word, copies the record out, zeroes it and advances read_pos.
+	// If a writer stalls before publishing, the reader skips its record after a timeout, but keeps
+	// read_pos on it until the writer publishes or its process is gone, see ShmReader::read.
+
+#if LOGURU_SHM
+	static const unsigned long long SHM_MAGIC = 0x316d68737572676cull; // "lgrushm1"
+	static const unsigned long long SHM_RESERVED = 1ull << 63; // Commit word of a record being written, see shm_reservation.
+	static const unsigned long long SHM_MAX_SPAN = 1ull << 32;
+
+	struct ShmHeader
+	{
+		std::atomic<unsigned long long> magic; // Set last, once the header is initialized.
+		unsigned long long              capacity;
+		alignas(64) std::atomic<unsigned long long> write_pos;
+		alignas(64) std::atomic<unsigned long long> read_pos;
+		alignas(64) std::atomic<unsigned long long> dropped;
+	};
+
+	// Fixed part of the payload. Followed by program, thread name, file and message, each zero-terminated.
+	struct ShmRecordHeader
+	{
+		long long time_us;
+		long long pid;
+		int       verbosity;
+		unsigned  line;
+		unsigned  depth;
+	};
+
+	struct ShmSink
+	{
+		ShmHeader*         header;
+		unsigned long long mapped_size;
+	};
+
+	static char* shm_ring(ShmHeader* header)
+	{
+		return reinterpret_cast<char*>(header) + sizeof(ShmHeader);
 	}
 
-	void shutdown()
+	static std::atomic<unsigned long long>& shm_commit_word(ShmHeader* header, unsigned long long pos)
 	{
-		VLOG_F(g_internal_verbosity, "loguru::shutdown()");
-		remove_all_callbacks();
-		set_fatal_handler(nullptr);
-		set_verbosity_to_name_callback(nullptr);
-		set_name_to_verbosity_callback(nullptr);
+		return *reinterpret_cast<std::atomic<unsigned long long>*>(shm_ring(header) + (pos & (header->capacity - 1)));
 	}
 
-	void write_date_time(char* buff, unsigned long long buff_size)
+	// Commit word of a record of `span` bytes that process `pid` is writing.
+	static unsigned long long shm_reservation(long long pid, unsigned long long span)
 	{
-		auto now = system_clock::now();
-		long long ms_since_epoch = duration_cast<milliseconds>(now.time_since_epoch()).count();
-		time_t sec_since_epoch = time_t(ms_since_epoch / 1000);
-		tm time_info;
-		localtime_r(&sec_since_epoch, &time_info);
-		snprintf(buff, buff_size, "%04d%02d%02d_%02d%02d%02d.%03lld",
-			1900 + time_info.tm_year, 1 + time_info.tm_mon, time_info.tm_mday,
-			time_info.tm_hour, time_info.tm_min, time_info.tm_sec, ms_since_epoch % 1000);
+		return SHM_RESERVED | (static_cast<unsigned long long>(pid) << 32) | span;
 	}
 
-	const char* argv0_filename()
+	// Bytes taken up by the record with this commit word.
+	static unsigned long long shm_span(unsigned long long commit_word)
 	{
-		return s_argv0_filename.c_str();
+		if (commit_word & SHM_RESERVED) {
+			return commit_word & (SHM_MAX_SPAN - 1);
+		}
+		return 8 + ((commit_word + 7) & ~7ull);
 	}
 
-	const char* arguments()
+	// False once the process that reserved a record has exited, so it will never publish it.
+	static bool shm_writer_alive(unsigned long long commit_word)
 	{
-		return s_arguments.c_str();
+		const pid_t pid = static_cast<pid_t>((commit_word & ~SHM_RESERVED) >> 32);
+		return kill(pid, 0) == 0 || errno != ESRCH;
 	}
 
-	const char* current_dir()
+	static unsigned long long shm_copy_in(ShmHeader* header, unsigned long long pos, const char* data, size_t size)
 	{
-		return s_current_dir;
+		const size_t offset = static_cast<size_t>(pos & (header->capacity - 1));
+		const size_t first = std::min(size, static_cast<size_t>(header->capacity) - offset);
+		memcpy(shm_ring(header) + offset, data, first);
+		memcpy(shm_ring(header), data + first, size - first);
+		return pos + size;
 	}
 
-	const char* home_dir()
+	static void shm_copy_out(ShmHeader* header, unsigned long long pos, char* data, size_t size)
 	{
-		#ifdef __MINGW32__
-			auto home = getenv("USERPROFILE");
-			CHECK_F(home != nullptr, "Missing USERPROFILE");
-			return home;
-		#elif defined(_WIN32)
-			char* user_profile;
-			size_t len;
-			errno_t err = _dupenv_s(&user_profile, &len, "USERPROFILE");
-			CHECK_F(err == 0, "Missing USERPROFILE");
-			return user_profile;
-		#else // _WIN32
-			auto home = getenv("HOME");
-			CHECK_F(home != nullptr, "Missing HOME");
-			return home;
-		#endif // _WIN32
+		const size_t offset = static_cast<size_t>(pos & (header->capacity - 1));
+		const size_t first = std::min(size, static_cast<size_t>(header->capacity) - offset);
+		memcpy(data, shm_ring(header) + offset, first);
+		memcpy(data + first, shm_ring(header), size - first);
 	}
 
-	void suggest_log_path(const char* prefix, char* buff, unsigned long long buff_size)
+	static void shm_zero(ShmHeader* header, unsigned long long pos, size_t size)
 	{
-		if (prefix[0] == '~') {
-			snprintf(buff, buff_size - 1, "%s%s", home_dir(), prefix + 1);
-		} else {
-			snprintf(buff, buff_size - 1, "%s", prefix);
+		const size_t offset = static_cast<size_t>(pos & (header->capacity - 1));
+		const size_t first = std::min(size, static_cast<size_t>(header->capacity) - offset);
+		memset(shm_ring(header) + offset, 0, first);
+		memset(shm_ring(header), 0, size - first);
+	}
+
+	// Opens or creates the named ring and maps it. Returns nullptr on failure.
+	static ShmHeader* shm_map(const char* name, unsigned long long size_bytes, unsigned long long* out_mapped_size)
+	{
+		unsigned long long capacity = 64;
+		while (capacity < size_bytes) { capacity *= 2; }
+
+		bool created = true;
+		int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1 && errno == EEXIST) {
+			created = false;
+			fd = shm_open(name, O_RDWR, 0600);
+		}
+		if (fd == -1) {
+			LOG_F(ERROR, "Failed to open shared memory '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", name, errno_as_text().c_str());
+			return nullptr;
 		}
 
-		// Check for terminating /
-		size_t n = strlen(buff);
-		if (n != 0) {
-			if (buff[n - 1] != '/') {
-				CHECK_F(n + 2 < buff_size, "Filename buffer too small");
-				buff[n] = '/';
-				buff[n + 1] = '\0';
+		struct stat st;
+		if (created) {
+			if (ftruncate(fd, static_cast<off_t>(sizeof(ShmHeader) + capacity)) != 0) {
+				LOG_F(ERROR, "Failed to size shared memory '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", name, errno_as_text().c_str());
+				::close(fd);
+				return nullptr;
+			}
+		} else {
+			// Whoever created it may not have sized it yet.
+			for (int i = 0; fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < sizeof(ShmHeader) && i < 1000; ++i) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
+			if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= sizeof(ShmHeader)) {
+				LOG_F(ERROR, "Shared memory '" LOGURU_FMT(s) "' has a bad size", name);
+				::close(fd);
+				return nullptr;
+			}
+			capacity = static_cast<unsigned long long>(st.st_size) - sizeof(ShmHeader);
 		}
 
-	#ifdef _WIN32
-		strncat_s(buff, buff_size - strlen(buff) - 1, s_argv0_filename.c_str(), buff_size - strlen(buff) - 1);
-		strncat_s(buff, buff_size - strlen(buff) - 1, "/",                      buff_size - strlen(buff) - 1);
-		write_date_time(buff + strlen(buff),    buff_size - strlen(buff));
-		strncat_s(buff, buff_size - strlen(buff) - 1, ".log",                   buff_size - strlen(buff) - 1);
-	#else
-		strncat(buff, s_argv0_filename.c_str(), buff_size - strlen(buff) - 1);
-		strncat(buff, "/", buff_size - strlen(buff) - 1);
-		write_date_time(buff + strlen(buff), buff_size - strlen(buff));
-		strncat(buff, ".log", buff_size - strlen(buff) - 1);
-	#endif
+		const unsigned long long mapped_size = sizeof(ShmHeader) + capacity;
+		void* memory = mmap(nullptr, static_cast<size_t>(mapped_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (memory == MAP_FAILED) {
+			LOG_F(ERROR, "Failed to map shared memory '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", name, errno_as_text().c_str());
+			return nullptr;
+		}
+
+		ShmHeader* header = reinterpret_cast<ShmHeader*>(memory);
+		if (created) {
+			header->capacity = capacity;
+			header->write_pos.store(0);
+			header->read_pos.store(0);
+			header->dropped.store(0);
+			header->magic.store(SHM_MAGIC, std::memory_order_release);
+		} else {
+			for (int i = 0; header->magic.load(std::memory_order_acquire) != SHM_MAGIC && i < 1000; ++i) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			if (header->magic.load(std::memory_order_acquire) != SHM_MAGIC || header->capacity != capacity) {
+				LOG_F(ERROR, "Shared memory '" LOGURU_FMT(s) "' is not a loguru ring", name);
+				munmap(memory, static_cast<size_t>(mapped_size));
+				return nullptr;
+			}
+		}
+		*out_mapped_size = mapped_size;
+		return header;
 	}
 
-	bool create_directories(const char* file_path_const)
+	void shm_log(void* user_data, const Message& message)
 	{
-		CHECK_F(file_path_const && *file_path_const);
-		char* file_path = STRDUP(file_path_const);
-		for (char* p = strchr(file_path + 1, '/'); p; p = strchr(p + 1, '/')) {
-			*p = '\0';
-
-	#ifdef _WIN32
-			if (_mkdir(file_path) == -1) {
-	#else
-			if (mkdir(file_path, 0755) == -1) {
-	#endif
-				if (errno != EEXIST) {
-					LOG_F(ERROR, "Failed to create directory '" LOGURU_FMT(s) "'", file_path);
-					LOG_IF_F(ERROR, errno == EACCES,       "EACCES");
-					LOG_IF_F(ERROR, errno == ENAMETOOLONG, "ENAMETOOLONG");
-					LOG_IF_F(ERROR, errno == ENOENT,       "ENOENT");
-					LOG_IF_F(ERROR, errno == ENOTDIR,      "ENOTDIR");
-					LOG_IF_F(ERROR, errno == ELOOP,        "ELOOP");
+		ShmHeader* header = reinterpret_cast<ShmSink*>(user_data)->header;
 
-					*p = '/';
-					free(file_path);
-					return false;
-				}
+		char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+		get_thread_name(thread_name, LOGURU_THREADNAME_WIDTH + 1, false);
+		const char* file = s_strip_file_path ? filename(message.filename) : message.filename;
+		const char* strings[] = {argv0_filename(), thread_name, file, message.prefix, message.message, fields_text(message)};
+		size_t lengths[6];
+		size_t payload_size = sizeof(ShmRecordHeader) + 4; // Four terminating zeros.
+		for (size_t i = 0; i < 6; ++i) {
+			lengths[i] = strlen(strings[i]);
+			payload_size += lengths[i];
+		}
+		const unsigned long long span = shm_span(payload_size);
+		const long long pid = static_cast<long long>(getpid());
+
+		unsigned long long pos = header->write_pos.load(std::memory_order_relaxed);
+		do {
+			if (span >= SHM_MAX_SPAN || pos + span - header->read_pos.load(std::memory_order_acquire) > header->capacity) {
+				header->dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		} while (!header->write_pos.compare_exchange_weak(pos, pos + span, std::memory_order_relaxed));
+		// The reservation is in memory before any of the payload, so should we die while copying,
+		// the reader knows where the record ends and whose it was.
+		shm_commit_word(header, pos).exchange(shm_reservation(pid, span));
+
+		ShmRecordHeader record;
+		record.time_us   = message_time_us();
+		record.pid       = pid;
+		record.verbosity = message.verbosity;
+		record.line      = message.line;
+		record.depth     = message.depth;
+
+		const char zero = '\0';
+		unsigned long long write_pos = shm_copy_in(header, pos + 8, reinterpret_cast<const char*>(&record), sizeof(record));
+		for (size_t i = 0; i < 6; ++i) {
+			write_pos = shm_copy_in(header, write_pos, strings[i], lengths[i]);
+			if (i < 3 || i == 5) { // prefix, message and fields are one string.
+				write_pos = shm_copy_in(header, write_pos, &zero, 1);
 			}
-			*p = '/';
 		}
-		free(file_path);
-		return true;
+		shm_commit_word(header, pos).store(payload_size, std::memory_order_release);
 	}
-	bool add_file(const char* path_in, FileMode mode, Verbosity verbosity)
+
+	void shm_close(void* user_data)
+	{
+		ShmSink* sink = reinterpret_cast<ShmSink*>(user_data);
+		munmap(sink->header, static_cast<size_t>(sink->mapped_size));
+		delete sink;
+	}
+#endif // LOGURU_SHM
+
+	bool add_shm_sink(const char* name, unsigned long long size_bytes, Verbosity verbosity)
+	{
+#if LOGURU_SHM
+		unsigned long long mapped_size = 0;
+		ShmHeader* header = shm_map(name, size_bytes, &mapped_size);
+		if (!header) {
+			return false;
+		}
+		add_callback(name, shm_log, new ShmSink{header, mapped_size}, verbosity, shm_close, nullptr);
+
+		VLOG_F(g_internal_verbosity, "Logging to shared memory '" LOGURU_FMT(s) "', size: " LOGURU_FMT(d) " KiB, verbosity: " LOGURU_FMT(d) "",
+			name, static_cast<unsigned>(header->capacity / 1024), verbosity);
+		return true;
+#else
+		(void)name;
+		(void)size_bytes;
+		(void)verbosity;
+		VLOG_F(g_internal_verbosity, "Shared memory not implemented on this system. Request to install shared memory logging ignored.");
+		return false;
+#endif
+	}
+
+	ShmReader::ShmReader()
+		: _memory(nullptr), _mapped_size(0), _buffer(nullptr), _buffer_size(0)
+		, _stall_timeout_ms(1000), _read_pos(0), _stalled_pos(~0ull), _stalled_since_ms(0), _num_held(0), _num_skipped(0)
+	{
+	}
+
+	ShmReader::~ShmReader()
+	{
+		close();
+		free(_buffer);
+	}
+
+	bool ShmReader::open(const char* name, unsigned long long size_bytes)
+	{
+		close();
+#if LOGURU_SHM
+		_memory = shm_map(name, size_bytes, &_mapped_size);
+		if (!_memory) { return false; }
+		_read_pos = reinterpret_cast<ShmHeader*>(_memory)->read_pos.load(std::memory_order_acquire);
+		return true;
+#else
+		(void)name;
+		(void)size_bytes;
+		VLOG_F(g_internal_verbosity, "Shared memory not implemented on this system.");
+		return false;
+#endif
+	}
+
+	void ShmReader::close()
+	{
+#if LOGURU_SHM
+		if (_memory) {
+			munmap(_memory, static_cast<size_t>(_mapped_size));
+		}
+#endif
+		_memory = nullptr;
+		_mapped_size = 0;
+		_stalled_pos = ~0ull;
+		_num_held = 0;
+	}
+
+	void ShmReader::set_stall_timeout(unsigned timeout_ms)
+	{
+		_stall_timeout_ms = timeout_ms;
+	}
+
+	bool ShmReader::read(ShmRecord* out_record)
+	{
+#if LOGURU_SHM
+		ShmHeader* header = reinterpret_cast<ShmHeader*>(_memory);
+		if (!header) { return false; }
+		if (_num_held != 0) {
+			release_held();
+		}
+		const unsigned long long pos = _read_pos;
+		const unsigned long long write_pos = header->write_pos.load(std::memory_order_acquire);
+		if (pos == write_pos) {
+			return false;
+		}
+		const unsigned long long payload_size = shm_commit_word(header, pos).load(std::memory_order_acquire);
+		if (payload_size == 0 || (payload_size & SHM_RESERVED)) {
+			// Still being written, or the writer stalled or died before publishing it.
+			const long long now_ms = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+			if (pos != _stalled_pos) {
+				_stalled_pos = pos;
+				_stalled_since_ms = now_ms;
+				return false;
+			}
+			if (now_ms - _stalled_since_ms < static_cast<long long>(_stall_timeout_ms)) {
+				return false;
+			}
+			unsigned long long end = pos;
+			if (payload_size == 0) {
+				// The writer died between reserving and marking the record, so it is all zeroes.
+				// It ends where the next record starts; all writers after it mark theirs first thing.
+				do { end += 8; } while (end < write_pos && shm_commit_word(header, end).load(std::memory_order_acquire) == 0);
+				if (end == write_pos) {
+					return false; // Wait for the next record, or we can't tell where this one ends.
+				}
+			} else {
+				// Skip it, but keep the space until the writer is done with it.
+				if (_num_held == MAX_HELD) {
+					return false;
+				}
+				_held[_num_held++] = pos;
+				end = pos + shm_span(payload_size);
+			}
+			_read_pos = end;
+			if (_num_held == 0) {
+				header->read_pos.store(end, std::memory_order_release);
+			}
+			_stalled_pos = ~0ull;
+			++_num_skipped;
+			return read(out_record);
+		}
+		if (payload_size + 1 > _buffer_size) {
+			_buffer_size = payload_size + 1;
+			_buffer = reinterpret_cast<char*>(realloc(_buffer, static_cast<size_t>(_buffer_size)));
+		}
+		shm_copy_out(header, pos + 8, _buffer, static_cast<size_t>(payload_size));
+		_buffer[payload_size] = '\0';
+		const unsigned long long span = shm_span(payload_size);
+		shm_zero(header, pos, static_cast<size_t>(span));
+		_read_pos = pos + span;
+		if (_num_held == 0) {
+			header->read_pos.store(_read_pos, std::memory_order_release);
+		}
+
+		ShmRecordHeader record;
+		memcpy(&record, _buffer, sizeof(record));
+		out_record->verbosity   = static_cast<Verbosity>(record.verbosity);
+		out_record->line        = record.line;
+		out_record->depth       = record.depth;
+		out_record->time_us     = record.time_us;
+		out_record->pid         = record.pid;
+		out_record->program     = _buffer + sizeof(record);
+		out_record->thread_name = out_record->program + strlen(out_record->program) + 1;
+		out_record->file        = out_record->thread_name + strlen(out_record->thread_name) + 1;
+		out_record->message     = out_record->file + strlen(out_record->file) + 1;
+		return true;
+#else
+		(void)out_record;
+		return false;
+#endif
+	}
+
+	void ShmReader::release_held()
+	{
+#if LOGURU_SHM
+		ShmHeader* header = reinterpret_cast<ShmHeader*>(_memory);
+		unsigned num_kept = 0;
+		for (unsigned i = 0; i < _num_held; ++i) {
+			const unsigned long long commit_word = shm_commit_word(header, _held[i]).load(std::memory_order_acquire);
+			if ((commit_word & SHM_RESERVED) && shm_writer_alive(commit_word)) {
+				_held[num_kept++] = _held[i];
+			} else {
+				// Published too late to be read, or never will be.
+				shm_zero(header, _held[i], static_cast<size_t>(shm_span(commit_word)));
+			}
+		}
+		_num_held = num_kept;
+		// Everything else before _read_pos has been read.
+		header->read_pos.store(_num_held ? _held[0] : _read_pos, std::memory_order_release);
+#endif
+	}
+
+	unsigned long long ShmReader::num_dropped() const
+	{
+#if LOGURU_SHM
+		if (_memory) {
+			return reinterpret_cast<const ShmHeader*>(_memory)->dropped.load(std::memory_order_relaxed);
+		}
+#endif
+		return 0;
+	}
+
+	unsigned long long ShmReader::num_skipped() const
+	{
+		return _num_skipped;
+	}
+
+// ------------------------------------------------------------------------------
+	// Helpers:
+
+	Text::~Text() { free(_str); }
+
+#if LOGURU_USE_FMTLIB
+	static void format_into(fmt::memory_buffer& buffer, fmt::string_view format, fmt::format_args args)
+	{
+#if FMT_VERSION >= 80000
+		fmt::vformat_to(fmt::appender(buffer), format, args);
+#else
+		fmt::vformat_to(buffer, format, args);
+#endif
+		buffer.push_back('\0');
+	}
+
+	Text vtextprintf(fmt::string_view format, fmt::format_args args)
+	{
+		fmt::memory_buffer buffer;
+		format_into(buffer, format, args);
+		char* str = static_cast<char*>(malloc(buffer.size()));
+		memcpy(str, buffer.data(), buffer.size());
+		return Text(str);
+	}
+
+	// A thread's reusable buffer for formatted log messages.
+	struct FormatBuffer
+	{
+		fmt::memory_buffer buffer;
+		bool               in_use = false;
+	};
+
+	// Buffers beyond this are freed after use rather than kept for the next message.
+	static const size_t FORMAT_BUFFER_MAX_KEPT = 64 * 1024;
+
+	// Formats into the calling thread's FormatBuffer, so that logging does not allocate once the
+	// buffer has grown to fit. If that buffer is already in use further up the stack (a callback
+	// or the FATAL stack trace logging while a message is being delivered) a local one is used instead.
+	class FormattedText
+	{
+	public:
+		FormattedText(fmt::string_view format, fmt::format_args args)
+		{
+			ThreadLocals& locals = thread_locals();
+			if (!locals.format_buffer) {
+				locals.format_buffer = new FormatBuffer();
+			}
+			if (!locals.format_buffer->in_use) {
+				_shared = locals.format_buffer;
+				_shared->in_use = true;
+				_shared->buffer.clear();
+			}
+			// A constructor that throws does not get its destructor run, so release the buffer here.
+			try {
+				format_into(buffer(), format, args);
+			} catch (...) {
+				if (_shared) { _shared->in_use = false; }
+				throw;
+			}
+		}
+
+		~FormattedText()
+		{
+			if (_shared) {
+				if (_shared->buffer.capacity() > FORMAT_BUFFER_MAX_KEPT) {
+					_shared->buffer = fmt::memory_buffer();
+				}
+				_shared->in_use = false;
+			}
+		}
+
+		FormattedText(const FormattedText&) = delete;
+		FormattedText& operator=(const FormattedText&) = delete;
+
+		const char* c_str() const { return _shared ? _shared->buffer.data() : _local.data(); }
+
+	private:
+		fmt::memory_buffer& buffer() { return _shared ? _shared->buffer : _local; }
+
+		FormatBuffer*      _shared = nullptr;
+		fmt::memory_buffer _local;
+	};
+#elif LOGURU_USE_STD_FORMAT
+	Text vtextprintf(std::string_view format, std::format_args args)
+	{
+		const std::string str = std::vformat(format, args);
+		return Text(STRDUP(str.c_str()));
+	}
+
+	// A thread's reusable buffer for formatted log messages.
+	struct FormatBuffer
+	{
+		char text[LOGURU_STD_FORMAT_BUFFER_SIZE];
+		bool in_use = false;
+	};
+
+	// Where a FixedBufferIterator writes. Shared by all copies of the iterator.
+	struct FixedBuffer
+	{
+		char*        begin;
+		char*        pos;
+		char*        end;
+		std::string* overflow;   // Where the text continues once it runs out of room.
+		bool         overflowed; // If so, all of the text is in *overflow.
+	};
+
+	// Output iterator for std::vformat_to that writes into a FixedBuffer, moving on to its
+	// overflow string if the text does not fit, so that it is only ever formatted once.
+	class FixedBufferIterator
+	{
+	public:
+		using difference_type = std::ptrdiff_t;
+
+		class Writer
+		{
+		public:
+			explicit Writer(FixedBuffer* buffer) : _buffer(buffer) {}
+			const Writer& operator=(char c) const
+			{
+				if (!_buffer->overflowed) {
+					if (_buffer->pos < _buffer->end) {
+						*_buffer->pos++ = c;
+						return *this;
+					}
+					_buffer->overflow->reserve(2 * static_cast<size_t>(_buffer->pos - _buffer->begin));
+					_buffer->overflow->assign(_buffer->begin, _buffer->pos);
+					_buffer->overflowed = true;
+				}
+				_buffer->overflow->push_back(c);
+				return *this;
+			}
+
+		private:
+			FixedBuffer* _buffer;
+		};
+
+		FixedBufferIterator() = default;
+		explicit FixedBufferIterator(FixedBuffer* buffer) : _buffer(buffer) {}
+
+		Writer operator*() const { return Writer(_buffer); }
+		FixedBufferIterator& operator++() { return *this; }
+		FixedBufferIterator operator++(int) { return *this; }
+
+	private:
+		FixedBuffer* _buffer = nullptr;
+	};
+
+	// Formats into the calling thread's FormatBuffer, so that logging does not allocate.
+	// Messages that do not fit continue into a std::string. Messages logged while the buffer is
+	// already in use further up the stack (a callback or the FATAL stack trace logging while a
+	// message is being delivered) are formatted into the string from the start.
+	class FormattedText
+	{
+	public:
+		FormattedText(std::string_view format, std::format_args args)
+		{
+			ThreadLocals& locals = thread_locals();
+			if (!locals.format_buffer) {
+				locals.format_buffer = new FormatBuffer();
+			}
+			if (!locals.format_buffer->in_use) {
+				FormatBuffer* shared = locals.format_buffer;
+				shared->in_use = true;
+				// Keep the last byte for the terminating zero:
+				FixedBuffer fixed = {shared->text, shared->text, shared->text + sizeof(shared->text) - 1, &_overflow, false};
+				try {
+					std::vformat_to(FixedBufferIterator(&fixed), format, args);
+				} catch (...) {
+					shared->in_use = false;
+					throw;
+				}
+				if (fixed.overflowed) {
+					shared->in_use = false;
+				} else {
+					*fixed.pos = '\0';
+					_shared = shared;
+				}
+				return;
+			}
+			_overflow = std::vformat(format, args);
+		}
+
+		~FormattedText()
+		{
+			if (_shared) {
+				_shared->in_use = false;
+			}
+		}
+
+		FormattedText(const FormattedText&) = delete;
+		FormattedText& operator=(const FormattedText&) = delete;
+
+		const char* c_str() const { return _shared ? _shared->text : _overflow.c_str(); }
+
+	private:
+		FormatBuffer* _shared = nullptr;
+		std::string   _overflow;
+	};
+#else
+	struct FormatBuffer {};
+
+	LOGURU_PRINTF_LIKE(1, 0)
+	static Text vtextprintf(const char* format, va_list vlist)
+	{
+#ifdef _WIN32
+		int bytes_needed = _vscprintf(format, vlist);
+		CHECK_F(bytes_needed >= 0, "Bad string format: '%s'", format);
+		char* buff = (char*)malloc(bytes_needed+1);
+		vsnprintf(buff, bytes_needed+1, format, vlist);
+		return Text(buff);
+#else
+		char* buff = nullptr;
+		int result = vasprintf(&buff, format, vlist);
+		CHECK_F(result >= 0, "Bad string format: '" LOGURU_FMT(s) "'", format);
+		return Text(buff);
+#endif
+	}
+
+	Text textprintf(const char* format, ...)
+	{
+		va_list vlist;
+		va_start(vlist, format);
+		auto result = vtextprintf(format, vlist);
+		va_end(vlist);
+		return result;
+	}
+#endif
+
+	// Overloaded for variadic template matching.
+	Text textprintf()
+	{
+		return Text(static_cast<char*>(calloc(1, 1)));
+	}
+
+	static const char* indentation(unsigned depth)
+	{
+		static const char buff[] =
+		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
+		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
+		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
+		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   "
+		".   .   .   .   .   .   .   .   .   .   " ".   .   .   .   .   .   .   .   .   .   ";
+		static const size_t INDENTATION_WIDTH = 4;
+		static const size_t NUM_INDENTATIONS = (sizeof(buff) - 1) / INDENTATION_WIDTH;
+		depth = std::min<unsigned>(depth, NUM_INDENTATIONS);
+		return buff + INDENTATION_WIDTH * (NUM_INDENTATIONS - depth);
+	}
+
+	static void parse_args(int& argc, char* argv[], const char* verbosity_flag)
+	{
+		int arg_dest = 1;
+		int out_argc = argc;
+
+		for (int arg_it = 1; arg_it < argc; ++arg_it) {
+			auto cmd = argv[arg_it];
+			auto arg_len = strlen(verbosity_flag);
+
+			bool last_is_alpha = false;
+			#if LOGURU_USE_LOCALE
+			try {  // locale variant of isalpha will throw on error
+				last_is_alpha = std::isalpha(cmd[arg_len], std::locale(""));
+			}
+			catch (...) {
+				last_is_alpha = std::isalpha(static_cast<int>(cmd[arg_len]));
+			}
+			#else
+			last_is_alpha = std::isalpha(static_cast<int>(cmd[arg_len]));
+			#endif
+
+			if (strncmp(cmd, verbosity_flag, arg_len) == 0 && !last_is_alpha) {
+				out_argc -= 1;
+				auto value_str = cmd + arg_len;
+				if (value_str[0] == '\0') {
+					// Value in separate argument
+					arg_it += 1;
+					CHECK_LT_F(arg_it, argc, "Missing verbosiy level after " LOGURU_FMT(s) "", verbosity_flag);
+					value_str = argv[arg_it];
+					out_argc -= 1;
+				}
+				if (*value_str == '=') { value_str += 1; }
+
+				auto req_verbosity = get_verbosity_from_name(value_str);
+				if (req_verbosity != Verbosity_INVALID) {
+					g_stderr_verbosity = req_verbosity;
+				} else {
+					char* end = 0;
+					g_stderr_verbosity = static_cast<int>(strtol(value_str, &end, 10));
+					CHECK_F(end && *end == '\0',
+						"Invalid verbosity. Expected integer, INFO, WARNING, ERROR or OFF, got '" LOGURU_FMT(s) "'", value_str);
+				}
+			} else {
+				argv[arg_dest++] = argv[arg_it];
+			}
+		}
+
+		argc = out_argc;
+		argv[argc] = nullptr;
+	}
+
+	static long long now_ns()
+	{
+		return duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	// Returns the part of the path after the last / or \ (if any).
+	const char* filename(const char* path)
+	{
+		for (auto ptr = path; *ptr; ++ptr) {
+			if (*ptr == '/' || *ptr == '\\') {
+				path = ptr + 1;
+			}
+		}
+		return path;
+	}
+
+	// ------------------------------------------------------------------------------
+
+	static void on_atexit()
+	{
+		VLOG_F(g_internal_verbosity, "atexit");
+		flush();
+	}
+
+	static void install_signal_handlers(const SignalOptions& signal_options);
+
+	static void write_hex_digit(std::string& out, unsigned num)
+	{
+		DCHECK_LT_F(num, 16u);
+		if (num < 10u) { out.push_back(char('0' + num)); }
+		else { out.push_back(char('A' + num - 10)); }
+	}
+
+	static void write_hex_byte(std::string& out, uint8_t n)
+	{
+		write_hex_digit(out, n >> 4u);
+		write_hex_digit(out, n & 0x0f);
+	}
+
+	static void escape(std::string& out, const std::string& str)
+	{
+		for (char c : str) {
+			/**/ if (c == '\a') { out += "\\a";  }
+			else if (c == '\b') { out += "\\b";  }
+			else if (c == '\f') { out += "\\f";  }
+			else if (c == '\n') { out += "\\n";  }
+			else if (c == '\r') { out += "\\r";  }
+			else if (c == '\t') { out += "\\t";  }
+			else if (c == '\v') { out += "\\v";  }
+			else if (c == '\\') { out += "\\\\"; }
+			else if (c == '\'') { out += "\\\'"; }
+			else if (c == '\"') { out += "\\\""; }
+			else if (c == ' ')  { out += "\\ ";  }
+			else if (0 <= c && c < 0x20) { // ASCI control character:
+			// else if (c < 0x20 || c != (c & 127)) { // ASCII control character or UTF-8:
+				out += "\\x";
+				write_hex_byte(out, static_cast<uint8_t>(c));
+			} else { out += c; }
+		}
+	}
+
+	Text errno_as_text()
+	{
+		char buff[256];
+	#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+		// GNU Version
+		return Text(STRDUP(strerror_r(errno, buff, sizeof(buff))));
+	#elif defined(__APPLE__) || _POSIX_C_SOURCE >= 200112L
+		// XSI Version
+		strerror_r(errno, buff, sizeof(buff));
+		return Text(strdup(buff));
+	#elif defined(_WIN32)
+		strerror_s(buff, sizeof(buff), errno);
+		return Text(STRDUP(buff));
+	#else
+		// Not thread-safe.
+		return Text(STRDUP(strerror(errno)));
+	#endif
+	}
+
+	void init(int& argc, char* argv[], const Options& options)
+	{
+		CHECK_GT_F(argc,       0,       "Expected proper argc/argv");
+		CHECK_EQ_F(argv[argc], nullptr, "Expected proper argc/argv");
+
+		s_argv0_filename = filename(argv[0]);
+
+		#ifdef _WIN32
+			#define getcwd _getcwd
+		#endif
+
+		if (!getcwd(s_current_dir, sizeof(s_current_dir))) {
+			const auto error_text = errno_as_text();
+			LOG_F(WARNING, "Failed to get current working directory: " LOGURU_FMT(s) "", error_text.c_str());
+		}
+
+		s_arguments = "";
+		for (int i = 0; i < argc; ++i) {
+			escape(s_arguments, argv[i]);
+			if (i + 1 < argc) {
+				s_arguments += " ";
+			}
+		}
+
+		if (options.verbosity_flag) {
+			parse_args(argc, argv, options.verbosity_flag);
+		}
+
+		if (const auto main_thread_name = options.main_thread_name) {
+			#if LOGURU_PTLS_NAMES || LOGURU_WINTHREADS
+				set_thread_name(main_thread_name);
+			#elif LOGURU_PTHREADS
+				char old_thread_name[16] = {0};
+				auto this_thread = pthread_self();
+				#if defined(__APPLE__) || defined(__linux__) || defined(__sun)
+					pthread_getname_np(this_thread, old_thread_name, sizeof(old_thread_name));
+				#endif
+				if (old_thread_name[0] == 0) {
+					#ifdef __APPLE__
+						pthread_setname_np(main_thread_name);
+					#elif defined(__FreeBSD__) || defined(__OpenBSD__)
+						pthread_set_name_np(this_thread, main_thread_name);
+					#elif defined(__linux__) || defined(__sun)
+						pthread_setname_np(this_thread, main_thread_name);
+					#endif
+				}
+			#endif // LOGURU_PTHREADS
+		}
+
+		if (g_stderr_verbosity >= Verbosity_INFO) {
+			if (g_preamble_header) {
+				char preamble_explain[LOGURU_PREAMBLE_WIDTH];
+				print_preamble_header(preamble_explain, sizeof(preamble_explain));
+				if (g_colorlogtostderr && s_terminal_has_color) {
+					fprintf(stderr, "%s%s%s\n", terminal_reset(), terminal_dim(), preamble_explain);
+				} else {
+					fprintf(stderr, "%s\n", preamble_explain);
+				}
+			}
+			fflush(stderr);
+		}
+		VLOG_F(g_internal_verbosity, "arguments: " LOGURU_FMT(s) "", s_arguments.c_str());
+		if (strlen(s_current_dir) != 0)
+		{
+			VLOG_F(g_internal_verbosity, "Current dir: " LOGURU_FMT(s) "", s_current_dir);
+		}
+		VLOG_F(g_internal_verbosity, "stderr verbosity: " LOGURU_FMT(d) "", g_stderr_verbosity);
+		VLOG_F(g_internal_verbosity, "-----------------------------------");
+
+		install_signal_handlers(options.signal_options);
+
+		atexit(on_atexit);
+	}
+
+	static void stop_background_threads()
+	{
+		std::thread* threads[4];
+		{
+			std::lock_guard<std::recursive_mutex> lock(s_mutex);
+			threads[0] = s_flush_thread;
+			threads[1] = s_scope_report_thread;
+			threads[2] = s_watchdog_thread;
+			threads[3] = s_stderr_thread;
+			s_flush_thread = s_scope_report_thread = s_watchdog_thread = s_stderr_thread = nullptr;
+			std::lock_guard<std::mutex> background_lock(s_background_mutex);
+			s_background_quit = true;
+		}
+		s_background_cv.notify_all();
+		// Joined without s_mutex, which they may be waiting for:
+		for (std::thread* thread : threads) {
+			if (thread) {
+				thread->join();
+				delete thread;
+			}
+		}
+		std::lock_guard<std::mutex> background_lock(s_background_mutex);
+		s_background_quit = false;
+	}
+
+	void shutdown()
+	{
+		VLOG_F(g_internal_verbosity, "loguru::shutdown()");
+		stop_background_threads();
+		remove_all_callbacks();
+		set_fatal_handler(nullptr);
+		set_verbosity_to_name_callback(nullptr);
+		set_name_to_verbosity_callback(nullptr);
+	}
+
+	void write_date_time(char* buff, unsigned long long buff_size)
+	{
+		auto now = system_clock::now();
+		long long ms_since_epoch = duration_cast<milliseconds>(now.time_since_epoch()).count();
+		time_t sec_since_epoch = time_t(ms_since_epoch / 1000);
+		tm time_info;
+		localtime_r(&sec_since_epoch, &time_info);
+		snprintf(buff, buff_size, "%04d%02d%02d_%02d%02d%02d.%03lld",
+			1900 + time_info.tm_year, 1 + time_info.tm_mon, time_info.tm_mday,
+			time_info.tm_hour, time_info.tm_min, time_info.tm_sec, ms_since_epoch % 1000);
+	}
+
+	const char* argv0_filename()
+	{
+		return s_argv0_filename.c_str();
+	}
+
+	const char* arguments()
+	{
+		return s_arguments.c_str();
+	}
+
+	const char* current_dir()
+	{
+		return s_current_dir;
+	}
+
+	const char* home_dir()
+	{
+		#ifdef __MINGW32__
+			auto home = getenv("USERPROFILE");
+			CHECK_F(home != nullptr, "Missing USERPROFILE");
+			return home;
+		#elif defined(_WIN32)
+			char* user_profile;
+			size_t len;
+			errno_t err = _dupenv_s(&user_profile, &len, "USERPROFILE");
+			CHECK_F(err == 0, "Missing USERPROFILE");
+			return user_profile;
+		#else // _WIN32
+			auto home = getenv("HOME");
+			CHECK_F(home != nullptr, "Missing HOME");
+			return home;
+		#endif // _WIN32
+	}
+
+	void suggest_log_path(const char* prefix, char* buff, unsigned long long buff_size)
+	{
+		if (prefix[0] == '~') {
+			snprintf(buff, buff_size - 1, "%s%s", home_dir(), prefix + 1);
+		} else {
+			snprintf(buff, buff_size - 1, "%s", prefix);
+		}
+
+		// Check for terminating /
+		size_t n = strlen(buff);
+		if (n != 0) {
+			if (buff[n - 1] != '/') {
+				CHECK_F(n + 2 < buff_size, "Filename buffer too small");
+				buff[n] = '/';
+				buff[n + 1] = '\0';
+			}
+		}
+
+	#ifdef _WIN32
+		strncat_s(buff, buff_size - strlen(buff) - 1, s_argv0_filename.c_str(), buff_size - strlen(buff) - 1);
+		strncat_s(buff, buff_size - strlen(buff) - 1, "/",                      buff_size - strlen(buff) - 1);
+		write_date_time(buff + strlen(buff),    buff_size - strlen(buff));
+		strncat_s(buff, buff_size - strlen(buff) - 1, ".log",                   buff_size - strlen(buff) - 1);
+	#else
+		strncat(buff, s_argv0_filename.c_str(), buff_size - strlen(buff) - 1);
+		strncat(buff, "/", buff_size - strlen(buff) - 1);
+		write_date_time(buff + strlen(buff), buff_size - strlen(buff));
+		strncat(buff, ".log", buff_size - strlen(buff) - 1);
+	#endif
+	}
+
+	bool create_directories(const char* file_path_const)
+	{
+		CHECK_F(file_path_const && *file_path_const);
+		char* file_path = STRDUP(file_path_const);
+		for (char* p = strchr(file_path + 1, '/'); p; p = strchr(p + 1, '/')) {
+			*p = '\0';
+
+	#ifdef _WIN32
+			if (_mkdir(file_path) == -1) {
+	#else
+			if (mkdir(file_path, 0755) == -1) {
+	#endif
+				if (errno != EEXIST) {
+					LOG_F(ERROR, "Failed to create directory '" LOGURU_FMT(s) "'", file_path);
+					LOG_IF_F(ERROR, errno == EACCES,       "EACCES");
+					LOG_IF_F(ERROR, errno == ENAMETOOLONG, "ENAMETOOLONG");
+					LOG_IF_F(ERROR, errno == ENOENT,       "ENOENT");
+					LOG_IF_F(ERROR, errno == ENOTDIR,      "ENOTDIR");
+					LOG_IF_F(ERROR, errno == ELOOP,        "ELOOP");
+
+					*p = '/';
+					free(file_path);
+					return false;
+				}
+			}
+			*p = '/';
+		}
+		free(file_path);
+		return true;
+	}
+	// Expands a leading ~ of path_in into path, creates all directories and opens the file.
+	static FILE* open_log_file(const char* path_in, const char* mode_str, char* path, size_t path_size)
 	{
-		char path[PATH_MAX];
 		if (path_in[0] == '~') {
-			snprintf(path, sizeof(path) - 1, "%s%s", home_dir(), path_in + 1);
+			snprintf(path, path_size - 1, "%s%s", home_dir(), path_in + 1);
+		} else {
+			snprintf(path, path_size - 1, "%s", path_in);
+		}
+
+		if (!create_directories(path)) {
+			LOG_F(ERROR, "Failed to create directories to '" LOGURU_FMT(s) "'", path);
+		}
+
+		FILE* file;
+	#ifdef _WIN32
+		file = _fsopen(path, mode_str, _SH_DENYNO);
+	#else
+		file = fopen(path, mode_str);
+	#endif
+		if (!file) {
+			LOG_F(ERROR, "Failed to open '" LOGURU_FMT(s) "'", path);
+		}
+		return file;
+	}
+
+	bool add_file(const char* path_in, FileMode mode, Verbosity verbosity)
+	{
+		char path[PATH_MAX];
+		const char* mode_str = (mode == FileMode::Truncate ? "w" : "a");
+		FILE* file = open_log_file(path_in, mode_str, path, sizeof(path));
+		if (!file) {
+			return false;
+		}
+#if LOGURU_WITH_FILEABS
+		FileAbs* file_abs = new FileAbs(); // this is deleted in file_close;
+		snprintf(file_abs->path, sizeof(file_abs->path) - 1, "%s", path);
+		snprintf(file_abs->mode_str, sizeof(file_abs->mode_str) - 1, "%s", mode_str);
+		stat(file_abs->path, &file_abs->st);
+		file_abs->fp = file;
+		file_abs->verbosity = verbosity;
+		add_callback(path_in, file_log, file_abs, verbosity, file_close, file_flush);
+#else
+		add_callback(path_in, file_log, file, verbosity, file_close, file_flush);
+#endif
+
+		if (mode == FileMode::Append) {
+			fprintf(file, "\n\n\n\n\n");
+		}
+		if (!s_arguments.empty()) {
+			fprintf(file, "arguments: %s\n", s_arguments.c_str());
+		}
+		if (strlen(s_current_dir) != 0) {
+			fprintf(file, "Current dir: %s\n", s_current_dir);
+		}
+		fprintf(file, "File verbosity level: %d\n", verbosity);
+		if (g_preamble_header) {
+			char preamble_explain[LOGURU_PREAMBLE_WIDTH];
+			print_preamble_header(preamble_explain, sizeof(preamble_explain));
+			fprintf(file, "%s\n", preamble_explain);
+		}
+		fflush(file);
+
+		VLOG_F(g_internal_verbosity, "Logging to '" LOGURU_FMT(s) "', mode: '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", path, mode_str, verbosity);
+		return true;
+	}
+
+	bool add_json_file(const char* path_in, FileMode mode, Verbosity verbosity)
+	{
+		char path[PATH_MAX];
+		const char* mode_str = (mode == FileMode::Truncate ? "w" : "a");
+		FILE* file = open_log_file(path_in, mode_str, path, sizeof(path));
+		if (!file) {
+			return false;
+		}
+		add_callback(path_in, json_log, new JsonSink{file, {}}, verbosity, json_close, json_flush);
+
+		VLOG_F(g_internal_verbosity, "Logging JSON to '" LOGURU_FMT(s) "', mode: '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", path, mode_str, verbosity);
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	// Chrome trace file, see add_trace_file.
+	//
+	// Each thread appends its events to its own TraceBuffer, and writes them to the file itself once
+	// TRACE_BUFFER_BYTES have piled up. flush() and removing the sink write out all the buffers.
+	// An async worker adds the messages it delivers to its own buffer, but on the track of the thread
+	// that logged them.
+	// Lock order: s_trace_buffers_mutex, then a TraceBuffer::mutex, then TraceSink::file_mutex.
+
+	static const size_t TRACE_BUFFER_BYTES = 64 * 1024;
+
+	struct TraceSink
+	{
+		FILE*      file;
+		std::mutex file_mutex;
+		long long  start_ns; // Timestamps are relative to this, to keep their nanoseconds.
+		long long  pid;
+	};
+
+	struct TraceBuffer
+	{
+		std::mutex        mutex;  // Only contended while another thread writes the buffer out.
+		std::string       events; // Each followed by ",\n".
+		long              tid;    // Of the thread owning the buffer; the kernel thread id on Linux, like message_thread_id.
+		std::vector<long> named;  // Tracks whose thread_name event has been added for the current sink.
+	};
+
+	static std::atomic<TraceSink*>  s_trace_sink { nullptr };
+	static std::atomic<int>         s_trace_verbosity { Verbosity_OFF };
+#ifndef __linux__
+	static std::atomic<long>        s_next_trace_tid { 1 };
+#endif
+	static std::mutex               s_trace_buffers_mutex;
+	static std::vector<TraceBuffer*> s_trace_buffers;
+
+	// With buffer.mutex locked.
+	static void trace_write_out(TraceSink* sink, TraceBuffer& buffer)
+	{
+		if (!buffer.events.empty()) {
+			std::lock_guard<std::mutex> lock(sink->file_mutex);
+			fwrite(buffer.events.data(), 1, buffer.events.size(), sink->file);
+		}
+		buffer.events.clear();
+	}
+
+	static void trace_write_out_all(TraceSink* sink)
+	{
+		std::lock_guard<std::mutex> lock(s_trace_buffers_mutex);
+		for (TraceBuffer* buffer : s_trace_buffers) {
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			trace_write_out(sink, *buffer);
+		}
+	}
+
+	static void trace_thread_exit(TraceBuffer* buffer)
+	{
+		if (!buffer) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(s_trace_buffers_mutex);
+		{
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			if (TraceSink* sink = s_trace_sink.load()) {
+				trace_write_out(sink, *buffer);
+			}
+		}
+		s_trace_buffers.erase(std::remove(s_trace_buffers.begin(), s_trace_buffers.end(), buffer), s_trace_buffers.end());
+		delete buffer;
+	}
+
+	// Writes the "pid", "tid" and "ts" members of an event.
+	static void trace_write_ids(std::string& out, const TraceSink* sink, long tid, long long time_ns)
+	{
+		char buff[96];
+		snprintf(buff, sizeof(buff), "\"pid\":%lld,\"tid\":%ld,\"ts\":%.3f",
+			sink->pid, tid, static_cast<double>(time_ns - sink->start_ns) / 1e3);
+		out += buff;
+	}
+
+	// Calls write_event(out, sink, tid) to add an event to this thread's buffer, if there is a trace sink.
+	// The event goes on the track of thread `tid`, or of this thread if it is 0.
+	template<typename Fn>
+	static void trace_add(long tid, Fn write_event)
+	{
+		TraceBuffer*& buffer = thread_locals().trace_buffer;
+		if (!buffer) {
+			buffer = new TraceBuffer();
+#ifdef __linux__
+			buffer->tid = static_cast<long>(syscall(SYS_gettid));
+#else
+			buffer->tid = s_next_trace_tid++;
+#endif
+			std::lock_guard<std::mutex> lock(s_trace_buffers_mutex);
+			s_trace_buffers.push_back(buffer);
+		}
+		if (tid == 0) {
+			tid = buffer->tid;
+		}
+
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		// Checked with the buffer locked, since trace_close writes out every buffer before deleting the sink.
+		TraceSink* sink = s_trace_sink.load();
+		if (!sink) {
+			return;
+		}
+		std::string& out = buffer->events;
+		if (std::find(buffer->named.begin(), buffer->named.end(), tid) == buffer->named.end()) {
+			// The name of the thread that logged the message, also when an async worker delivers it.
+			char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+			get_thread_name(thread_name, LOGURU_THREADNAME_WIDTH + 1, false);
+			out += "{\"name\":\"thread_name\",\"ph\":\"M\",";
+			trace_write_ids(out, sink, tid, sink->start_ns);
+			out += ",\"args\":{\"name\":\"";
+			json_escape(out, thread_name);
+			out += "\"}},\n";
+			buffer->named.push_back(tid);
+		}
+		write_event(out, sink, tid);
+		out += ",\n";
+		if (out.size() >= TRACE_BUFFER_BYTES) {
+			trace_write_out(sink, *buffer);
+		}
+	}
+
+	static void trace_write_args(std::string& out, const char* file, unsigned line)
+	{
+		out += ",\"args\":{\"file\":\"";
+		json_escape(out, s_strip_file_path ? filename(file) : file);
+		out += "\",\"line\":";
+		out += std::to_string(line);
+		out += '}';
+	}
+
+	// A complete ("X") event for a LogScopeRAII.
+	static void trace_scope(const char* file, unsigned line, const char* name, long long start_ns, long long end_ns)
+	{
+		trace_add(0, [&](std::string& out, const TraceSink* sink, long tid) {
+			// The scope may have started before this trace file (while another one was open):
+			start_ns = std::max(start_ns, sink->start_ns);
+			out += "{\"name\":\"";
+			json_escape(out, name);
+			out += "\",\"cat\":\"scope\",\"ph\":\"X\",";
+			trace_write_ids(out, sink, tid, start_ns);
+			char buff[48];
+			snprintf(buff, sizeof(buff), ",\"dur\":%.3f", static_cast<double>(end_ns - start_ns) / 1e3);
+			out += buff;
+			trace_write_args(out, file, line);
+			out += '}';
+		});
+	}
+
+	// An instant ("i") event for each message.
+	static void trace_log(void*, const Message& message)
+	{
+		if (message.prefix[0] == '{' || message.prefix[0] == '}') {
+			return; // The lines of a LOG_SCOPE_F; the scope itself is traced by LogScopeRAII.
+		}
+		const ThreadLocals& locals = thread_locals();
+		long long time_ns = now_ns();
+		if (locals.log_time_us != 0) {
+			// Delivered by an async worker: back to when it was logged, see message_time_us.
+			const long long now_us = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+			time_ns -= (now_us - message_time_us()) * 1000;
+		}
+		trace_add(locals.log_thread_id, [&](std::string& out, const TraceSink* sink, long tid) {
+			out += "{\"name\":\"";
+			json_escape(out, message.prefix);
+			json_escape(out, message.message);
+			out += "\",\"cat\":\"";
+			if (const char* level_name = get_verbosity_name(message.verbosity)) {
+				json_escape(out, level_name);
+			} else {
+				out += std::to_string(message.verbosity);
+			}
+			out += "\",\"ph\":\"i\",\"s\":\"t\",";
+			trace_write_ids(out, sink, tid, time_ns);
+			trace_write_args(out, message.filename, message.line);
+			out += '}';
+		});
+	}
+
+	// Called by flush(). Not the on_flush of the sink, which would write out every buffer after every message.
+	static void trace_flush()
+	{
+		std::lock_guard<std::mutex> lock(s_trace_buffers_mutex);
+		// Checked with s_trace_buffers_mutex locked, since trace_close takes it before deleting the sink.
+		TraceSink* sink = s_trace_sink.load();
+		if (!sink) {
+			return;
+		}
+		for (TraceBuffer* buffer : s_trace_buffers) {
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			trace_write_out(sink, *buffer);
+		}
+		std::lock_guard<std::mutex> file_lock(sink->file_mutex);
+		fflush(sink->file);
+	}
+
+	static void trace_close(void* user_data)
+	{
+		TraceSink* sink = reinterpret_cast<TraceSink*>(user_data);
+		s_trace_verbosity = Verbosity_OFF;
+		s_trace_sink = nullptr;
+		trace_write_out_all(sink);
+		// Every event ends with a comma, so finish with one that does not.
+		fprintf(sink->file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lld,\"args\":{\"name\":\"", sink->pid);
+		std::string name;
+		json_escape(name, argv0_filename());
+		fprintf(sink->file, "%s\"}}\n]\n", name.c_str());
+		fclose(sink->file);
+		delete sink;
+	}
+
+	bool add_trace_file(const char* path_in, Verbosity verbosity)
+	{
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		if (s_trace_sink) {
+			LOG_F(ERROR, "Only one trace file can be written at a time, so not writing to '" LOGURU_FMT(s) "'", path_in);
+			return false;
+		}
+		char path[PATH_MAX];
+		FILE* file = open_log_file(path_in, "w", path, sizeof(path));
+		if (!file) {
+			return false;
+		}
+		fputs("[\n", file);
+
+		TraceSink* sink = new TraceSink();
+		sink->file = file;
+		sink->start_ns = now_ns();
+#ifdef _WIN32
+		sink->pid = static_cast<long long>(_getpid());
+#else
+		sink->pid = static_cast<long long>(getpid());
+#endif
+		{
+			// Events of a previous trace file that were added after it was closed.
+			std::lock_guard<std::mutex> buffers_lock(s_trace_buffers_mutex);
+			for (TraceBuffer* buffer : s_trace_buffers) {
+				std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+				buffer->events.clear();
+				buffer->named.clear();
+			}
+		}
+		s_trace_sink = sink;
+		add_callback(path_in, trace_log, sink, verbosity, trace_close, nullptr); // Sets s_trace_verbosity.
+
+		VLOG_F(g_internal_verbosity, "Writing trace to '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", path, verbosity);
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	// Network sink, see add_network_sink.
+
+#ifndef _WIN32
+	static const size_t NETWORK_MAX_QUEUED_BYTES = 8 * 1024 * 1024; // Records beyond this are dropped.
+	static const size_t NETWORK_BATCH_BYTES      = 64 * 1024;       // Send as soon as we have this much...
+	static const int    NETWORK_BATCH_DELAY_MS   = 5;               // ...or when the oldest record is this old.
+	static const size_t NETWORK_MAX_DATAGRAM     = 60 * 1024;
+	static const size_t NETWORK_REPLAY_BYTES     = 1024 * 1024;     // Read from the spool at a time. Longer records are truncated.
+	static const int    NETWORK_RECONNECT_MS     = 1000;
+
+	struct NetworkSink
+	{
+		std::string             host;
+		std::string             port;
+		bool                    udp;
+		int                     fd;
+		long long               last_connect_ns;
+		FILE*                   spool;        // nullptr if no spool file was given.
+		long long               spool_offset; // Everything before this has been replayed.
+		long long               spool_size;
+		std::string             sending;      // Owned by the thread.
+		std::vector<char>       replay;       // Owned by the thread. See network_replay_spool.
+		std::string             line;         // Scratch for the logging thread, we are called with s_mutex locked.
+		std::mutex              mutex;        // Protects the fields below.
+		std::condition_variable cv;
+		std::string             pending;      // Framed records waiting for the thread.
+		bool                    quit;
+		std::thread             thread;
+	};
+
+	static void append_record(std::string& out, const char* data, size_t size)
+	{
+		const uint32_t length = static_cast<uint32_t>(size);
+		out += static_cast<char>((length >> 24) & 0xff);
+		out += static_cast<char>((length >> 16) & 0xff);
+		out += static_cast<char>((length >>  8) & 0xff);
+		out += static_cast<char>( length        & 0xff);
+		out.append(data, size);
+	}
+
+	// The size of the record starting at data, including its length prefix.
+	static size_t record_size(const char* data)
+	{
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+		return 4 + ((size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]));
+	}
+
+	// Returns the length of the longest prefix of data that is complete records.
+	// The first record is included even if it is longer than max_size.
+	static size_t complete_records(const char* data, size_t size, size_t max_size)
+	{
+		size_t pos = 0;
+		while (pos + 4 <= size) {
+			const size_t length = record_size(data + pos);
+			if (pos + length > size || (pos != 0 && pos + length > max_size)) {
+				break;
+			}
+			pos += length;
+		}
+		return pos;
+	}
+
+	static bool network_connect(NetworkSink* sink)
+	{
+		sink->last_connect_ns = now_ns();
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family   = AF_UNSPEC;
+		hints.ai_socktype = sink->udp ? SOCK_DGRAM : SOCK_STREAM;
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(sink->host.c_str(), sink->port.c_str(), &hints, &addresses) != 0) {
+			return false;
+		}
+		for (addrinfo* address = addresses; address; address = address->ai_next) {
+			const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (fd == -1) { continue; }
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+				if (!sink->udp) {
+					int one = 1; // We do our own coalescing.
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				}
+				timeval timeout = {5, 0}; // Don't hang forever on a stuck collector.
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+				sink->fd = fd;
+				break;
+			}
+			close(fd);
+		}
+		freeaddrinfo(addresses);
+		return sink->fd != -1;
+	}
+
+	static void network_disconnect(NetworkSink* sink)
+	{
+		if (sink->fd != -1) {
+			close(sink->fd);
+			sink->fd = -1;
+		}
+	}
+
+	// Sends complete records: all in one go over TCP, in datagrams of whole records over UDP.
+	static bool network_send(NetworkSink* sink, const char* data, size_t size)
+	{
+		while (size > 0) {
+			size_t chunk = size;
+			if (sink->udp) {
+				chunk = complete_records(data, size, NETWORK_MAX_DATAGRAM);
+				if (chunk > NETWORK_MAX_DATAGRAM) {
+					// A record too long for a datagram (spooled by an older version, say). Skip it.
+					data += chunk;
+					size -= chunk;
+					continue;
+				}
+			}
+			const auto bytes = send(sink->fd, data, chunk, MSG_NOSIGNAL);
+			if (bytes < 0) {
+				if (errno == EINTR) { continue; }
+				network_disconnect(sink);
+				return false;
+			}
+			if (sink->udp && static_cast<size_t>(bytes) != chunk) {
+				network_disconnect(sink);
+				return false;
+			}
+			data += bytes;
+			size -= static_cast<size_t>(bytes);
+		}
+		return true;
+	}
+
+	static void network_spool(NetworkSink* sink, const std::string& data)
+	{
+		if (!sink->spool) { return; } // Dropped.
+		fseek(sink->spool, 0, SEEK_END);
+		fwrite(data.data(), 1, data.size(), sink->spool);
+		fflush(sink->spool);
+		sink->spool_size += static_cast<long long>(data.size());
+	}
+
+	// Sends what is in the spool file, in order. Returns true when it is empty.
+	static bool network_replay_spool(NetworkSink* sink)
+	{
+		std::vector<char>& buffer = sink->replay;
+		buffer.resize(NETWORK_REPLAY_BYTES);
+		while (sink->spool_offset < sink->spool_size) {
+			fseek(sink->spool, static_cast<long>(sink->spool_offset), SEEK_SET);
+			const size_t bytes = fread(buffer.data(), 1, buffer.size(), sink->spool);
+			const size_t records = complete_records(buffer.data(), bytes, buffer.size());
+			if (records == 0) {
+				// A record longer than the buffer, or cut short (by a crash while spooling, say):
+				// skip it rather than getting stuck on it.
+				const long long skipped = bytes < 4 ? sink->spool_size : static_cast<long long>(record_size(buffer.data()));
+				sink->spool_offset = std::min(sink->spool_offset + skipped, sink->spool_size);
+				continue;
+			}
+			if (!network_send(sink, buffer.data(), records)) {
+				return false;
+			}
+			sink->spool_offset += static_cast<long long>(records);
+		}
+		if (sink->spool_size != 0) {
+			fflush(sink->spool);
+			if (ftruncate(fileno(sink->spool), 0) == 0) {
+				sink->spool_offset = 0;
+				sink->spool_size = 0;
+			}
+		}
+		return true;
+	}
+
+	static void network_send_batch(NetworkSink* sink)
+	{
+		if (sink->fd == -1 && now_ns() - sink->last_connect_ns >= NETWORK_RECONNECT_MS * 1000000ll) {
+			network_connect(sink);
+		}
+		if (sink->spool_offset < sink->spool_size) {
+			// Keep the order: the new records go after what is already spooled.
+			network_spool(sink, sink->sending);
+			if (sink->fd != -1) {
+				network_replay_spool(sink);
+			}
+		} else if (sink->fd == -1 || !network_send(sink, sink->sending.data(), sink->sending.size())) {
+			network_spool(sink, sink->sending);
+		}
+		sink->sending.clear();
+	}
+
+	static void network_thread(NetworkSink* sink)
+	{
+		for (;;) {
+			bool quit;
+			{
+				std::unique_lock<std::mutex> lock(sink->mutex);
+				const bool spooled = sink->spool_offset < sink->spool_size;
+				sink->cv.wait_for(lock, std::chrono::milliseconds(NETWORK_RECONNECT_MS),
+					[sink]{ return !sink->pending.empty() || sink->quit; });
+				if (!sink->quit && sink->pending.size() < NETWORK_BATCH_BYTES) {
+					// Give more records a chance to join this batch:
+					sink->cv.wait_for(lock, std::chrono::milliseconds(NETWORK_BATCH_DELAY_MS),
+						[sink]{ return sink->pending.size() >= NETWORK_BATCH_BYTES || sink->quit; });
+				}
+				quit = sink->quit;
+				if (sink->pending.empty() && !spooled) {
+					if (quit) { return; }
+					continue;
+				}
+				std::swap(sink->pending, sink->sending);
+			}
+			network_send_batch(sink);
+			if (quit) {
+				return; // Whatever is still spooled is replayed next time.
+			}
+		}
+	}
+
+	void network_log(void* user_data, const Message& message)
+	{
+		NetworkSink* sink = reinterpret_cast<NetworkSink*>(user_data);
+		std::string& line = sink->line;
+		line.clear();
+		line += message.preamble;
+		line += message.indentation;
+		line += message.prefix;
+		line += message.message;
+		line += fields_text(message);
+		// Make sure every record fits in a datagram, and can be replayed from the spool:
+		line.resize(std::min(line.size(), (sink->udp ? NETWORK_MAX_DATAGRAM : NETWORK_REPLAY_BYTES) - 4));
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			if (sink->pending.size() + line.size() + 4 > NETWORK_MAX_QUEUED_BYTES) {
+				return; // Dropped.
+			}
+			append_record(sink->pending, line.data(), line.size());
+		}
+		sink->cv.notify_one();
+	}
+
+	void network_close(void* user_data)
+	{
+		NetworkSink* sink = reinterpret_cast<NetworkSink*>(user_data);
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			sink->quit = true;
+		}
+		sink->cv.notify_one();
+		sink->thread.join();
+		network_disconnect(sink);
+		if (sink->spool) {
+			fclose(sink->spool);
+		}
+		delete sink;
+	}
+#endif // _WIN32
+
+	bool add_network_sink(const char* url, Verbosity verbosity, const char* spool_path)
+	{
+#ifndef _WIN32
+		bool udp;
+		if (strncmp(url, "tcp://", 6) == 0) {
+			udp = false;
+		} else if (strncmp(url, "udp://", 6) == 0) {
+			udp = true;
 		} else {
-			snprintf(path, sizeof(path) - 1, "%s", path_in);
+			LOG_F(ERROR, "Network sink url must start with tcp:// or udp://, got '" LOGURU_FMT(s) "'", url);
+			return false;
+		}
+		const char* host = url + 6;
+		const char* colon = strrchr(host, ':');
+		if (!colon || colon == host || colon[1] == '\0') {
+			LOG_F(ERROR, "Network sink url must be tcp://host:port or udp://host:port, got '" LOGURU_FMT(s) "'", url);
+			return false;
+		}
+
+		NetworkSink* sink = new NetworkSink();
+		sink->host = std::string(host, colon);
+		if (sink->host.size() > 2 && sink->host.front() == '[' && sink->host.back() == ']') {
+			sink->host = sink->host.substr(1, sink->host.size() - 2); // [::1]
+		}
+		sink->port            = colon + 1;
+		sink->udp             = udp;
+		sink->fd              = -1;
+		sink->last_connect_ns = 0;
+		sink->spool           = nullptr;
+		sink->spool_offset    = 0;
+		sink->spool_size      = 0;
+		sink->quit            = false;
+		if (spool_path) {
+			char path[PATH_MAX];
+			sink->spool = open_log_file(spool_path, "a+b", path, sizeof(path));
+			if (!sink->spool) {
+				delete sink;
+				return false;
+			}
+			fseek(sink->spool, 0, SEEK_END);
+			sink->spool_size = ftell(sink->spool); // Left over from last time.
+		}
+		if (!network_connect(sink)) {
+			LOG_F(WARNING, "Failed to connect to '" LOGURU_FMT(s) "', will retry", url);
+		}
+		sink->thread = std::thread(network_thread, sink);
+		add_callback(url, network_log, sink, verbosity, network_close, nullptr);
+
+		VLOG_F(g_internal_verbosity, "Logging to '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", url, verbosity);
+		return true;
+#else
+		(void)url;
+		(void)verbosity;
+		(void)spool_path;
+		VLOG_F(g_internal_verbosity, "Network logging not implemented on this system. Request to install network logging ignored.");
+		return false;
+#endif
+	}
+
+	// ------------------------------------------------------------------------
+	// Pipe to a subprocess, see add_pipe_sink.
+
+#ifndef _WIN32
+	static const size_t PIPE_MAX_QUEUED_BYTES  = 8 * 1024 * 1024; // Lines beyond this are dropped.
+	static const int    PIPE_BUFFER_SIZE       = 1024 * 1024;
+	static const int    PIPE_POLL_MS           = 100;
+	static const int    PIPE_CLOSE_TIMEOUT_MS  = 2000; // For the child to take the rest and exit, see pipe_close.
+
+	struct PipeSink
+	{
+		pid_t                   pid;
+		int                     fd;      // Write end of the child's stdin.
+		std::string             sending; // Owned by the thread.
+		std::mutex              mutex;   // Protects the fields below.
+		std::condition_variable cv;
+		std::string             pending;
+		bool                    broken;  // The child stopped reading.
+		bool                    quit;
+		long long               close_deadline_ns; // Set by pipe_close.
+		std::thread             thread;
+	};
+
+	static bool pipe_past_deadline(PipeSink* sink)
+	{
+		std::lock_guard<std::mutex> lock(sink->mutex);
+		return sink->close_deadline_ns != 0 && now_ns() >= sink->close_deadline_ns;
+	}
+
+	static void pipe_thread(PipeSink* sink)
+	{
+		// A child that exits would otherwise kill us with SIGPIPE; we want EPIPE instead.
+		sigset_t sigpipe;
+		sigemptyset(&sigpipe);
+		sigaddset(&sigpipe, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+		for (;;) {
+			bool quit;
+			{
+				std::unique_lock<std::mutex> lock(sink->mutex);
+				sink->cv.wait(lock, [sink]{ return !sink->pending.empty() || sink->quit; });
+				quit = sink->quit;
+				std::swap(sink->pending, sink->sending);
+			}
+			size_t written = 0;
+			while (written < sink->sending.size()) {
+				const auto bytes = write(sink->fd, sink->sending.data() + written, sink->sending.size() - written);
+				if (bytes < 0) {
+					if (errno == EINTR) { continue; }
+					if (errno == EAGAIN || errno == EWOULDBLOCK) {
+						// The child is not keeping up. Wait for it, but never past the deadline of pipe_close.
+						pollfd poll_fd = {sink->fd, POLLOUT, 0};
+						poll(&poll_fd, 1, PIPE_POLL_MS);
+						if (!pipe_past_deadline(sink)) { continue; }
+					}
+					std::lock_guard<std::mutex> lock(sink->mutex);
+					sink->broken = true; // EPIPE: nobody to write to any more. Or a child stuck past the deadline.
+					sink->pending.clear();
+					break;
+				}
+				written += static_cast<size_t>(bytes);
+			}
+			sink->sending.clear();
+			if (quit) {
+				return; // Any SIGPIPE we caused was sent to this thread only, and dies with it.
+			}
+		}
+	}
+
+	void pipe_log(void* user_data, const Message& message)
+	{
+		PipeSink* sink = reinterpret_cast<PipeSink*>(user_data);
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			if (sink->broken || sink->pending.size() > PIPE_MAX_QUEUED_BYTES) {
+				return; // Dropped.
+			}
+			std::string& out = sink->pending;
+			out += message.preamble;
+			out += message.indentation;
+			out += message.prefix;
+			out += message.message;
+			out += fields_text(message);
+			out += '\n';
+		}
+		sink->cv.notify_one();
+	}
+
+	void pipe_close(void* user_data)
+	{
+		PipeSink* sink = reinterpret_cast<PipeSink*>(user_data);
+		const long long deadline_ns = now_ns() + PIPE_CLOSE_TIMEOUT_MS * 1000000ll;
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			sink->quit = true;
+			sink->close_deadline_ns = deadline_ns;
+		}
+		sink->cv.notify_one();
+		sink->thread.join();
+		close(sink->fd); // The child sees EOF...
+		// ...and we give it until the deadline to finish up.
+		for (;;) {
+			int status;
+			const pid_t result = waitpid(sink->pid, &status, WNOHANG);
+			if (result == -1 && errno == EINTR) { continue; }
+			if (result != 0) { break; }
+			if (now_ns() >= deadline_ns) {
+				kill(sink->pid, SIGKILL);
+				while (waitpid(sink->pid, &status, 0) == -1 && errno == EINTR) {}
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		delete sink;
+	}
+#endif // _WIN32
+
+	bool add_pipe_sink(const char* command, Verbosity verbosity)
+	{
+#ifndef _WIN32
+		// Close-on-exec, so that neither end leaks into other children: the child gets the read end
+		// as its stdin, which dup2 makes inheritable.
+		int fds[2];
+	#ifdef __linux__
+		if (pipe2(fds, O_CLOEXEC) != 0) {
+	#else
+		if (pipe(fds) != 0) {
+	#endif
+			LOG_F(ERROR, "Failed to create a pipe: " LOGURU_FMT(s) "", errno_as_text().c_str());
+			return false;
+		}
+		// Our end only, so that a child that stops reading can't hang pipe_thread, see pipe_close.
+		fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	#ifndef __linux__
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	#endif
+	#ifdef F_SETPIPE_SZ
+		fcntl(fds[1], F_SETPIPE_SZ, PIPE_BUFFER_SIZE); // Best effort; capped by /proc/sys/fs/pipe-max-size.
+	#endif
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+		posix_spawn_file_actions_addclose(&actions, fds[0]);
+		const char* argv[] = {"/bin/sh", "-c", command, nullptr};
+		pid_t pid;
+		const int result = posix_spawn(&pid, "/bin/sh", &actions, nullptr, const_cast<char* const*>(argv), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		close(fds[0]);
+		if (result != 0) {
+			LOG_F(ERROR, "Failed to start '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", command, strerror(result));
+			close(fds[1]);
+			return false;
+		}
+
+		PipeSink* sink = new PipeSink();
+		sink->pid    = pid;
+		sink->fd     = fds[1];
+		sink->broken = false;
+		sink->quit   = false;
+		sink->close_deadline_ns = 0;
+		sink->thread = std::thread(pipe_thread, sink);
+		add_callback(command, pipe_log, sink, verbosity, pipe_close, nullptr);
+
+		VLOG_F(g_internal_verbosity, "Logging to '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", command, verbosity);
+		return true;
+#else
+		(void)command;
+		(void)verbosity;
+		VLOG_F(g_internal_verbosity, "Pipe sinks not implemented on this system. Request to install pipe logging ignored.");
+		return false;
+#endif
+	}
+
+	/*
+		Will add syslog as a standard sink for log messages
+		Any logging message with a verbosity lower or equal to
+		the given verbosity will be included.
+
+		This works for Unix like systems (i.e. Linux/Mac)
+		There is no current implementation for Windows (as I don't know the
+		equivalent calls or have a way to test them). If you know please
+		add and send a pull request.
+
+		The code should still compile under windows but will only generate
+		a warning message that syslog is unavailable.
+
+		Search for LOGURU_SYSLOG to find and fix.
+	*/
+	bool add_syslog(const char* app_name, Verbosity verbosity)
+	{
+		return add_syslog(app_name, verbosity, LOG_USER);
+	}
+	bool add_syslog(const char* app_name, Verbosity verbosity, int facility)
+	{
+#if LOGURU_SYSLOG
+		if (app_name == nullptr) {
+			app_name = argv0_filename();
+		}
+		openlog(app_name, 0, facility);
+		add_callback("'syslog'", syslog_log, nullptr, verbosity, syslog_close, syslog_flush);
+
+		VLOG_F(g_internal_verbosity, "Logging to 'syslog' , verbosity: " LOGURU_FMT(d) "", verbosity);
+		return true;
+#else
+		(void)app_name;
+		(void)verbosity;
+		(void)facility;
+		VLOG_F(g_internal_verbosity, "syslog not implemented on this system. Request to install syslog logging ignored.");
+		return false;
+#endif
+	}
+	bool add_syslog_socket(const char* app_name, Verbosity verbosity, int facility, const char* socket_path)
+	{
+#if LOGURU_SYSLOG
+		if (app_name == nullptr) {
+			app_name = argv0_filename();
+		}
+		SyslogSocketSink* sink = new SyslogSocketSink();
+		sink->fd               = -1;
+		sink->path             = socket_path;
+		sink->facility         = facility;
+		sink->timestamp_sec    = -1;
+		sink->queued           = 0;
+		sink->dropped          = 0;
+		sink->reported_dropped = 0;
+		sink->quit             = false;
+		if (!syslog_socket_connect(sink)) {
+			LOG_F(ERROR, "Failed to connect to syslog socket '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", socket_path, errno_as_text().c_str());
+			delete sink;
+			return false;
+		}
+
+		// Everything after the timestamp is the same for every message, so render it once:
+		char hostname[256] = {0};
+		gethostname(hostname, sizeof(hostname) - 1);
+		char pid[32];
+		snprintf(pid, sizeof(pid), "%d", static_cast<int>(getpid()));
+		sink->header = " ";
+		append_syslog_field(sink->header, hostname);
+		sink->header += ' ';
+		append_syslog_field(sink->header, app_name);
+		sink->header += ' ';
+		sink->header += pid;
+		sink->header += " - - "; // No MSGID, no STRUCTURED-DATA.
+
+		sink->thread = std::thread([sink](){
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(sink->mutex);
+					sink->cv.wait(lock, [sink]{ return sink->queued != 0 || sink->quit; });
+					if (sink->queued == 0) {
+						return; // quit
+					}
+				}
+				syslog_socket_send_queued(sink, true);
+				syslog_socket_report_drops(sink);
+			}
+		});
+		add_callback(socket_path, syslog_socket_log, sink, verbosity, syslog_socket_close, nullptr);
+
+		VLOG_F(g_internal_verbosity, "Logging to syslog socket '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", socket_path, verbosity);
+		return true;
+#else
+		(void)app_name;
+		(void)verbosity;
+		(void)facility;
+		(void)socket_path;
+		VLOG_F(g_internal_verbosity, "syslog not implemented on this system. Request to install syslog socket logging ignored.");
+		return false;
+#endif
+	}
+
+	bool add_journald(Verbosity verbosity, const char* socket_path)
+	{
+#if LOGURU_SYSLOG && defined(__linux__)
+		const int fd = connect_unix_datagram(socket_path);
+		if (fd == -1) {
+			LOG_F(ERROR, "Failed to connect to journald socket '" LOGURU_FMT(s) "': " LOGURU_FMT(s) "", socket_path, errno_as_text().c_str());
+			return false;
+		}
+		add_callback(socket_path, journald_log, new JournaldSink{fd, argv0_filename(), {}, {}}, verbosity, journald_close, nullptr);
+
+		VLOG_F(g_internal_verbosity, "Logging to journald socket '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", socket_path, verbosity);
+		return true;
+#else
+		(void)verbosity;
+		(void)socket_path;
+		VLOG_F(g_internal_verbosity, "journald not implemented on this system. Request to install journald logging ignored.");
+		return false;
+#endif
+	}
+
+	// Will be called right before abort().
+	void set_fatal_handler(fatal_handler_t handler)
+	{
+		s_fatal_handler = handler;
+	}
+
+	fatal_handler_t get_fatal_handler()
+	{
+		return s_fatal_handler;
+	}
+
+	void set_verbosity_to_name_callback(verbosity_to_name_t callback)
+	{
+		s_verbosity_to_name_callback = callback;
+	}
+
+	void set_name_to_verbosity_callback(name_to_verbosity_t callback)
+	{
+		s_name_to_verbosity_callback = callback;
+	}
+
+	void add_stack_cleanup(const char* find_this, const char* replace_with_this)
+	{
+		if (strlen(find_this) <= strlen(replace_with_this)) {
+			LOG_F(WARNING, "add_stack_cleanup: the replacement should be shorter than the pattern!");
+			return;
+		}
+
+		s_user_stack_cleanups.push_back(StringPair(find_this, replace_with_this));
+	}
+
+	static std::atomic<int> s_ring_verbosity { Verbosity_OFF }; // Read without s_mutex, see log_message.
+
+	// Which callbacks want messages of each verbosity from FATAL to Verbosity_MAX, so that
+	// log_message only visits those. Row v is s_routes[s_route_begin[v - FATAL] .. s_route_begin[v - FATAL + 1]),
+	// indices into s_callbacks in order of registration. Rebuilt by on_callback_change.
+	static const int NUM_ROUTED_VERBOSITIES = Verbosity_MAX - Verbosity_FATAL + 1;
+	static std::vector<unsigned> s_routes;
+	static unsigned              s_route_begin[NUM_ROUTED_VERBOSITIES + 1];
+
+	static void on_callback_change()
+	{
+		Verbosity max_callback_verbosity = Verbosity_OFF;
+		for (const auto& callback : s_callbacks) {
+			max_callback_verbosity = std::max(max_callback_verbosity, callback.verbosity);
 		}
+		s_max_callback_verbosity = max_callback_verbosity;
+		s_max_out_verbosity = std::max(max_callback_verbosity, s_ring_verbosity.load());
 
-		if (!create_directories(path)) {
-			LOG_F(ERROR, "Failed to create directories to '" LOGURU_FMT(s) "'", path);
+		// Scopes are traced by LogScopeRAII rather than the callback, so it needs to know (see set_sink_verbosity):
+		int trace_verbosity = Verbosity_OFF;
+		for (const auto& callback : s_callbacks) {
+			if (callback.callback == trace_log) {
+				trace_verbosity = callback.verbosity;
+			}
+		}
+		s_trace_verbosity = trace_verbosity;
+
+		s_routes.clear();
+		for (int row = 0; row < NUM_ROUTED_VERBOSITIES; ++row) {
+			s_route_begin[row] = static_cast<unsigned>(s_routes.size());
+			for (size_t i = 0; i < s_callbacks.size(); ++i) {
+				if (Verbosity_FATAL + row <= s_callbacks[i].verbosity) {
+					s_routes.push_back(static_cast<unsigned>(i));
+				}
+			}
 		}
+		s_route_begin[NUM_ROUTED_VERBOSITIES] = static_cast<unsigned>(s_routes.size());
+	}
 
-		const char* mode_str = (mode == FileMode::Truncate ? "w" : "a");
-		FILE* file;
-	#ifdef _WIN32
-		file = _fsopen(path, mode_str, _SH_DENYNO);
-	#else
-		file = fopen(path, mode_str);
-	#endif
-		if (!file) {
-			LOG_F(ERROR, "Failed to open '" LOGURU_FMT(s) "'", path);
+	// Calls fn(callback) for each callback that wants messages of the given verbosity.
+	template<typename Fn>
+	static void for_each_routed_callback(Verbosity verbosity, Fn fn)
+	{
+		if (Verbosity_FATAL <= verbosity && verbosity <= Verbosity_MAX) {
+			const int row = verbosity - Verbosity_FATAL;
+			for (unsigned i = s_route_begin[row]; i < s_route_begin[row + 1]; ++i) {
+				fn(s_callbacks[s_routes[i]]);
+			}
+		} else {
+			for (auto& callback : s_callbacks) {
+				if (verbosity <= callback.verbosity) {
+					fn(callback);
+				}
+			}
+		}
+	}
+
+	// Handles are handed out in increasing order and callbacks are only ever appended,
+	// so s_callbacks is sorted by handle.
+	static Callback* find_sink(SinkHandle handle)
+	{
+		auto it = std::lower_bound(s_callbacks.begin(), s_callbacks.end(), handle,
+			[](const Callback& callback, SinkHandle h) { return callback.handle < h; });
+		return it != s_callbacks.end() && it->handle == handle ? &*it : nullptr;
+	}
+
+	bool set_sink_verbosity(SinkHandle handle, Verbosity verbosity)
+	{
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		Callback* callback = find_sink(handle);
+		if (!callback) {
 			return false;
 		}
-#if LOGURU_WITH_FILEABS
-		FileAbs* file_abs = new FileAbs(); // this is deleted in file_close;
-		snprintf(file_abs->path, sizeof(file_abs->path) - 1, "%s", path);
-		snprintf(file_abs->mode_str, sizeof(file_abs->mode_str) - 1, "%s", mode_str);
-		stat(file_abs->path, &file_abs->st);
-		file_abs->fp = file;
-		file_abs->verbosity = verbosity;
-		add_callback(path_in, file_log, file_abs, verbosity, file_close, file_flush);
+		callback->verbosity = verbosity;
+		on_callback_change();
+		return true;
+	}
+
+	SinkHandle add_callback(
+		const char*     id,
+		log_handler_t   callback,
+		void*           user_data,
+		Verbosity       verbosity,
+		close_handler_t on_close,
+		flush_handler_t on_flush)
+	{
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		const SinkHandle handle = s_next_sink_handle++;
+		s_callbacks.push_back(Callback{id, handle, callback, user_data, verbosity, on_close, on_flush, nullptr});
+		on_callback_change();
+		return handle;
+	}
+
+	// Returns a custom verbosity name if one is available, or nullptr.
+	// See also set_verbosity_to_name_callback.
+	const char* get_verbosity_name(Verbosity verbosity)
+	{
+		auto name = s_verbosity_to_name_callback
+				? (*s_verbosity_to_name_callback)(verbosity)
+				: nullptr;
+
+		// Use standard replacements if callback fails:
+		if (!name)
+		{
+			if (verbosity <= Verbosity_FATAL) {
+				name = "FATL";
+			} else if (verbosity == Verbosity_ERROR) {
+				name = "ERR";
+			} else if (verbosity == Verbosity_WARNING) {
+				name = "WARN";
+			} else if (verbosity == Verbosity_INFO) {
+				name = "INFO";
+			}
+		}
+
+		return name;
+	}
+
+	// Returns Verbosity_INVALID if the name is not found.
+	// See also set_name_to_verbosity_callback.
+	Verbosity get_verbosity_from_name(const char* name)
+	{
+		auto verbosity = s_name_to_verbosity_callback
+				? (*s_name_to_verbosity_callback)(name)
+				: Verbosity_INVALID;
+
+		// Use standard replacements if callback fails:
+		if (verbosity == Verbosity_INVALID) {
+			if (strcmp(name, "OFF") == 0) {
+				verbosity = Verbosity_OFF;
+			} else if (strcmp(name, "INFO") == 0) {
+				verbosity = Verbosity_INFO;
+			} else if (strcmp(name, "WARNING") == 0) {
+				verbosity = Verbosity_WARNING;
+			} else if (strcmp(name, "ERROR") == 0) {
+				verbosity = Verbosity_ERROR;
+			} else if (strcmp(name, "FATAL") == 0) {
+				verbosity = Verbosity_FATAL;
+			}
+		}
+
+		return verbosity;
+	}
+
+	// ------------------------------------------------------------------------
+	// Asynchronous callbacks, see set_callback_async.
+
+	// A Field whose strings are stored as offsets into AsyncRecord::strings.
+	struct AsyncField
+	{
+		Field  field;
+		size_t key_offset;
+		size_t value_offset;
+	};
+
+	// A deep copy of a Message.
+	struct AsyncRecord
+	{
+		Verbosity               verbosity;
+		unsigned                line;
+		unsigned                depth;
+		std::string             filename;
+		std::string             preamble;
+		std::string             indentation;
+		std::string             prefix;
+		std::string             message;
+		std::string             thread_name;
+		long long               time_us;   // When it was logged, see message_time_us.
+		long long               uptime_us;
+		long                    thread_id; // See message_thread_id.
+		std::vector<AsyncField> fields;
+		std::vector<AsyncField> context; // Outermost first.
+		std::string             strings; // Keys and string values of fields and context.
+	};
+
+	// A ring buffer of preallocated records, so that their strings keep their capacity.
+	// Records that must not be dropped wait in `overflow` while it is full. That holds as many records
+	// as the ring, so that e.g. a LogBatch, or a worker logging from its callback, can't grow it without
+	// bound; beyond that even they are dropped.
+	struct AsyncLane
+	{
+		std::vector<AsyncRecord> records;
+		size_t                   head;
+		size_t                   count;
+		std::deque<AsyncRecord>  overflow;   // Oldest first. Only ever non-empty while the ring is full.
+		unsigned long long       overflowed; // Records ever put in the overflow.
+		unsigned long long       refilled;   // Records ever moved from the overflow into the ring.
+
+		bool full() const { return count == records.size(); }
+		AsyncRecord& back() { return records[(head + count) % records.size()]; }
+		void pop_front() { head = (head + 1) % records.size(); --count; }
+	};
+
+	struct AsyncSink
+	{
+		log_handler_t            callback;
+		void*                    user_data;
+		flush_handler_t          flush;
+		AsyncOptions             options;
+		std::vector<Field>       fields;     // Scratch for the worker.
+		AsyncRecord              delivering; // Owned by the worker.
+		std::mutex               mutex;      // Protects everything below.
+		std::condition_variable  has_work;
+		std::condition_variable  has_room;   // Also notified when the worker is idle.
+		AsyncLane                queue;      // options.max_queued records.
+		AsyncLane                urgent;     // At least options.priority_verbosity. Delivered first, never dropped.
+		FILE*                    spill;
+		size_t                   spilled;    // Records in the spill file not yet delivered.
+		long                     spill_read_pos;
+		long                     spill_write_pos;
+		bool                     busy;       // The worker is delivering a record.
+		std::thread::id          bypassing;  // Thread calling the callback or flush instead of the worker, if any.
+		bool                     needs_flush;
+		bool                     quit;
+		unsigned long long       dropped;
+		unsigned                 waiters;    // Threads in async_wait.
+		std::thread              thread;
+	};
+
+	static void async_copy_field(std::vector<AsyncField>& out, std::string& strings, const Field& field)
+	{
+		AsyncField copy = {field, strings.size(), 0};
+		strings.append(field.key);
+		strings += '\0';
+		if (field.type == FieldType_String) {
+			copy.value_offset = strings.size();
+			strings.append(field.string_value, static_cast<size_t>(field.string_length));
+			strings += '\0';
+		}
+		out.push_back(copy);
+	}
+
+	static void async_copy_context(AsyncRecord& record, const ContextScope* context)
+	{
+		if (context) {
+			async_copy_context(record, context->previous());
+			async_copy_field(record.context, record.strings, context->field());
+		}
+	}
+
+	static void async_copy(AsyncRecord& record, const Message& message)
+	{
+		record.verbosity   = message.verbosity;
+		record.line        = message.line;
+		record.depth       = message.depth;
+		record.filename    = message.filename;
+		record.preamble    = message.preamble;
+		record.indentation = message.indentation;
+		record.prefix      = message.prefix;
+		record.message     = message.message;
+		char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+		get_thread_name(thread_name, LOGURU_THREADNAME_WIDTH + 1, false);
+		record.thread_name = thread_name;
+		record.time_us     = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+		record.uptime_us   = duration_cast<microseconds>(steady_clock::now() - s_start_time).count();
+#ifdef __linux__
+		record.thread_id   = static_cast<long>(syscall(SYS_gettid));
 #else
-		add_callback(path_in, file_log, file, verbosity, file_close, file_flush);
+		record.thread_id   = 0;
 #endif
+		record.fields.clear();
+		record.context.clear();
+		record.strings.clear();
+		for (unsigned i = 0; i < message.num_fields; ++i) {
+			async_copy_field(record.fields, record.strings, message.fields[i]);
+		}
+		async_copy_context(record, message.context);
+	}
 
-		if (mode == FileMode::Append) {
-			fprintf(file, "\n\n\n\n\n");
+	static Field async_resolve(const AsyncField& field, const std::string& strings)
+	{
+		Field resolved = field.field;
+		resolved.key = strings.c_str() + field.key_offset;
+		if (resolved.type == FieldType_String) {
+			resolved.string_value = strings.c_str() + field.value_offset;
 		}
-		if (!s_arguments.empty()) {
-			fprintf(file, "arguments: %s\n", s_arguments.c_str());
+		return resolved;
+	}
+
+	static void async_write_string(FILE* file, const std::string& str)
+	{
+		const unsigned long long size = str.size();
+		fwrite(&size, sizeof(size), 1, file);
+		fwrite(str.data(), 1, str.size(), file);
+	}
+
+	static void async_read_string(FILE* file, std::string& str)
+	{
+		unsigned long long size = 0;
+		if (fread(&size, sizeof(size), 1, file) != 1) { size = 0; }
+		str.resize(static_cast<size_t>(size));
+		if (size != 0 && fread(&str[0], 1, str.size(), file) != str.size()) { str.clear(); }
+	}
+
+	static void async_write_fields(FILE* file, const std::vector<AsyncField>& fields)
+	{
+		const unsigned long long size = fields.size();
+		fwrite(&size, sizeof(size), 1, file);
+		fwrite(fields.data(), sizeof(AsyncField), fields.size(), file);
+	}
+
+	static void async_read_fields(FILE* file, std::vector<AsyncField>& fields)
+	{
+		unsigned long long size = 0;
+		if (fread(&size, sizeof(size), 1, file) != 1) { size = 0; }
+		fields.resize(static_cast<size_t>(size));
+		if (size != 0 && fread(fields.data(), sizeof(AsyncField), fields.size(), file) != fields.size()) { fields.clear(); }
+	}
+
+	// The spill file is only ever read back by this process, so the layout is just the raw structs.
+	static void async_spill(AsyncSink* sink, const AsyncRecord& record)
+	{
+		fseek(sink->spill, sink->spill_write_pos, SEEK_SET);
+		const int numbers[3] = {record.verbosity, static_cast<int>(record.line), static_cast<int>(record.depth)};
+		fwrite(numbers, sizeof(numbers), 1, sink->spill);
+		async_write_string(sink->spill, record.filename);
+		async_write_string(sink->spill, record.preamble);
+		async_write_string(sink->spill, record.indentation);
+		async_write_string(sink->spill, record.prefix);
+		async_write_string(sink->spill, record.message);
+		async_write_string(sink->spill, record.thread_name);
+		const long long stamps[3] = {record.time_us, record.uptime_us, record.thread_id};
+		fwrite(stamps, sizeof(stamps), 1, sink->spill);
+		async_write_fields(sink->spill, record.fields);
+		async_write_fields(sink->spill, record.context);
+		async_write_string(sink->spill, record.strings);
+		sink->spill_write_pos = ftell(sink->spill);
+		++sink->spilled;
+	}
+
+	static void async_unspill(AsyncSink* sink, AsyncRecord& record)
+	{
+		fflush(sink->spill);
+		fseek(sink->spill, sink->spill_read_pos, SEEK_SET);
+		int numbers[3] = {0, 0, 0};
+		if (fread(numbers, sizeof(numbers), 1, sink->spill) != 1) { numbers[0] = Verbosity_INFO; }
+		record.verbosity = numbers[0];
+		record.line      = static_cast<unsigned>(numbers[1]);
+		record.depth     = static_cast<unsigned>(numbers[2]);
+		async_read_string(sink->spill, record.filename);
+		async_read_string(sink->spill, record.preamble);
+		async_read_string(sink->spill, record.indentation);
+		async_read_string(sink->spill, record.prefix);
+		async_read_string(sink->spill, record.message);
+		async_read_string(sink->spill, record.thread_name);
+		long long stamps[3] = {0, 0, 0};
+		if (fread(stamps, sizeof(stamps), 1, sink->spill) != 1) { stamps[0] = stamps[1] = stamps[2] = 0; }
+		record.time_us   = stamps[0];
+		record.uptime_us = stamps[1];
+		record.thread_id = static_cast<long>(stamps[2]);
+		async_read_fields(sink->spill, record.fields);
+		async_read_fields(sink->spill, record.context);
+		async_read_string(sink->spill, record.strings);
+		sink->spill_read_pos = ftell(sink->spill);
+		if (--sink->spilled == 0) {
+			// Caught up: start over from the beginning of the file instead of letting it grow.
+			sink->spill_read_pos  = 0;
+			sink->spill_write_pos = 0;
 		}
-		if (strlen(s_current_dir) != 0) {
-			fprintf(file, "Current dir: %s\n", s_current_dir);
+	}
+
+	// Moves the oldest record waiting in the overflow into the ring, which must have room.
+	static void async_refill(AsyncSink* sink, AsyncLane& lane)
+	{
+		if (!lane.overflow.empty()) {
+			std::swap(lane.back(), lane.overflow.front());
+			lane.overflow.pop_front();
+			++lane.count;
+			++lane.refilled;
+			sink->has_room.notify_all();
 		}
-		fprintf(file, "File verbosity level: %d\n", verbosity);
-		if (g_preamble_header) {
-			char preamble_explain[LOGURU_PREAMBLE_WIDTH];
-			print_preamble_header(preamble_explain, sizeof(preamble_explain));
-			fprintf(file, "%s\n", preamble_explain);
+	}
+
+	// Removes the oldest queued record more verbose than options.drop_verbosity, if any.
+	static bool async_drop_verbose(AsyncSink* sink)
+	{
+		AsyncLane& lane = sink->queue;
+		const size_t size = lane.records.size();
+		for (size_t i = 0; i < lane.count; ++i) {
+			if (lane.records[(lane.head + i) % size].verbosity > sink->options.drop_verbosity) {
+				for (size_t j = i; j > 0; --j) {
+					std::swap(lane.records[(lane.head + j) % size], lane.records[(lane.head + j - 1) % size]);
+				}
+				lane.pop_front();
+				async_refill(sink, lane);
+				return true;
+			}
 		}
-		fflush(file);
+		return false;
+	}
 
-		VLOG_F(g_internal_verbosity, "Logging to '" LOGURU_FMT(s) "', mode: '" LOGURU_FMT(s) "', verbosity: " LOGURU_FMT(d) "", path, mode_str, verbosity);
-		return true;
+	// Set while log_message handles a FATAL message (and its stack trace and error context).
+	// Protected by s_mutex.
+	static bool s_fatal_in_progress = false;
+
+	// A record in a lane's overflow that the thread that logged it should wait for.
+	struct AsyncWait
+	{
+		AsyncSink*         sink;
+		AsyncLane*         lane;
+		unsigned long long ticket; // Let into the ring once lane->refilled > ticket.
+	};
+
+	// Waits that log_message has yet to do, once it no longer holds s_mutex. See AsyncWaits.
+	// Protected by s_mutex.
+	static std::vector<AsyncWait> s_async_waits;
+	static unsigned s_log_depth = 0; // log_message:s and LogBatch:es in progress. Protected by s_mutex.
+	// Callbacks removed by a callback, to be closed once s_mutex is released. Protected by s_mutex.
+	static CallbackVec s_removed_callbacks;
+
+	static void close_callback(const Callback& callback);
+
+	// Queues a copy of the message on the lane, or in its overflow if the ring is full.
+	// In the latter case the logging thread waits for it to be let into the ring (if `may_wait`),
+	// unless it is the worker itself, logging from the callback.
+	// Called with sink->mutex and s_mutex locked.
+	static void async_push(AsyncSink* sink, AsyncLane& lane, const Message& message, bool may_wait)
+	{
+		if (!lane.full()) {
+			async_copy(lane.back(), message);
+			++lane.count;
+		} else if (lane.overflow.size() >= lane.records.size()) {
+			++sink->dropped;
+		} else {
+			lane.overflow.emplace_back();
+			async_copy(lane.overflow.back(), message);
+			if (may_wait && s_log_depth != 0 && std::this_thread::get_id() != sink->thread.get_id()) {
+				s_async_waits.push_back(AsyncWait{sink, &lane, lane.overflowed});
+				++sink->waiters;
+			}
+			++lane.overflowed;
+		}
+		sink->has_work.notify_one();
 	}
 
-	/*
-		Will add syslog as a standard sink for log messages
-		Any logging message with a verbosity lower or equal to
-		the given verbosity will be included.
+	static void async_wait(const AsyncWait& wait)
+	{
+		AsyncSink* sink = wait.sink;
+		std::unique_lock<std::mutex> lock(sink->mutex);
+		sink->has_room.wait(lock, [&wait]{ return wait.lane->refilled > wait.ticket || wait.sink->quit; });
+		--sink->waiters;
+		sink->has_room.notify_all();
+	}
 
-		This works for Unix like systems (i.e. Linux/Mac)
-		There is no current implementation for Windows (as I don't know the
-		equivalent calls or have a way to test them). If you know please
-		add and send a pull request.
+	// Declared before locking s_mutex in log_message and LogBatch, and entered right after.
+	// When the outermost of them is done, it waits for room for the records it put in an overflow,
+	// after s_mutex is released, so that other threads can keep logging meanwhile.
+	// It then closes any callbacks that were removed meanwhile, see remove_sink.
+	class AsyncWaits
+	{
+	public:
+		AsyncWaits() = default;
+		AsyncWaits(const AsyncWaits&) = delete;
+		AsyncWaits& operator=(const AsyncWaits&) = delete;
 
-		The code should still compile under windows but will only generate
-		a warning message that syslog is unavailable.
+		~AsyncWaits()
+		{
+			for (const AsyncWait& wait : _waits) {
+				async_wait(wait);
+			}
+			for (const Callback& callback : _removed) {
+				close_callback(callback);
+			}
+		}
 
-		Search for LOGURU_SYSLOG to find and fix.
-	*/
-	bool add_syslog(const char* app_name, Verbosity verbosity)
+		// Called with s_mutex locked. Leaves when destroyed, before s_mutex is unlocked.
+		struct Depth
+		{
+			AsyncWaits& waits;
+			explicit Depth(AsyncWaits& waits_) : waits(waits_) { ++s_log_depth; }
+			~Depth()
+			{
+				if (--s_log_depth == 0) {
+					waits._waits.swap(s_async_waits);
+					waits._removed.swap(s_removed_callbacks);
+				}
+			}
+			Depth(const Depth&) = delete;
+			Depth& operator=(const Depth&) = delete;
+		};
+
+	private:
+		std::vector<AsyncWait> _waits;
+		CallbackVec            _removed;
+	};
+
+	// Calls fn, which calls into the callback, on this thread, without sink->mutex held (the callback may log).
+	// The worker stays out of the callback meanwhile. Called with `lock` on sink->mutex, and the worker idle.
+	template<typename Fn>
+	static void async_bypass_worker(AsyncSink* sink, std::unique_lock<std::mutex>& lock, const Fn& fn)
 	{
-		return add_syslog(app_name, verbosity, LOG_USER);
+		sink->bypassing = std::this_thread::get_id();
+		lock.unlock();
+		fn();
+		lock.lock();
+		sink->bypassing = std::thread::id();
+		sink->has_work.notify_one();
+		sink->has_room.notify_all();
 	}
-	bool add_syslog(const char* app_name, Verbosity verbosity, int facility)
+
+	// Delivers the message on the calling thread, ahead of anything queued, since we are about to abort.
+	// If the worker is stuck in the callback, the message goes first in line for it instead.
+	static void async_emergency(AsyncSink* sink, const Message& message)
 	{
-#if LOGURU_SYSLOG
-		if (app_name == nullptr) {
-			app_name = argv0_filename();
+		std::unique_lock<std::mutex> lock(sink->mutex);
+		if (sink->bypassing == std::this_thread::get_id()) {
+			// Logged by the callback we are in the middle of, which must not be re-entered.
+			++sink->dropped;
+			return;
 		}
-		openlog(app_name, 0, facility);
-		add_callback("'syslog'", syslog_log, nullptr, verbosity, syslog_close, syslog_flush);
+		// Give the worker a moment to finish the record it is on, if any:
+		const bool idle = sink->has_room.wait_for(lock, std::chrono::milliseconds(100),
+			[sink]{ return !sink->busy && sink->bypassing == std::thread::id(); });
+		if (!idle) {
+			// The callback must never run on two threads at once, so leave the message to the worker,
+			// which async_drain gives a little longer before we abort.
+			async_push(sink, sink->urgent, message, false);
+			return;
+		}
+		async_bypass_worker(sink, lock, [sink, &message]{
+			sink->callback(sink->user_data, message);
+			if (sink->flush) { sink->flush(sink->user_data); }
+		});
+	}
 
-		VLOG_F(g_internal_verbosity, "Logging to 'syslog' , verbosity: " LOGURU_FMT(d) "", verbosity);
-		return true;
-#else
-		(void)app_name;
-		(void)verbosity;
-		(void)facility;
-		VLOG_F(g_internal_verbosity, "syslog not implemented on this system. Request to install syslog logging ignored.");
-		return false;
-#endif
+	// Called with s_mutex locked, so records arrive in the order they were logged.
+	// Never waits for room itself, see AsyncWaits.
+	static void async_enqueue(AsyncSink* sink, const Message& message)
+	{
+		if (s_fatal_in_progress) {
+			async_emergency(sink, message);
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(sink->mutex);
+
+		if (message.verbosity <= sink->options.priority_verbosity) {
+			// Bypasses the policy: the worker will get to it soon, so just wait for room.
+			async_push(sink, sink->urgent, message, true);
+			return;
+		}
+
+		const QueuePolicy policy = sink->options.policy;
+		if (policy == QueuePolicy_SpillToDisk && (sink->queue.full() || sink->spilled != 0)) {
+			// Once anything is spilled, everything newer is too, to keep the order.
+			AsyncRecord record;
+			async_copy(record, message);
+			async_spill(sink, record);
+			sink->has_work.notify_one();
+			return;
+		}
+
+		if (sink->queue.full()) {
+			if (policy == QueuePolicy_DropNewest ||
+				(policy == QueuePolicy_DropBelowSeverity && message.verbosity > sink->options.drop_verbosity)) {
+				++sink->dropped;
+				return;
+			} else if (policy == QueuePolicy_DropOldest) {
+				sink->queue.pop_front();
+				++sink->dropped;
+			} else if (policy == QueuePolicy_DropBelowSeverity && async_drop_verbose(sink)) {
+				++sink->dropped;
+			}
+			// Else QueuePolicy_Block, or a queue full of important messages: wait for room.
+		}
+		async_push(sink, sink->queue, message, true);
+	}
+
+	// Creates a ContextScope for each entry of the record's context on this thread, then calls the callback.
+	static void async_deliver_in_context(AsyncSink* sink, const AsyncRecord& record, size_t index, Message& message)
+	{
+		if (index == record.context.size()) {
+			message.context = get_thread_context();
+			sink->callback(sink->user_data, message);
+			return;
+		}
+		const Field field = async_resolve(record.context[index], record.strings);
+		switch (field.type) {
+			case FieldType_Int: {
+				ContextScope scope(field.key, field.int_value);
+				async_deliver_in_context(sink, record, index + 1, message);
+				break;
+			}
+			case FieldType_Unsigned: {
+				ContextScope scope(field.key, field.unsigned_value);
+				async_deliver_in_context(sink, record, index + 1, message);
+				break;
+			}
+			case FieldType_Double: {
+				ContextScope scope(field.key, field.double_value);
+				async_deliver_in_context(sink, record, index + 1, message);
+				break;
+			}
+			case FieldType_Bool: {
+				ContextScope scope(field.key, field.bool_value);
+				async_deliver_in_context(sink, record, index + 1, message);
+				break;
+			}
+			case FieldType_String: {
+				ContextScope scope(field.key, field.string_value);
+				async_deliver_in_context(sink, record, index + 1, message);
+				break;
+			}
+		}
 	}
-	// Will be called right before abort().
-	void set_fatal_handler(fatal_handler_t handler)
+
+	static void async_deliver(AsyncSink* sink, const AsyncRecord& record)
 	{
-		s_fatal_handler = handler;
+		sink->fields.clear();
+		for (const auto& field : record.fields) {
+			sink->fields.push_back(async_resolve(field, record.strings));
+		}
+		auto message = Message{record.verbosity, record.filename.c_str(), record.line, record.preamble.c_str(),
+			record.indentation.c_str(), record.prefix.c_str(), record.message.c_str(), record.depth,
+			sink->fields.empty() ? nullptr : sink->fields.data(), static_cast<unsigned>(sink->fields.size()), nullptr};
+		ThreadLocals& locals = thread_locals();
+		locals.fields_text_message = nullptr; // `message` may be where the last one was.
+		locals.thread_name   = record.thread_name.c_str();
+		locals.log_time_us   = record.time_us;
+		locals.log_uptime_us = record.uptime_us;
+		locals.log_thread_id = record.thread_id;
+		async_deliver_in_context(sink, record, 0, message);
+		locals.thread_name   = nullptr;
+		locals.log_time_us   = 0;
+		locals.log_uptime_us = 0;
+		locals.log_thread_id = 0;
 	}
 
-	fatal_handler_t get_fatal_handler()
+	static void async_worker(AsyncSink* sink)
 	{
-		return s_fatal_handler;
+		for (;;) {
+			std::unique_lock<std::mutex> lock(sink->mutex);
+			sink->busy = false;
+			sink->has_room.notify_all();
+			sink->has_work.wait(lock, [sink]{
+				return sink->bypassing == std::thread::id() &&
+					(sink->urgent.count != 0 || sink->queue.count != 0 || sink->spilled != 0 || sink->needs_flush || sink->quit);
+			});
+			if (sink->urgent.count != 0) {
+				std::swap(sink->urgent.records[sink->urgent.head], sink->delivering);
+				sink->urgent.pop_front();
+				async_refill(sink, sink->urgent);
+			} else if (sink->queue.count != 0) {
+				std::swap(sink->queue.records[sink->queue.head], sink->delivering);
+				sink->queue.pop_front();
+				async_refill(sink, sink->queue);
+			} else if (sink->spilled != 0) {
+				async_unspill(sink, sink->delivering);
+			} else if (sink->needs_flush) {
+				sink->needs_flush = false;
+				lock.unlock();
+				if (sink->flush) { sink->flush(sink->user_data); }
+				continue;
+			} else {
+				return; // quit, and everything is delivered.
+			}
+			sink->busy = true;
+			const bool caught_up = (sink->urgent.count == 0 && sink->queue.count == 0 && sink->spilled == 0);
+			lock.unlock();
+
+			async_deliver(sink, sink->delivering);
+			if (caught_up && g_flush_interval_ms == 0 && sink->flush) {
+				sink->flush(sink->user_data);
+			}
+		}
 	}
 
-	void set_verbosity_to_name_callback(verbosity_to_name_t callback)
+	// Gives the worker up to `timeout_ms` to deliver everything queued, then flushes the callback.
+	// Used before we abort, so that the FATAL message makes it out.
+	static void async_drain(AsyncSink* sink, unsigned timeout_ms)
 	{
-		s_verbosity_to_name_callback = callback;
+		std::unique_lock<std::mutex> lock(sink->mutex);
+		if (sink->bypassing == std::this_thread::get_id()) {
+			return; // Called by the callback while we are in it.
+		}
+		const bool idle = sink->has_room.wait_for(lock, std::chrono::milliseconds(timeout_ms), [sink]{
+			return sink->urgent.count == 0 && sink->queue.count == 0 && sink->spilled == 0 && !sink->busy &&
+				sink->bypassing == std::thread::id();
+		});
+		if (idle && sink->flush) {
+			async_bypass_worker(sink, lock, [sink]{ sink->flush(sink->user_data); });
+		}
 	}
 
-	void set_name_to_verbosity_callback(name_to_verbosity_t callback)
+	// Called without s_mutex, since the callback may log. The sink must no longer be in s_callbacks.
+	static void async_stop(AsyncSink* sink)
 	{
-		s_name_to_verbosity_callback = callback;
+		{
+			std::lock_guard<std::mutex> lock(sink->mutex);
+			sink->quit = true;
+		}
+		sink->has_work.notify_one();
+		sink->has_room.notify_all();
+		sink->thread.join();
+		{
+			// Everything is delivered, so anyone still waiting is on their way out.
+			std::unique_lock<std::mutex> lock(sink->mutex);
+			sink->has_room.wait(lock, [sink]{ return sink->waiters == 0; });
+		}
+		if (sink->spill) {
+			fclose(sink->spill);
+		}
+		delete sink;
 	}
 
-	void add_stack_cleanup(const char* find_this, const char* replace_with_this)
+	bool set_callback_async(const char* id, const AsyncOptions& options)
 	{
-		if (strlen(find_this) <= strlen(replace_with_this)) {
-			LOG_F(WARNING, "add_stack_cleanup: the replacement should be shorter than the pattern!");
-			return;
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		auto it = std::find_if(begin(s_callbacks), end(s_callbacks), [&](const Callback& c) { return c.id == id; });
+		if (it == s_callbacks.end()) {
+			LOG_F(ERROR, "Failed to locate callback with id '" LOGURU_FMT(s) "'", id);
+			return false;
+		}
+		if (it->async) {
+			return true;
 		}
 
-		s_user_stack_cleanups.push_back(StringPair(find_this, replace_with_this));
+		AsyncSink* sink = new AsyncSink();
+		sink->callback        = it->callback;
+		sink->user_data       = it->user_data;
+		sink->flush           = it->flush;
+		sink->options         = options;
+		sink->queue.records.resize(std::max(options.max_queued, 1u));
+		sink->queue.head      = 0;
+		sink->queue.count     = 0;
+		sink->queue.overflowed = 0;
+		sink->queue.refilled  = 0;
+		sink->urgent.records.resize(std::max(options.max_queued / 8, 16u));
+		sink->urgent.head     = 0;
+		sink->urgent.count    = 0;
+		sink->urgent.overflowed = 0;
+		sink->urgent.refilled = 0;
+		sink->spill           = nullptr;
+		sink->spilled         = 0;
+		sink->spill_read_pos  = 0;
+		sink->spill_write_pos = 0;
+		sink->busy            = false;
+		sink->bypassing       = std::thread::id();
+		sink->needs_flush     = false;
+		sink->quit            = false;
+		sink->dropped         = 0;
+		sink->waiters         = 0;
+		if (options.policy == QueuePolicy_SpillToDisk) {
+			if (!options.spill_path) {
+				LOG_F(ERROR, "QueuePolicy_SpillToDisk needs a spill_path");
+				delete sink;
+				return false;
+			}
+			char path[PATH_MAX];
+			sink->spill = open_log_file(options.spill_path, "w+b", path, sizeof(path));
+			if (!sink->spill) {
+				delete sink;
+				return false;
+			}
+		}
+		sink->thread = std::thread(async_worker, sink);
+		it->async = sink;
+		return true;
 	}
 
-	static void on_callback_change()
+	unsigned long long get_callback_drop_count(const char* id)
 	{
-		s_max_out_verbosity = Verbosity_OFF;
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
 		for (const auto& callback : s_callbacks) {
-			s_max_out_verbosity = std::max(s_max_out_verbosity, callback.verbosity);
+			if (callback.id == id && callback.async) {
+				std::lock_guard<std::mutex> async_lock(callback.async->mutex);
+				return callback.async->dropped;
+			}
+#if LOGURU_SYSLOG
+			if (callback.id == id && callback.callback == syslog_socket_log) {
+				SyslogSocketSink* sink = reinterpret_cast<SyslogSocketSink*>(callback.user_data);
+				std::lock_guard<std::mutex> sink_lock(sink->mutex);
+				return sink->dropped;
+			}
+#endif
 		}
+		return 0;
 	}
 
-	void add_callback(
-		const char*     id,
-		log_handler_t   callback,
-		void*           user_data,
-		Verbosity       verbosity,
-		close_handler_t on_close,
-		flush_handler_t on_flush)
+	// Stops the worker of a callback taken out of s_callbacks, if any, and closes it.
+	// Called without s_mutex, which the worker may need to log.
+	static void close_callback(const Callback& callback)
 	{
-		std::lock_guard<std::recursive_mutex> lock(s_mutex);
-		s_callbacks.push_back(Callback{id, callback, user_data, verbosity, on_close, on_flush, 0});
-		on_callback_change();
+		if (callback.async) { async_stop(callback.async); }
+		if (callback.close) { callback.close(callback.user_data); }
 	}
 
-	// Returns a custom verbosity name if one is available, or nullptr.
-	// See also set_verbosity_to_name_callback.
-	const char* get_verbosity_name(Verbosity verbosity)
+	bool remove_sink(SinkHandle handle)
 	{
-		auto name = s_verbosity_to_name_callback
-				? (*s_verbosity_to_name_callback)(verbosity)
-				: nullptr;
-
-		// Use standard replacements if callback fails:
-		if (!name)
+		Callback removed;
 		{
-			if (verbosity <= Verbosity_FATAL) {
-				name = "FATL";
-			} else if (verbosity == Verbosity_ERROR) {
-				name = "ERR";
-			} else if (verbosity == Verbosity_WARNING) {
-				name = "WARN";
-			} else if (verbosity == Verbosity_INFO) {
-				name = "INFO";
+			std::lock_guard<std::recursive_mutex> lock(s_mutex);
+			Callback* callback = find_sink(handle);
+			if (!callback) {
+				return false;
+			}
+			removed = *callback;
+			s_callbacks.erase(s_callbacks.begin() + (callback - s_callbacks.data()));
+			on_callback_change();
+			if (s_log_depth != 0) {
+				// Called from a callback, so s_mutex stays locked until the log call is done. It closes it then.
+				s_removed_callbacks.push_back(removed);
+				return true;
 			}
 		}
-
-		return name;
+		close_callback(removed);
+		return true;
 	}
 
-	// Returns Verbosity_INVALID if the name is not found.
-	// See also set_name_to_verbosity_callback.
-	Verbosity get_verbosity_from_name(const char* name)
+	SinkHandle get_sink_handle(const char* id)
 	{
-		auto verbosity = s_name_to_verbosity_callback
-				? (*s_name_to_verbosity_callback)(name)
-				: Verbosity_INVALID;
-
-		// Use standard replacements if callback fails:
-		if (verbosity == Verbosity_INVALID) {
-			if (strcmp(name, "OFF") == 0) {
-				verbosity = Verbosity_OFF;
-			} else if (strcmp(name, "INFO") == 0) {
-				verbosity = Verbosity_INFO;
-			} else if (strcmp(name, "WARNING") == 0) {
-				verbosity = Verbosity_WARNING;
-			} else if (strcmp(name, "ERROR") == 0) {
-				verbosity = Verbosity_ERROR;
-			} else if (strcmp(name, "FATAL") == 0) {
-				verbosity = Verbosity_FATAL;
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		for (const auto& callback : s_callbacks) {
+			if (callback.id == id) {
+				return callback.handle;
 			}
 		}
-
-		return verbosity;
+		return 0;
 	}
 
 	bool remove_callback(const char* id)
 	{
-		std::lock_guard<std::recursive_mutex> lock(s_mutex);
-		auto it = std::find_if(begin(s_callbacks), end(s_callbacks), [&](const Callback& c) { return c.id == id; });
-		if (it != s_callbacks.end()) {
-			if (it->close) { it->close(it->user_data); }
-			s_callbacks.erase(it);
-			on_callback_change();
+		if (remove_sink(get_sink_handle(id))) {
 			return true;
 		} else {
 			LOG_F(ERROR, "Failed to locate callback with id '" LOGURU_FMT(s) "'", id);
@@ -1000,14 +4040,19 @@ namespace loguru
 
 	void remove_all_callbacks()
 	{
-		std::lock_guard<std::recursive_mutex> lock(s_mutex);
-		for (auto& callback : s_callbacks) {
-			if (callback.close) {
-				callback.close(callback.user_data);
+		CallbackVec removed;
+		{
+			std::lock_guard<std::recursive_mutex> lock(s_mutex);
+			removed.swap(s_callbacks);
+			on_callback_change();
+			if (s_log_depth != 0) {
+				s_removed_callbacks.insert(s_removed_callbacks.end(), removed.begin(), removed.end());
+				return;
 			}
 		}
-		s_callbacks.clear();
-		on_callback_change();
+		for (const auto& callback : removed) {
+			close_callback(callback);
+		}
 	}
 
 	// Returns the maximum of g_stderr_verbosity and all file/custom outputs.
@@ -1069,6 +4114,12 @@ namespace loguru
 		CHECK_NE_F(length, 0u, "Zero length buffer in get_thread_name");
 		CHECK_NOTNULL_F(buffer, "nullptr in get_thread_name");
 
+		if (const char* name = thread_locals().thread_name) {
+			// An asynchronous callback delivering a message from another thread.
+			snprintf(buffer, static_cast<size_t>(length), "%s", name);
+			return;
+		}
+
 		#if LOGURU_PTLS_NAMES
 			(void)pthread_once(&s_pthread_key_once, make_pthread_key_name);
 			if (const char* name = static_cast<const char*>(pthread_getspecific(s_pthread_key_name))) {
@@ -1184,12 +4235,9 @@ namespace loguru
 		return output;
 	}
 
-	std::string stacktrace_as_stdstring(int skip)
+	static std::string stacktrace_as_stdstring(void* const* callstack, int num_frames, int max_frames, int skip)
 	{
 		// From https://gist.github.com/fmela/591333
-		void* callstack[128];
-		const auto max_frames = sizeof(callstack) / sizeof(callstack[0]);
-		int num_frames = backtrace(callstack, max_frames);
 		char** symbols = backtrace_symbols(callstack, num_frames);
 
 		std::string result;
@@ -1229,6 +4277,14 @@ namespace loguru
 		return prettify_stacktrace(result);
 	}
 
+	std::string stacktrace_as_stdstring(int skip)
+	{
+		void* callstack[128];
+		const int max_frames = static_cast<int>(sizeof(callstack) / sizeof(callstack[0]));
+		const int num_frames = backtrace(callstack, max_frames);
+		return stacktrace_as_stdstring(callstack, num_frames, max_frames, skip);
+	}
+
 #else // LOGURU_STACKTRACES
 	Text demangle(const char* name)
 	{
@@ -1367,28 +4423,451 @@ namespace loguru
 				pos += bytes;
 			}
 		}
-		if (g_preamble_verbose && pos < out_buff_size) {
-			int bytes = snprintf(out_buff + pos, out_buff_size - pos, "%4s",
-			                     level_buff);
-			if (bytes > 0) {
-				pos += bytes;
+		if (g_preamble_verbose && pos < out_buff_size) {
+			int bytes = snprintf(out_buff + pos, out_buff_size - pos, "%4s",
+			                     level_buff);
+			if (bytes > 0) {
+				pos += bytes;
+			}
+		}
+		if (g_preamble_pipe && pos < out_buff_size) {
+			int bytes = snprintf(out_buff + pos, out_buff_size - pos, "| ");
+			if (bytes > 0) {
+				pos += bytes;
+			}
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	// Non-blocking stderr, see set_stderr_nonblocking.
+	// Everything here is called with s_mutex locked.
+
+#ifndef _WIN32
+	struct PendingLine
+	{
+		Verbosity   verbosity;
+		std::string text;
+	};
+
+	static int                     s_stderr_fd          = -1; // Only set in non-blocking mode.
+	static size_t                  s_stderr_buffer_size = 0;
+	static size_t                  s_stderr_buffered    = 0;  // Total size of s_stderr_pending.
+	static size_t                  s_stderr_written     = 0;  // How much of the first pending line has been written.
+	static std::deque<PendingLine> s_stderr_pending;
+	static unsigned long long      s_stderr_dropped       = 0; // Since the last report.
+	static unsigned long long      s_stderr_dropped_total = 0;
+	static long long               s_stderr_last_report_ns = 0;
+	static unsigned                s_stderr_report_interval_ms = 1000;
+	static std::string             s_stderr_line;
+	static bool                    s_stderr_blocked = false; // Protected by s_background_mutex. Wakes s_stderr_thread.
+
+	// Writes as much of the pending lines as stderr takes without blocking.
+	static void stderr_drain()
+	{
+		while (!s_stderr_pending.empty()) {
+			const std::string& text = s_stderr_pending.front().text;
+			const auto bytes = write(s_stderr_fd, text.data() + s_stderr_written, text.size() - s_stderr_written);
+			if (bytes < 0) {
+				if (errno == EINTR) { continue; }
+				return; // EAGAIN, or a reader that is gone. Keep it buffered.
+			}
+			s_stderr_written += static_cast<size_t>(bytes);
+			if (s_stderr_written == text.size()) {
+				s_stderr_buffered -= text.size();
+				s_stderr_written = 0;
+				s_stderr_pending.pop_front();
+			}
+		}
+	}
+
+	// Makes room for `size` more bytes by dropping the newest pending lines that are more verbose than `verbosity`.
+	static bool stderr_make_room(Verbosity verbosity, size_t size)
+	{
+		auto it = s_stderr_pending.end();
+		while (s_stderr_buffered + size > s_stderr_buffer_size && it != s_stderr_pending.begin()) {
+			--it;
+			const bool partially_written = (it == s_stderr_pending.begin() && s_stderr_written != 0);
+			if (it->verbosity > verbosity && !partially_written) {
+				s_stderr_buffered -= it->text.size();
+				it = s_stderr_pending.erase(it);
+				++s_stderr_dropped;
+				++s_stderr_dropped_total;
+			}
+		}
+		return s_stderr_buffered + size <= s_stderr_buffer_size;
+	}
+
+	// Called when stderr would block, so that s_stderr_thread keeps draining when nothing new is logged.
+	static void stderr_wake_drainer()
+	{
+		{
+			std::lock_guard<std::mutex> background_lock(s_background_mutex);
+			if (s_stderr_blocked) { return; }
+			s_stderr_blocked = true;
+		}
+		s_background_cv.notify_all();
+	}
+
+	static void stderr_write_nonblocking(Verbosity verbosity, const std::string& line)
+	{
+		stderr_drain();
+		size_t written = 0;
+		if (s_stderr_pending.empty()) {
+			while (written < line.size()) {
+				const auto bytes = write(s_stderr_fd, line.data() + written, line.size() - written);
+				if (bytes < 0) {
+					if (errno == EINTR) { continue; }
+					break;
+				}
+				written += static_cast<size_t>(bytes);
+			}
+			if (written == line.size()) {
+				return;
+			}
+		}
+		stderr_wake_drainer();
+		// Never drop a partially written line, or the next one would be glued to it.
+		if (written == 0 && !stderr_make_room(verbosity, line.size())) {
+			++s_stderr_dropped;
+			++s_stderr_dropped_total;
+			return;
+		}
+		s_stderr_pending.push_back(PendingLine{verbosity, line});
+		s_stderr_buffered += line.size();
+		s_stderr_written = written;
+	}
+
+	// Queues a single "N lines dropped" line for everything dropped since the last one.
+	static void stderr_report_drops()
+	{
+		if (s_stderr_dropped == 0) { return; }
+		const long long now = now_ns();
+		if (now - s_stderr_last_report_ns < static_cast<long long>(s_stderr_report_interval_ms) * 1000000) { return; }
+		char preamble_buff[LOGURU_PREAMBLE_WIDTH];
+		print_preamble(preamble_buff, sizeof(preamble_buff), Verbosity_WARNING, __FILE__, __LINE__);
+		char buff[LOGURU_PREAMBLE_WIDTH + 128];
+		snprintf(buff, sizeof(buff), "%s%llu lines to stderr dropped because it was not being read fast enough\n",
+			preamble_buff, s_stderr_dropped);
+		s_stderr_last_report_ns = now;
+		s_stderr_dropped = 0;
+		stderr_write_nonblocking(Verbosity_WARNING, buff);
+	}
+#endif // _WIN32
+
+	bool set_stderr_nonblocking(unsigned long long buffer_size, unsigned report_interval_ms)
+	{
+#ifndef _WIN32
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		if (s_stderr_fd != -1) {
+			stderr_drain();
+			close(s_stderr_fd);
+			s_stderr_fd = -1;
+			s_stderr_pending.clear();
+			s_stderr_buffered = 0;
+			s_stderr_written = 0;
+		}
+		if (buffer_size == 0) {
+			return true;
+		}
+
+		fflush(stderr);
+		int fd = -1;
+	#ifdef __linux__
+		// For pipes and terminals we can get our own open file description, so that
+		// O_NONBLOCK does not leak to fd 2, which the rest of the process may write to.
+		struct stat st;
+		if (fstat(STDERR_FILENO, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode))) {
+			fd = open("/proc/self/fd/2", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		}
+	#endif
+		if (fd == -1) {
+			fd = dup(STDERR_FILENO);
+			if (fd == -1 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+				LOG_F(ERROR, "Failed to make stderr non-blocking: " LOGURU_FMT(s) "", errno_as_text().c_str());
+				if (fd != -1) { close(fd); }
+				return false;
+			}
+		}
+
+		s_stderr_fd = fd;
+		s_stderr_buffer_size = static_cast<size_t>(buffer_size);
+		s_stderr_report_interval_ms = report_interval_ms;
+		if (!s_stderr_thread) {
+			// Keeps draining when nothing new is logged. Idle until stderr_wake_drainer.
+			s_stderr_thread = new std::thread([](){
+				for (;;) {
+					{
+						std::unique_lock<std::mutex> background_lock(s_background_mutex);
+						s_background_cv.wait(background_lock, []{ return s_stderr_blocked || s_background_quit; });
+					}
+					if (!background_sleep(10)) { return; }
+					std::lock_guard<std::recursive_mutex> lock(s_mutex);
+					if (s_stderr_fd != -1) {
+						stderr_drain();
+						stderr_report_drops();
+					}
+					if (s_stderr_fd == -1 || (s_stderr_pending.empty() && s_stderr_dropped == 0)) {
+						std::lock_guard<std::mutex> background_lock(s_background_mutex);
+						s_stderr_blocked = false;
+					}
+				}
+			});
+		}
+		VLOG_F(g_internal_verbosity, "stderr is non-blocking, buffer size: " LOGURU_FMT(d) "", static_cast<unsigned>(buffer_size));
+		return true;
+#else
+		(void)buffer_size;
+		(void)report_interval_ms;
+		VLOG_F(g_internal_verbosity, "Non-blocking stderr not implemented on this system.");
+		return false;
+#endif
+	}
+
+	unsigned long long stderr_lines_dropped()
+	{
+#ifndef _WIN32
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		return s_stderr_dropped_total;
+#else
+		return 0;
+#endif
+	}
+
+	static void log_to_stderr(const Message& message)
+	{
+		const auto verbosity = message.verbosity;
+#ifndef _WIN32
+		if (s_stderr_fd != -1) {
+			std::string& line = s_stderr_line;
+			line.clear();
+			const bool color = g_colorlogtostderr && s_terminal_has_color;
+			if (color) {
+				line += terminal_reset();
+				line += verbosity > Verbosity_WARNING ? terminal_dim() : verbosity == Verbosity_WARNING ? terminal_yellow() : terminal_red();
+			}
+			line += message.preamble;
+			line += message.indentation;
+			if (color && verbosity == Verbosity_INFO) {
+				line += terminal_reset(); // un-dim for info
+			}
+			line += message.prefix;
+			line += message.message;
+			line += fields_text(message);
+			if (color) {
+				line += terminal_reset();
+			}
+			line += '\n';
+			stderr_write_nonblocking(verbosity, line);
+			stderr_report_drops();
+			return;
+		}
+#endif
+		if (g_colorlogtostderr && s_terminal_has_color) {
+			if (verbosity > Verbosity_WARNING) {
+				fprintf(stderr, "%s%s%s%s%s%s%s%s%s\n",
+					terminal_reset(),
+					terminal_dim(),
+					message.preamble,
+					message.indentation,
+					verbosity == Verbosity_INFO ? terminal_reset() : "", // un-dim for info
+					message.prefix,
+					message.message,
+					fields_text(message),
+					terminal_reset());
+			} else {
+				fprintf(stderr, "%s%s%s%s%s%s%s%s\n",
+					terminal_reset(),
+					verbosity == Verbosity_WARNING ? terminal_yellow() : terminal_red(),
+					message.preamble,
+					message.indentation,
+					message.prefix,
+					message.message,
+					fields_text(message),
+					terminal_reset());
+			}
+		} else {
+			fprintf(stderr, "%s%s%s%s%s\n",
+				message.preamble, message.indentation, message.prefix, message.message, fields_text(message));
+		}
+
+		if (g_flush_interval_ms == 0 && !s_batch_in_progress) {
+			fflush(stderr);
+		} else {
+			s_needs_flushing = true;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	// Ring buffer of recent messages, see set_ring_buffer.
+
+	struct RingRecord
+	{
+		unsigned long long index; // Which message this is.
+		Verbosity          verbosity;
+		const char*        file;
+		unsigned           line;
+		char               preamble[LOGURU_PREAMBLE_WIDTH];
+		char               text[LOGURU_RING_TEXT_SIZE]; // indentation + prefix + message
+	};
+
+	struct RingEntry
+	{
+		std::atomic_flag busy; // Held while the record is written or read.
+		RingRecord       record;
+	};
+
+	struct RingBuffer
+	{
+		unsigned   size;
+		RingEntry* entries;
+	};
+
+	static std::atomic<RingBuffer*>        s_ring { nullptr };
+	static std::atomic<unsigned>           s_ring_users[2];           // Calls to ring_push and ring_consume in progress, see RingUse.
+	static std::atomic<unsigned>           s_ring_epoch { 0 };        // Its low bit says which s_ring_users new calls count in.
+	static std::atomic<unsigned long long> s_ring_next { 0 };         // Index of the next message.
+	static std::atomic<unsigned long long> s_ring_dumped_until { 0 }; // Everything before this has been written out.
+
+	// Holds on to s_ring while in scope, so that set_ring_buffer does not free it under us.
+	class RingUse
+	{
+	public:
+		RingUse() : _slot(s_ring_epoch.load() & 1)
+		{
+			s_ring_users[_slot].fetch_add(1);
+			ring = s_ring.load();
+		}
+		~RingUse() { s_ring_users[_slot].fetch_sub(1, std::memory_order_release); }
+		RingBuffer* ring;
+
+	private:
+		unsigned _slot;
+	};
+
+	// Lock-free. May drop the message if another thread is using the same entry.
+	static void ring_push(const Message& message)
+	{
+		RingUse use;
+		RingBuffer* ring = use.ring;
+		if (!ring) { return; }
+		const unsigned long long index = s_ring_next.fetch_add(1, std::memory_order_relaxed);
+		RingEntry& entry = ring->entries[index % ring->size];
+		if (entry.busy.test_and_set(std::memory_order_acquire)) {
+			return;
+		}
+		RingRecord& record = entry.record;
+		record.index     = index;
+		record.verbosity = message.verbosity;
+		record.file      = message.filename;
+		record.line      = message.line;
+		snprintf(record.preamble, sizeof(record.preamble), "%s", message.preamble);
+		snprintf(record.text, sizeof(record.text), "%s%s%s", message.indentation, message.prefix, message.message);
+		entry.busy.clear(std::memory_order_release);
+	}
+
+	// Calls visitor(const RingRecord&) on every message not yet written out, oldest first, then forgets them.
+	// Does not allocate or lock, so it is safe to use from a signal handler.
+	template<typename Visitor>
+	static void ring_consume(const Visitor& visitor)
+	{
+		RingUse use;
+		RingBuffer* ring = use.ring;
+		if (!ring) { return; }
+		const unsigned long long end = s_ring_next.load(std::memory_order_acquire);
+		unsigned long long index = std::max(s_ring_dumped_until.exchange(end), end < ring->size ? 0 : end - ring->size);
+		for (; index < end; ++index) {
+			RingEntry& entry = ring->entries[index % ring->size];
+			if (entry.busy.test_and_set(std::memory_order_acquire)) {
+				continue; // Being written (or read by a signal handler). Skip it.
+			}
+			if (entry.record.index == index) {
+				visitor(entry.record);
+			}
+			entry.busy.clear(std::memory_order_release);
+		}
+	}
+
+	// Writes the ring buffer to every output that has not already seen the messages in it.
+	// Called with s_mutex locked.
+	static void dump_ring_buffer()
+	{
+		ring_consume([](const RingRecord& record) {
+			auto message = Message{record.verbosity, record.file, record.line, record.preamble, "", "", record.text, 0, nullptr, 0, nullptr};
+			if (record.verbosity > g_stderr_verbosity) {
+				log_to_stderr(message);
+			}
+			for (auto& p : s_callbacks) {
+				if (record.verbosity > p.verbosity) {
+					if (p.async) {
+						async_enqueue(p.async, message);
+					} else {
+						p.callback(p.user_data, message);
+					}
+				}
+			}
+		});
+	}
+
+	void set_ring_buffer(unsigned num_messages, Verbosity verbosity)
+	{
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		RingBuffer* ring = nullptr;
+		if (num_messages > 0) {
+			ring = new RingBuffer{num_messages, new RingEntry[num_messages]};
+			for (unsigned i = 0; i < num_messages; ++i) {
+				ring->entries[i].busy.clear();
+				ring->entries[i].record.index = ~0ull;
 			}
 		}
-		if (g_preamble_pipe && pos < out_buff_size) {
-			int bytes = snprintf(out_buff + pos, out_buff_size - pos, "| ");
-			if (bytes > 0) {
-				pos += bytes;
+		// ring_push runs without a lock, so another thread may still be writing to the old ring.
+		// Anyone who picks up a ring from now on gets the new one, so the old one is free once each
+		// count of users has been zero. New users count in the other slot, so that one drains
+		// while we wait, however busy the ring is.
+		if (RingBuffer* old_ring = s_ring.exchange(ring)) {
+			for (int i = 0; i < 2; ++i) {
+				const unsigned slot = s_ring_epoch.fetch_add(1) & 1;
+				while (s_ring_users[slot].load(std::memory_order_acquire) != 0) {
+					std::this_thread::yield();
+				}
 			}
+			delete[] old_ring->entries;
+			delete old_ring;
 		}
+		s_ring_verbosity = ring ? verbosity : Verbosity_OFF;
+		s_ring_dumped_until = s_ring_next.load();
+		on_callback_change();
 	}
 
 	// stack_trace_skip is just if verbosity == FATAL.
 	static void log_message(int stack_trace_skip, Message& message, bool with_indentation, bool abort_if_fatal)
 	{
 		const auto verbosity = message.verbosity;
+		ThreadLocals& locals = thread_locals();
+
+		if (verbosity <= s_ring_verbosity.load(std::memory_order_relaxed) && verbosity > Verbosity_ERROR) {
+			if (with_indentation) {
+				message.depth = thread_scope_depth(locals, g_stderr_verbosity);
+				message.indentation = indentation(message.depth);
+			}
+			ring_push(message);
+			if (verbosity > g_stderr_verbosity && verbosity > s_max_callback_verbosity.load(std::memory_order_relaxed)) {
+				return; // Only kept in the ring, so no need to lock.
+			}
+		}
+
+		AsyncWaits async_waits;
 		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		AsyncWaits::Depth depth(async_waits);
+		locals.fields_text_message = nullptr; // `message` may be where the last one was.
+		message.context = locals.context_head;
+
+		if (verbosity <= Verbosity_ERROR) {
+			dump_ring_buffer();
+		}
 
 		if (message.verbosity == Verbosity_FATAL) {
+			s_fatal_in_progress = true;
+
 			auto st = loguru::stacktrace(stack_trace_skip + 2);
 			if (!st.empty()) {
 				RAW_LOG_F(ERROR, "Stack trace:\n" LOGURU_FMT(s) "", st.c_str());
@@ -1401,69 +4880,46 @@ namespace loguru
 		}
 
 		if (with_indentation) {
-			message.indentation = indentation(s_stderr_indentation);
+			message.depth = thread_scope_depth(locals, g_stderr_verbosity);
+			message.indentation = indentation(message.depth);
 		}
 
 		if (verbosity <= g_stderr_verbosity) {
-			if (g_colorlogtostderr && s_terminal_has_color) {
-				if (verbosity > Verbosity_WARNING) {
-					fprintf(stderr, "%s%s%s%s%s%s%s%s\n",
-						terminal_reset(),
-						terminal_dim(),
-						message.preamble,
-						message.indentation,
-						verbosity == Verbosity_INFO ? terminal_reset() : "", // un-dim for info
-						message.prefix,
-						message.message,
-						terminal_reset());
-				} else {
-					fprintf(stderr, "%s%s%s%s%s%s%s\n",
-						terminal_reset(),
-						verbosity == Verbosity_WARNING ? terminal_yellow() : terminal_red(),
-						message.preamble,
-						message.indentation,
-						message.prefix,
-						message.message,
-						terminal_reset());
-				}
-			} else {
-				fprintf(stderr, "%s%s%s%s\n",
-					message.preamble, message.indentation, message.prefix, message.message);
-			}
+			log_to_stderr(message);
+		}
 
-			if (g_flush_interval_ms == 0) {
-				fflush(stderr);
+		for_each_routed_callback(verbosity, [&](Callback& p) {
+			if (with_indentation) {
+				message.depth = thread_scope_depth(locals, p.verbosity);
+				message.indentation = indentation(message.depth);
+			}
+			if (p.async) {
+				async_enqueue(p.async, message);
+				return;
+			}
+			p.callback(p.user_data, message);
+			if (g_flush_interval_ms == 0 && !s_batch_in_progress) {
+				if (p.flush) { p.flush(p.user_data); }
 			} else {
 				s_needs_flushing = true;
 			}
-		}
-
-		for (auto& p : s_callbacks) {
-			if (verbosity <= p.verbosity) {
-				if (with_indentation) {
-					message.indentation = indentation(p.indentation);
-				}
-				p.callback(p.user_data, message);
-				if (g_flush_interval_ms == 0) {
-					if (p.flush) { p.flush(p.user_data); }
-				} else {
-					s_needs_flushing = true;
-				}
-			}
-		}
+		});
 
 		if (g_flush_interval_ms > 0 && !s_flush_thread) {
 			s_flush_thread = new std::thread([](){
-				for (;;) {
+				do {
 					if (s_needs_flushing) {
 						flush();
 					}
-					std::this_thread::sleep_for(std::chrono::milliseconds(g_flush_interval_ms));
-				}
+				} while (background_sleep(g_flush_interval_ms));
 			});
 		}
 
 		if (message.verbosity == Verbosity_FATAL) {
+			s_fatal_in_progress = false;
+			for (auto& p : s_callbacks) {
+				if (p.async) { async_drain(p.async, 1000); }
+			}
 			flush();
 
 			if (s_fatal_handler) {
@@ -1483,69 +4939,603 @@ namespace loguru
 		}
 	}
 
-	// stack_trace_skip is just if verbosity == FATAL.
-	void log_to_everywhere(int stack_trace_skip, Verbosity verbosity,
-	                       const char* file, unsigned line,
-	                       const char* prefix, const char* buff)
+	// stack_trace_skip is just if verbosity == FATAL.
+	void log_to_everywhere(int stack_trace_skip, Verbosity verbosity,
+	                       const char* file, unsigned line,
+	                       const char* prefix, const char* buff)
+	{
+		char preamble_buff[LOGURU_PREAMBLE_WIDTH];
+		print_preamble(preamble_buff, sizeof(preamble_buff), verbosity, file, line);
+		auto message = Message{verbosity, file, line, preamble_buff, "", prefix, buff, 0, nullptr, 0, nullptr};
+		log_message(stack_trace_skip + 1, message, true, true);
+	}
+
+	void log_fields(Verbosity verbosity, const char* file, unsigned line, const char* message, const Field* fields, unsigned num_fields)
+	{
+		char preamble_buff[LOGURU_PREAMBLE_WIDTH];
+		print_preamble(preamble_buff, sizeof(preamble_buff), verbosity, file, line);
+		auto msg = Message{verbosity, file, line, preamble_buff, "", "", message, 0, fields, num_fields, nullptr};
+		log_message(1, msg, true, true);
+	}
+
+	// Per-thread text buffers (see log_hex and LogBatch) above this are freed instead of kept for reuse.
+	static const size_t THREAD_TEXT_MAX_KEPT = 64 * 1024;
+
+	// Writes the two lower-case hex digits of each of the 8 bytes at `in` to `out`.
+	// All bytes are converted at once, one nibble (0-15) per byte of a 64-bit word:
+	// adding 0x76 to a nibble sets the top bit of its byte exactly when it is above 9.
+	static void hex_encode_8(const unsigned char* in, char* out)
+	{
+		const unsigned long long ones = 0x0101010101010101ULL;
+		unsigned long long bytes;
+		memcpy(&bytes, in, sizeof(bytes));
+		unsigned long long nibbles[2] = {(bytes >> 4) & (0x0f * ones), bytes & (0x0f * ones)};
+		for (auto& n : nibbles) {
+			const unsigned long long above_9 = ((n + 0x76 * ones) >> 7) & ones;
+			n += '0' * ones + above_9 * ('a' - '0' - 10);
+		}
+		char digits[2][8];
+		memcpy(digits, nibbles, sizeof(digits));
+		for (int i = 0; i < 8; ++i) {
+			out[2 * i]     = digits[0][i];
+			out[2 * i + 1] = digits[1][i];
+		}
+	}
+
+	// Appends one line of up to 16 bytes, e.g. "00000010  0a 0d 0a 00 ff      ...      |.....|"
+	static void hex_dump_line(std::string& out, unsigned long long offset, const unsigned char* bytes, size_t num_bytes)
+	{
+		unsigned char padded[16] = {0};
+		memcpy(padded, bytes, num_bytes);
+		char digits[32];
+		hex_encode_8(padded, digits);
+		hex_encode_8(padded + 8, digits + 16);
+
+		char line[80];
+		char* p = line;
+		for (int shift = 28; shift >= 0; shift -= 4) {
+			*p++ = "0123456789abcdef"[(offset >> shift) & 0xf];
+		}
+		*p++ = ' ';
+		for (size_t i = 0; i < 16; ++i) {
+			if (i == 8) { *p++ = ' '; }
+			*p++ = ' ';
+			*p++ = i < num_bytes ? digits[2 * i]     : ' ';
+			*p++ = i < num_bytes ? digits[2 * i + 1] : ' ';
+		}
+		*p++ = ' ';
+		*p++ = ' ';
+		*p++ = '|';
+		for (size_t i = 0; i < num_bytes; ++i) {
+			*p++ = (bytes[i] >= 0x20 && bytes[i] < 0x7f) ? static_cast<char>(bytes[i]) : '.';
+		}
+		*p++ = '|';
+		out.push_back('\n');
+		out.append(line, p);
+	}
+
+	// Takes the thread's hex dump text while log_hex uses it (a callback may do a LOG_HEX of its own),
+	// and gives it back afterwards, even if a callback throws.
+	struct HexTextLease
+	{
+		std::string* text;
+
+		HexTextLease() : text(thread_locals().hex_text)
+		{
+			thread_locals().hex_text = nullptr;
+			if (text == nullptr) {
+				text = new std::string();
+			}
+		}
+
+		~HexTextLease()
+		{
+			ThreadLocals& locals = thread_locals();
+			if (locals.hex_text == nullptr && text->capacity() <= THREAD_TEXT_MAX_KEPT) {
+				locals.hex_text = text;
+			} else {
+				delete text;
+			}
+		}
+
+		HexTextLease(const HexTextLease&) = delete;
+		HexTextLease& operator=(const HexTextLease&) = delete;
+	};
+
+	void log_hex(Verbosity verbosity, const char* file, unsigned line, const void* data, unsigned long long size, const char* description)
+	{
+		HexTextLease lease;
+		std::string* text = lease.text;
+
+		const size_t num_dumped = static_cast<size_t>(std::min<unsigned long long>(size, LOGURU_HEX_DUMP_MAX_BYTES));
+		char header[64];
+		snprintf(header, sizeof(header), " (%llu bytes):", size);
+		text->clear();
+		text->reserve(strlen(description) + sizeof(header) + (num_dumped + 15) / 16 * 80 + sizeof(header));
+		*text += description;
+		*text += header;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t offset = 0; offset < num_dumped; offset += 16) {
+			hex_dump_line(*text, offset, bytes + offset, std::min<size_t>(16, num_dumped - offset));
+		}
+		if (num_dumped < size) {
+			snprintf(header, sizeof(header), "\n... %llu more bytes", size - num_dumped);
+			*text += header;
+		}
+
+		log_to_everywhere(1, verbosity, file, line, "", text->c_str());
+	}
+
+	// ------------------------------------------------------------------------
+
+	// The lines of a LogBatch, each followed by a zero. Each thread keeps one for reuse.
+	struct BatchLines
+	{
+		std::string text;
+		bool        in_use = false;
+	};
+
+	LogBatch::LogBatch(Verbosity verbosity, const char* file, unsigned line)
+		: _verbosity(verbosity), _file(file), _line(line), _lines(nullptr)
+	{
+		if (verbosity > current_verbosity_cutoff()) {
+			return;
+		}
+		BatchLines*& thread_lines = thread_locals().batch_lines;
+		if (thread_lines == nullptr) {
+			thread_lines = new BatchLines();
+		}
+		// A batch within a batch gets lines of its own.
+		_lines = thread_lines->in_use ? new BatchLines() : thread_lines;
+		_lines->in_use = true;
+	}
+
+	// Gives the lines back to the thread, even if a callback throws.
+	struct BatchLinesReleaser
+	{
+		BatchLines* lines;
+
+		~BatchLinesReleaser()
+		{
+			if (lines != thread_locals().batch_lines) {
+				delete lines;
+				return;
+			}
+			lines->text.clear();
+			if (lines->text.capacity() > THREAD_TEXT_MAX_KEPT) {
+				std::string().swap(lines->text);
+			}
+			lines->in_use = false;
+		}
+	};
+
+	LogBatch::~LogBatch() noexcept
+	{
+		try {
+			write();
+		} catch (...) {
+			// Thrown by a callback (or the fatal handler). The rest of the batch is lost, but a destructor must not throw.
+			fprintf(stderr, "loguru: exception thrown while writing a LogBatch from %s:%u\n", _file, _line);
+			if (_verbosity == Verbosity_FATAL) {
+				abort();
+			}
+		}
+	}
+
+	void LogBatch::write()
+	{
+		if (_lines == nullptr) {
+			return;
+		}
+		BatchLinesReleaser releaser{_lines};
+		if (_lines->text.empty()) {
+			return;
+		}
+
+		AsyncWaits async_waits;
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		AsyncWaits::Depth depth(async_waits);
+		char preamble_buff[LOGURU_PREAMBLE_WIDTH];
+		print_preamble(preamble_buff, sizeof(preamble_buff), _verbosity, _file, _line);
+		{
+			struct BatchFlag
+			{
+				bool previous = s_batch_in_progress;
+				BatchFlag() { s_batch_in_progress = true; }
+				~BatchFlag() { s_batch_in_progress = previous; }
+			} batch_flag;
+
+			const std::string& text = _lines->text;
+			for (size_t pos = 0; pos < text.size(); pos = text.find('\0', pos) + 1) {
+				auto message = Message{_verbosity, _file, _line, preamble_buff, "", "", &text[pos], 0, nullptr, 0, nullptr};
+				log_message(1, message, true, true);
+			}
+		}
+		if (g_flush_interval_ms == 0 && !s_batch_in_progress) {
+			flush();
+		}
+	}
+
+#if LOGURU_USE_FMTLIB
+	void LogBatch::vadd(fmt::string_view format, fmt::format_args args)
+	{
+		if (_lines) {
+			fmt::vformat_to(std::back_inserter(_lines->text), format, args);
+			_lines->text.push_back('\0');
+		}
+	}
+#elif LOGURU_USE_STD_FORMAT
+	void LogBatch::vadd(std::string_view format, std::format_args args)
+	{
+		if (_lines) {
+			std::vformat_to(std::back_inserter(_lines->text), format, args);
+			_lines->text.push_back('\0');
+		}
+	}
+#else
+	void LogBatch::add(const char* format, ...)
+	{
+		if (_lines == nullptr) {
+			return;
+		}
+		std::string& text = _lines->text;
+		char buff[256];
+		va_list vlist;
+		va_start(vlist, format);
+		const int length = vsnprintf(buff, sizeof(buff), format, vlist);
+		va_end(vlist);
+		if (length < 0) {
+			return;
+		}
+		if (static_cast<size_t>(length) < sizeof(buff)) {
+			text.append(buff, static_cast<size_t>(length));
+		} else {
+			// Too long for the stack buffer: format again, straight into the text.
+			const size_t old_size = text.size();
+			text.resize(old_size + static_cast<size_t>(length) + 1);
+			va_start(vlist, format);
+			vsnprintf(&text[old_size], static_cast<size_t>(length) + 1, format, vlist);
+			va_end(vlist);
+			text.resize(old_size + static_cast<size_t>(length));
+		}
+		text.push_back('\0');
+	}
+#endif
+
+	void log_plain(Verbosity verbosity, const char* file, unsigned line, const char* message)
+	{
+		log_to_everywhere(1, verbosity, file, line, "", message);
+	}
+
+	void raw_log_plain(Verbosity verbosity, const char* file, unsigned line, const char* message)
+	{
+		auto msg = Message{verbosity, file, line, "", "", "", message, 0, nullptr, 0, nullptr};
+		log_message(1, msg, false, true);
+	}
+
+#if LOGURU_USE_FMTLIB
+	void vlog(Verbosity verbosity, const char* file, unsigned line, fmt::string_view format, fmt::format_args args)
+	{
+		FormattedText formatted(format, args);
+		log_to_everywhere(1, verbosity, file, line, "", formatted.c_str());
+	}
+
+	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, fmt::string_view format, fmt::format_args args)
+	{
+		FormattedText formatted(format, args);
+		auto message = Message{verbosity, file, line, "", "", "", formatted.c_str(), 0, nullptr, 0, nullptr};
+		log_message(1, message, false, true);
+	}
+#elif LOGURU_USE_STD_FORMAT
+	void vlog(Verbosity verbosity, const char* file, unsigned line, std::string_view format, std::format_args args)
+	{
+		FormattedText formatted(format, args);
+		log_to_everywhere(1, verbosity, file, line, "", formatted.c_str());
+	}
+
+	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, std::string_view format, std::format_args args)
+	{
+		FormattedText formatted(format, args);
+		auto message = Message{verbosity, file, line, "", "", "", formatted.c_str(), 0, nullptr, 0, nullptr};
+		log_message(1, message, false, true);
+	}
+#else
+	void log(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+	{
+		va_list vlist;
+		va_start(vlist, format);
+		vlog(verbosity, file, line, format, vlist);
+		va_end(vlist);
+	}
+
+	void vlog(Verbosity verbosity, const char* file, unsigned line, const char* format, va_list vlist)
+	{
+		auto buff = vtextprintf(format, vlist);
+		log_to_everywhere(1, verbosity, file, line, "", buff.c_str());
+	}
+
+	void raw_log(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+	{
+		va_list vlist;
+		va_start(vlist, format);
+		auto buff = vtextprintf(format, vlist);
+		auto message = Message{verbosity, file, line, "", "", "", buff.c_str(), 0, nullptr, 0, nullptr};
+		log_message(1, message, false, true);
+		va_end(vlist);
+	}
+#endif
+
+	void flush()
+	{
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+		fflush(stderr);
+#ifndef _WIN32
+		if (s_stderr_fd != -1) {
+			stderr_drain();
+		}
+#endif
+		for (const auto& callback : s_callbacks)
+		{
+			if (callback.async) {
+				// Only the worker may touch the callback; it flushes once it has caught up.
+				std::lock_guard<std::mutex> async_lock(callback.async->mutex);
+				callback.async->needs_flush = true;
+				callback.async->has_work.notify_one();
+			} else if (callback.flush) {
+				callback.flush(callback.user_data);
+			}
+		}
+		trace_flush();
+		s_needs_flushing = false;
+	}
+
+	// ------------------------------------------------------------------------
+	// Scope profiler, see set_scope_profiling.
+
+	static std::atomic<int>      s_scope_profile_verbosity { Verbosity_OFF };
+	static std::atomic<bool>     s_scope_profile_log_scopes { true };
+	static std::atomic<unsigned> s_scope_report_interval_ms { 0 };
+	static std::atomic<int>      s_scope_report_verbosity { Verbosity_INFO };
+
+	// Latencies go in log-linear buckets, like an HDR histogram: values below 16 ns get a bucket each,
+	// and every power of two above that is split into 16 buckets, so a bucket is at most 1/16 wide.
+	static const int LATENCY_SUB_BUCKET_BITS = 4;
+	static const int NUM_LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BUCKET_BITS;
+	static const int NUM_LATENCY_BUCKETS     = (64 - LATENCY_SUB_BUCKET_BITS + 1) * NUM_LATENCY_SUB_BUCKETS;
+
+	static int highest_bit(unsigned long long value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return 63 - __builtin_clzll(value);
+#else
+		int bit = 0;
+		while (value >>= 1) { ++bit; }
+		return bit;
+#endif
+	}
+
+	static int latency_bucket(long long ns)
+	{
+		const unsigned long long value = ns > 0 ? static_cast<unsigned long long>(ns) : 0;
+		if (value < NUM_LATENCY_SUB_BUCKETS) {
+			return static_cast<int>(value);
+		}
+		const int shift = highest_bit(value) - LATENCY_SUB_BUCKET_BITS;
+		const int sub_bucket = static_cast<int>((value >> shift) & (NUM_LATENCY_SUB_BUCKETS - 1));
+		return ((shift + 1) << LATENCY_SUB_BUCKET_BITS) | sub_bucket;
+	}
+
+	// The largest value that goes in the bucket.
+	static long long latency_bucket_max(int bucket)
+	{
+		if (bucket < NUM_LATENCY_SUB_BUCKETS) {
+			return bucket;
+		}
+		const int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+		const unsigned long long sub_bucket = static_cast<unsigned long long>(bucket & (NUM_LATENCY_SUB_BUCKETS - 1));
+		const unsigned long long lowest = (NUM_LATENCY_SUB_BUCKETS + sub_bucket) << shift;
+		return static_cast<long long>(lowest + ((1ULL << shift) - 1));
+	}
+
+	enum ScopeCallsiteState { ScopeCallsite_Empty, ScopeCallsite_Claiming, ScopeCallsite_Ready };
+
+	// The profiled scopes of one callsite. Claimed once, then updated without locks.
+	struct ScopeCallsite
+	{
+		std::atomic<int>                state;   // ScopeCallsiteState.
+		const char*                     file;
+		unsigned                        line;
+		char                            name[64];
+		std::atomic<unsigned long long> count;
+		std::atomic<long long>          max_ns;
+		std::atomic<unsigned>*          buckets; // NUM_LATENCY_BUCKETS of them.
+	};
+
+	static ScopeCallsite s_scope_callsites[LOGURU_SCOPE_PROFILE_MAX_CALLSITES];
+
+	// An open-addressing hash table keyed on file and line. Returns nullptr if it is full.
+	static ScopeCallsite* find_scope_callsite(const char* file, unsigned line, const char* format)
+	{
+		const unsigned num_slots = LOGURU_SCOPE_PROFILE_MAX_CALLSITES;
+		const unsigned first = static_cast<unsigned>((line * 2654435761ULL) % num_slots);
+		for (unsigned i = 0; i < num_slots; ++i) {
+			ScopeCallsite& site = s_scope_callsites[(first + i) % num_slots];
+			int state = site.state.load(std::memory_order_acquire);
+			if (state == ScopeCallsite_Empty &&
+			    site.state.compare_exchange_strong(state, ScopeCallsite_Claiming, std::memory_order_acquire)) {
+				site.file = file;
+				site.line = line;
+				snprintf(site.name, sizeof(site.name), "%s", format);
+				site.buckets = new std::atomic<unsigned>[NUM_LATENCY_BUCKETS]();
+				site.state.store(ScopeCallsite_Ready, std::memory_order_release);
+				return &site;
+			}
+			// Another thread is claiming it; that only takes a moment.
+			while (state == ScopeCallsite_Claiming) {
+				std::this_thread::yield();
+				state = site.state.load(std::memory_order_acquire);
+			}
+			// __FILE__ may be a different pointer in each translation unit.
+			if (site.line == line && (site.file == file || strcmp(site.file, file) == 0)) {
+				return &site;
+			}
+		}
+		return nullptr;
+	}
+
+	static void record_scope_latency(ScopeCallsite* site, long long ns)
+	{
+		site->buckets[latency_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		site->count.fetch_add(1, std::memory_order_relaxed);
+		long long max_ns = site->max_ns.load(std::memory_order_relaxed);
+		while (ns > max_ns && !site->max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+		}
+	}
+
+	// The smallest bucket maximum that at least the given fraction of the recorded latencies are within.
+	static long long scope_latency_percentile(const ScopeCallsite& site, double fraction, long long max_ns)
+	{
+		std::vector<unsigned> counts(NUM_LATENCY_BUCKETS);
+		unsigned long long total = 0;
+		for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+			counts[static_cast<size_t>(i)] = site.buckets[i].load(std::memory_order_relaxed);
+			total += counts[static_cast<size_t>(i)];
+		}
+		const auto rank = std::max<unsigned long long>(1, static_cast<unsigned long long>(std::ceil(fraction * static_cast<double>(total))));
+		unsigned long long seen = 0;
+		for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+			seen += counts[static_cast<size_t>(i)];
+			if (seen >= rank) {
+				return std::min(latency_bucket_max(i), max_ns);
+			}
+		}
+		return max_ns;
+	}
+
+	Verbosity current_scope_verbosity_cutoff()
 	{
-		char preamble_buff[LOGURU_PREAMBLE_WIDTH];
-		print_preamble(preamble_buff, sizeof(preamble_buff), verbosity, file, line);
-		auto message = Message{verbosity, file, line, preamble_buff, "", prefix, buff};
-		log_message(stack_trace_skip + 1, message, true, true);
+		return std::max(current_verbosity_cutoff(), static_cast<Verbosity>(s_scope_profile_verbosity.load(std::memory_order_relaxed)));
 	}
 
-#if LOGURU_USE_FMTLIB
-	void vlog(Verbosity verbosity, const char* file, unsigned line, const char* format, fmt::format_args args)
+	unsigned get_scope_stats(ScopeStats* out_stats, unsigned max_stats)
 	{
-		auto formatted = fmt::vformat(format, args);
-		log_to_everywhere(1, verbosity, file, line, "", formatted.c_str());
+		unsigned num_callsites = 0;
+		for (const ScopeCallsite& site : s_scope_callsites) {
+			if (site.state.load(std::memory_order_acquire) != ScopeCallsite_Ready) { continue; }
+			const unsigned long long count = site.count.load(std::memory_order_relaxed);
+			if (count == 0) { continue; }
+			if (num_callsites < max_stats) {
+				ScopeStats& stats = out_stats[num_callsites];
+				stats.file   = site.file;
+				stats.line   = site.line;
+				stats.name   = site.name;
+				stats.count  = count;
+				stats.max_ns = site.max_ns.load(std::memory_order_relaxed);
+				stats.p50_ns = scope_latency_percentile(site, 0.50, stats.max_ns);
+				stats.p99_ns = scope_latency_percentile(site, 0.99, stats.max_ns);
+			}
+			++num_callsites;
+		}
+		return num_callsites;
 	}
 
-	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, const char* format, fmt::format_args args)
+	void reset_scope_stats()
 	{
-		auto formatted = fmt::vformat(format, args);
-		auto message = Message{verbosity, file, line, "", "", "", formatted.c_str()};
-		log_message(1, message, false, true);
+		for (ScopeCallsite& site : s_scope_callsites) {
+			if (site.state.load(std::memory_order_acquire) != ScopeCallsite_Ready) { continue; }
+			site.count.store(0, std::memory_order_relaxed);
+			site.max_ns.store(0, std::memory_order_relaxed);
+			for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+				site.buckets[i].store(0, std::memory_order_relaxed);
+			}
+		}
 	}
-#else
-	void log(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+
+	// e.g. "  1.23 ms"
+	static void format_latency(char* buff, size_t buff_size, long long ns)
 	{
-		va_list vlist;
-		va_start(vlist, format);
-		vlog(verbosity, file, line, format, vlist);
-		va_end(vlist);
+		if (ns < 1000) {
+			snprintf(buff, buff_size, "%6lld ns", ns);
+		} else if (ns < 1000000) {
+			snprintf(buff, buff_size, "%6.2f us", static_cast<double>(ns) / 1e3);
+		} else if (ns < 1000000000) {
+			snprintf(buff, buff_size, "%6.2f ms", static_cast<double>(ns) / 1e6);
+		} else {
+			snprintf(buff, buff_size, "%6.2f s ", static_cast<double>(ns) / 1e9);
+		}
 	}
 
-	void vlog(Verbosity verbosity, const char* file, unsigned line, const char* format, va_list vlist)
+	// A header line, then one line per callsite, slowest p99 first.
+	static std::vector<std::string> scope_stats_lines()
 	{
-		auto buff = vtextprintf(format, vlist);
-		log_to_everywhere(1, verbosity, file, line, "", buff.c_str());
+		std::vector<ScopeStats> stats(LOGURU_SCOPE_PROFILE_MAX_CALLSITES);
+		stats.resize(get_scope_stats(stats.data(), static_cast<unsigned>(stats.size())));
+		std::sort(stats.begin(), stats.end(), [](const ScopeStats& a, const ScopeStats& b) {
+			return a.p99_ns > b.p99_ns;
+		});
+
+		std::vector<std::string> lines;
+		lines.emplace_back("     count        p50        p99        max  scope");
+		for (const ScopeStats& site : stats) {
+			char p50[32], p99[32], max[32];
+			format_latency(p50, sizeof(p50), site.p50_ns);
+			format_latency(p99, sizeof(p99), site.p99_ns);
+			format_latency(max, sizeof(max), site.max_ns);
+			char line[LOGURU_FILENAME_WIDTH + 256];
+			snprintf(line, sizeof(line), "%10llu  %s  %s  %s  %s:%u %s",
+				site.count, p50, p99, max, filename(site.file), site.line, site.name);
+			lines.emplace_back(line);
+		}
+		return lines;
 	}
 
-	void raw_log(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+	Text scope_stats_report()
 	{
-		va_list vlist;
-		va_start(vlist, format);
-		auto buff = vtextprintf(format, vlist);
-		auto message = Message{verbosity, file, line, "", "", "", buff.c_str()};
-		log_message(1, message, false, true);
-		va_end(vlist);
+		std::string report;
+		for (const std::string& line : scope_stats_lines()) {
+			if (!report.empty()) { report += '\n'; }
+			report += line;
+		}
+		return Text(STRDUP(report.c_str()));
 	}
-#endif
 
-	void flush()
+	static void log_scope_stats()
+	{
+		const std::vector<std::string> lines = scope_stats_lines();
+		if (lines.size() <= 1) {
+			return;
+		}
+		LogBatch batch(static_cast<Verbosity>(s_scope_report_verbosity.load()), __FILE__, __LINE__);
+		for (const std::string& line : lines) {
+			batch.add(LOGURU_FMT(s), line.c_str());
+		}
+	}
+
+	void set_scope_profiling(const ScopeProfilingOptions& options)
 	{
+		s_scope_profile_log_scopes = options.log_scopes;
+		s_scope_report_verbosity = options.report_verbosity;
+		s_scope_report_interval_ms = options.report_interval_ms;
+		s_scope_profile_verbosity = options.verbosity;
+
 		std::lock_guard<std::recursive_mutex> lock(s_mutex);
-		fflush(stderr);
-		for (const auto& callback : s_callbacks)
-		{
-			if (callback.flush) {
-				callback.flush(callback.user_data);
-			}
+		if (options.report_interval_ms > 0 && !s_scope_report_thread) {
+			s_scope_report_thread = new std::thread([](){
+				for (;;) {
+					const unsigned interval_ms = s_scope_report_interval_ms;
+					if (!background_sleep(interval_ms > 0 ? interval_ms : 100)) {
+						return;
+					}
+					if (interval_ms > 0 && s_scope_report_interval_ms > 0) {
+						log_scope_stats();
+					}
+				}
+			});
 		}
-		s_needs_flushing = false;
 	}
 
+	// ------------------------------------------------------------------------
+
 	LogScopeRAII::LogScopeRAII(Verbosity verbosity, const char* file, unsigned line, const char* format, va_list vlist) :
 		_verbosity(verbosity), _file(file), _line(line)
 	{
@@ -1564,23 +5554,25 @@ namespace loguru
 	LogScopeRAII::~LogScopeRAII()
 	{
 		if (_file) {
-			std::lock_guard<std::recursive_mutex> lock(s_mutex);
-			if (_indent_stderr && s_stderr_indentation > 0) {
-				--s_stderr_indentation;
+			const long long end_ns = now_ns();
+			const long long duration_ns = end_ns - _start_time_ns;
+			if (_callsite) {
+				record_scope_latency(_callsite, duration_ns);
 			}
-			for (auto& p : s_callbacks) {
-				// Note: Callback indentation cannot change!
-				if (_verbosity <= p.verbosity) {
-					// in unlikely case this callback is new
-					if (p.indentation > 0) {
-						--p.indentation;
-					}
-				}
+			if (_traced) {
+				trace_scope(_file, _line, _name, _start_time_ns, end_ns);
+			}
+			if (!_logged) {
+				return;
+			}
+			std::vector<Verbosity>* open_scopes = thread_locals().open_scopes;
+			if (open_scopes && !open_scopes->empty()) {
+				open_scopes->pop_back();
 			}
 #if LOGURU_VERBOSE_SCOPE_ENDINGS
-			auto duration_sec = static_cast<double>(now_ns() - _start_time_ns) / 1e9;
-#if LOGURU_USE_FMTLIB
-			auto buff = textprintf("{:.{}f} s: {:s}", duration_sec, LOGURU_SCOPE_TIME_PRECISION, _name);
+			auto duration_sec = static_cast<double>(duration_ns) / 1e9;
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
+			auto buff = textprintf("{:.{}f} s: {:s}", duration_sec, LOGURU_SCOPE_TIME_PRECISION, static_cast<const char*>(_name));
 #else
 			auto buff = textprintf("%.*f s: %s", LOGURU_SCOPE_TIME_PRECISION, duration_sec, _name);
 #endif
@@ -1593,31 +5585,303 @@ namespace loguru
 
 	void LogScopeRAII::Init(const char* format, va_list vlist)
 	{
-		if (_verbosity <= current_verbosity_cutoff()) {
-			std::lock_guard<std::recursive_mutex> lock(s_mutex);
-			_indent_stderr = (_verbosity <= g_stderr_verbosity);
-			_start_time_ns = now_ns();
+		_callsite = nullptr;
+		if (_verbosity <= s_scope_profile_verbosity.load(std::memory_order_relaxed)) {
+			_callsite = find_scope_callsite(_file, _line, format);
+		}
+		_logged = _verbosity <= current_verbosity_cutoff() && (!_callsite || s_scope_profile_log_scopes);
+		_traced = _verbosity <= s_trace_verbosity.load(std::memory_order_relaxed);
+		if (!_logged && !_callsite && !_traced) {
+			_file = nullptr;
+			return;
+		}
+
+		if (_logged || _traced) {
 			vsnprintf(_name, sizeof(_name), format, vlist);
+		}
+		if (_logged) {
 			log_to_everywhere(1, _verbosity, _file, _line, "{ ", _name);
 
-			if (_indent_stderr) {
-				++s_stderr_indentation;
+			// Only this thread's messages are indented, so no lock is needed.
+			ThreadLocals& locals = thread_locals();
+			if (!locals.open_scopes) {
+				locals.open_scopes = new std::vector<Verbosity>();
 			}
+			locals.open_scopes->push_back(_verbosity);
+		}
+		// Started after the "{" line, so that writing it is not part of the scope's time.
+		_start_time_ns = now_ns();
+	}
 
-			for (auto& p : s_callbacks) {
-				if (_verbosity <= p.verbosity) {
-					++p.indentation;
+	// ------------------------------------------------------------------------
+	// Scope budgets and the watchdog, see LOG_SCOPE_BUDGET_F and set_scope_watchdog.
+
+	// The budgeted scopes open on one thread, innermost last. Only registered while the watchdog runs.
+	struct ScopeBudgets
+	{
+		std::mutex                       mutex; // While the watchdog holds it, none of the scopes can close.
+		std::vector<LogScopeBudgetRAII*> open;
+		char                             thread_name[LOGURU_THREADNAME_WIDTH + 1];
+#if LOGURU_PTHREADS
+		pthread_t                        thread;
+#endif
+		unsigned                         samplers; // Stack traces being captured. Guarded by s_scope_budgets_mutex.
+	};
+
+	static std::atomic<unsigned>      s_watchdog_interval_ms { 0 };
+	static std::atomic<int>           s_watchdog_verbosity { Verbosity_WARNING };
+	static std::atomic<bool>          s_watchdog_stacktraces { true };
+	static std::mutex                 s_scope_budgets_mutex;
+	static std::condition_variable    s_scope_budgets_sampled; // ScopeBudgets::samplers went down.
+	static std::vector<ScopeBudgets*> s_scope_budgets;
+
+	static void scope_budgets_thread_exit(ScopeBudgets* budgets)
+	{
+		if (!budgets) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(s_scope_budgets_mutex);
+		// The watchdog may be about to signal us, so stay around until it is done:
+		s_scope_budgets_sampled.wait(lock, [budgets]{ return budgets->samplers == 0; });
+		s_scope_budgets.erase(std::remove(s_scope_budgets.begin(), s_scope_budgets.end(), budgets), s_scope_budgets.end());
+		delete budgets;
+	}
+
+#if LOGURU_PTHREADS && LOGURU_STACKTRACES
+	static const int         WATCHDOG_MAX_FRAMES = 128;
+	static void*             s_watchdog_frames[WATCHDOG_MAX_FRAMES];
+	static std::atomic<int>  s_watchdog_num_frames { -1 };
+	static std::atomic<bool> s_watchdog_signal_installed { false };
+
+	static void watchdog_signal_handler(int)
+	{
+		const int saved_errno = errno;
+		s_watchdog_num_frames = backtrace(s_watchdog_frames, WATCHDOG_MAX_FRAMES);
+		errno = saved_errno;
+	}
+
+	// Returns false if the signal is already taken by someone else.
+	static bool install_watchdog_signal_handler()
+	{
+		struct sigaction old_action;
+		if (sigaction(LOGURU_WATCHDOG_SIGNAL, NULL, &old_action) == -1 || (old_action.sa_flags & SA_SIGINFO) ||
+			(old_action.sa_handler != SIG_DFL && old_action.sa_handler != SIG_IGN)) {
+			LOG_F(WARNING, "Signal " LOGURU_FMT(d) " already has a handler, so the scope watchdog will not capture "
+				"stack traces. Define LOGURU_WATCHDOG_SIGNAL to use another signal.", LOGURU_WATCHDOG_SIGNAL);
+			return false;
+		}
+
+		// The first backtrace() loads libgcc, which is not something to do in a signal handler.
+		void* frame;
+		(void)backtrace(&frame, 1);
+
+		struct sigaction sig_action;
+		memset(&sig_action, 0, sizeof(sig_action));
+		sigemptyset(&sig_action.sa_mask);
+		sig_action.sa_flags |= SA_RESTART;
+		sig_action.sa_handler = &watchdog_signal_handler;
+		CHECK_F(sigaction(LOGURU_WATCHDOG_SIGNAL, &sig_action, NULL) != -1,
+			"Failed to install handler for signal " LOGURU_FMT(d) "", LOGURU_WATCHDOG_SIGNAL);
+		return true;
+	}
+
+	// Has the thread capture its own stack in watchdog_signal_handler. Empty if it does not in time.
+	static std::string thread_stacktrace(pthread_t thread)
+	{
+		s_watchdog_num_frames = -1;
+		if (!s_watchdog_signal_installed || pthread_kill(thread, LOGURU_WATCHDOG_SIGNAL) != 0) {
+			return "";
+		}
+		for (int ms = 0; ms < 100 && s_watchdog_num_frames < 0; ++ms) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		const int num_frames = s_watchdog_num_frames;
+		if (num_frames < 0) {
+			return "";
+		}
+		// Skip the signal handler and the signal trampoline.
+		return stacktrace_as_stdstring(s_watchdog_frames, num_frames, WATCHDOG_MAX_FRAMES, 2);
+	}
+#endif // LOGURU_PTHREADS && LOGURU_STACKTRACES
+
+	static std::string error_context_as_stdstring(const EcEntryBase* ec_head, bool with_values);
+
+	static void format_budget(char* buff, size_t buff_size, const char* name, const char* what, long long duration_ns, long long budget_ns)
+	{
+		snprintf(buff, buff_size, "'%s' %s %.*f s, over its budget of %g ms", name, what,
+			LOGURU_SCOPE_TIME_PRECISION, static_cast<double>(duration_ns) / 1e9, static_cast<double>(budget_ns) / 1e6);
+	}
+
+	struct ScopeWatchdog
+	{
+		struct Overrun
+		{
+			const char* file;
+			unsigned    line;
+			std::string text;
+			std::string error_context;
+			std::string stacktrace;
+			ScopeBudgets* budgets; // Of the thread, if we are to capture its stack.
+		};
+
+		// Reports each scope that is open past its budget, once.
+		static void check()
+		{
+			std::vector<Overrun> overruns;
+			{
+				const long long time_ns = now_ns();
+				std::lock_guard<std::mutex> lock(s_scope_budgets_mutex);
+				for (ScopeBudgets* budgets : s_scope_budgets) {
+					std::lock_guard<std::mutex> budgets_lock(budgets->mutex);
+					for (LogScopeBudgetRAII* scope : budgets->open) {
+						const long long duration_ns = time_ns - scope->_start_time_ns;
+						if (scope->_reported || duration_ns <= scope->_budget_ns) {
+							continue;
+						}
+						scope->_reported = true;
+
+						char buff[LOGURU_SCOPE_TEXT_SIZE + 128];
+						format_budget(buff, sizeof(buff), scope->_name, "has been open for", duration_ns, scope->_budget_ns);
+						Overrun overrun{scope->_file, scope->_line, buff, "", "", nullptr};
+						overrun.text += " on thread '";
+						overrun.text += budgets->thread_name;
+						overrun.text += "'";
+						// The contexts outside of the scope stay alive while it is open,
+						// but their values are the other thread's business.
+						overrun.error_context = error_context_as_stdstring(scope->_ec_handle, false);
+						if (s_watchdog_stacktraces) {
+							overrun.budgets = budgets;
+							++budgets->samplers;
+						}
+						overruns.push_back(overrun);
+					}
 				}
 			}
-		} else {
+
+			// Captured without the locks, since it takes a while. The thread may close the scope meanwhile, but not exit.
+			for (Overrun& overrun : overruns) {
+				if (!overrun.budgets) {
+					continue;
+				}
+#if LOGURU_PTHREADS && LOGURU_STACKTRACES
+				overrun.stacktrace = thread_stacktrace(overrun.budgets->thread);
+#endif
+				std::lock_guard<std::mutex> lock(s_scope_budgets_mutex);
+				--overrun.budgets->samplers;
+				s_scope_budgets_sampled.notify_all();
+			}
+
+			// Logged without the locks, in case a scope is open in a callback.
+			for (const Overrun& overrun : overruns) {
+				LogBatch batch(static_cast<Verbosity>(s_watchdog_verbosity.load()), overrun.file, overrun.line);
+				batch.add(LOGURU_FMT(s), overrun.text.c_str());
+				if (!overrun.error_context.empty()) {
+					batch.add(LOGURU_FMT(s), overrun.error_context.c_str());
+				}
+				if (!overrun.stacktrace.empty()) {
+					batch.add("Stack trace:\n" LOGURU_FMT(s) "", overrun.stacktrace.c_str());
+				}
+			}
+		}
+	};
+
+	void set_scope_watchdog(const ScopeWatchdogOptions& options)
+	{
+		s_watchdog_verbosity = options.verbosity;
+		s_watchdog_stacktraces = options.stacktraces;
+		s_watchdog_interval_ms = options.interval_ms;
+
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
+#if LOGURU_PTHREADS && LOGURU_STACKTRACES
+		if (options.interval_ms > 0 && options.stacktraces && !s_watchdog_signal_installed) {
+			s_watchdog_signal_installed = install_watchdog_signal_handler();
+		}
+#endif
+		if (options.interval_ms > 0 && !s_watchdog_thread) {
+			s_watchdog_thread = new std::thread([](){
+				for (;;) {
+					const unsigned interval_ms = s_watchdog_interval_ms;
+					if (!background_sleep(interval_ms > 0 ? interval_ms : 100)) {
+						return;
+					}
+					if (interval_ms > 0 && s_watchdog_interval_ms > 0) {
+						ScopeWatchdog::check();
+					}
+				}
+			});
+		}
+	}
+
+	LogScopeBudgetRAII::LogScopeBudgetRAII(Verbosity verbosity, const char* file, unsigned line, double budget_ms, const char* format, ...) :
+		_verbosity(verbosity), _file(file), _line(line), _budget_ns(static_cast<long long>(budget_ms * 1e6)),
+		_budgets(nullptr), _ec_handle(nullptr), _reported(false)
+	{
+		if (verbosity > current_verbosity_cutoff()) {
 			_file = nullptr;
+			return;
+		}
+		va_list vlist;
+		va_start(vlist, format);
+		vsnprintf(_name, sizeof(_name), format, vlist);
+		va_end(vlist);
+
+		if (s_watchdog_interval_ms.load(std::memory_order_relaxed) > 0) {
+			ThreadLocals& locals = thread_locals();
+			if (!locals.scope_budgets) {
+				ScopeBudgets* budgets = new ScopeBudgets();
+				get_thread_name(budgets->thread_name, sizeof(budgets->thread_name), false);
+#if LOGURU_PTHREADS
+				budgets->thread = pthread_self();
+#endif
+				std::lock_guard<std::mutex> lock(s_scope_budgets_mutex);
+				s_scope_budgets.push_back(budgets);
+				locals.scope_budgets = budgets;
+			}
+			_budgets = locals.scope_budgets;
+			_ec_handle = get_thread_ec_handle();
+			std::lock_guard<std::mutex> lock(_budgets->mutex);
+			_start_time_ns = now_ns(); // Before the watchdog can see us.
+			_budgets->open.push_back(this);
+		} else {
+			_start_time_ns = now_ns();
+		}
+	}
+
+	LogScopeBudgetRAII::~LogScopeBudgetRAII()
+	{
+		if (!_file) {
+			return;
+		}
+		const long long duration_ns = now_ns() - _start_time_ns;
+		if (_budgets) {
+			std::lock_guard<std::mutex> lock(_budgets->mutex);
+			_budgets->open.pop_back();
+		}
+		if (duration_ns <= _budget_ns) {
+			return;
+		}
+
+		char buff[LOGURU_SCOPE_TEXT_SIZE + 128];
+		format_budget(buff, sizeof(buff), _name, "took", duration_ns, _budget_ns);
+		LogBatch batch(_verbosity, _file, _line);
+		batch.add(LOGURU_FMT(s), buff);
+		const Text error_context = get_error_context();
+		if (!error_context.empty()) {
+			batch.add(LOGURU_FMT(s), error_context.c_str());
 		}
 	}
 
 #if LOGURU_USE_FMTLIB
-	void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, const char* format, fmt::format_args args)
+	void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, fmt::string_view format, fmt::format_args args)
+	{
+		FormattedText formatted(format, args);
+		log_to_everywhere(stack_trace_skip + 1, Verbosity_FATAL, file, line, expr, formatted.c_str());
+		abort(); // log_to_everywhere already does this, but this makes the analyzer happy.
+	}
+#elif LOGURU_USE_STD_FORMAT
+	void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, std::string_view format, std::format_args args)
 	{
-		auto formatted = fmt::vformat(format, args);
+		FormattedText formatted(format, args);
 		log_to_everywhere(stack_trace_skip + 1, Verbosity_FATAL, file, line, expr, formatted.c_str());
 		abort(); // log_to_everywhere already does this, but this makes the analyzer happy.
 	}
@@ -1635,17 +5899,27 @@ namespace loguru
 
 	void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line)
 	{
-		log_and_abort(stack_trace_skip + 1, expr, file, line, " ");
+		log_and_abort_plain(stack_trace_skip + 1, expr, file, line, " ");
+	}
+
+	void log_and_abort_plain(int stack_trace_skip, const char* expr, const char* file, unsigned line, const char* message)
+	{
+		log_to_everywhere(stack_trace_skip + 1, Verbosity_FATAL, file, line, expr, message);
+		abort(); // log_to_everywhere already does this, but this makes the analyzer happy.
 	}
 
 	// ----------------------------------------------------------------------------
 	// Streams:
 
-#if LOGURU_USE_FMTLIB
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
 	template<typename... Args>
 	std::string vstrprintf(const char* format, const Args&... args)
 	{
-		auto text = textprintf(format, args...);
+#if LOGURU_USE_FMTLIB
+		auto text = vtextprintf(format, fmt::make_format_args(args...));
+#else
+		auto text = vtextprintf(format, std::make_format_args(args...));
+#endif
 		std::string result = text.c_str();
 		return result;
 	}
@@ -1675,16 +5949,115 @@ namespace loguru
 
 	#if LOGURU_WITH_STREAMS
 
+	// Spilled LOG_S text above this is freed instead of kept for the next message.
+	static const size_t STREAM_SPILL_MAX_KEPT = 64 * 1024;
+
+	// Writes into a fixed buffer, and moves to a std::string only for messages that do not fit.
+	class LogStreamBuf : public std::streambuf
+	{
+	public:
+		LogStreamBuf() { reset(); }
+
+		void reset()
+		{
+			_spilled.clear();
+			if (_spilled.capacity() > STREAM_SPILL_MAX_KEPT) {
+				std::string().swap(_spilled);
+			}
+			// Keep the last byte for the zero terminator.
+			setp(_fixed, _fixed + sizeof(_fixed) - 1);
+		}
+
+		const char* c_str()
+		{
+			if (_spilled.empty()) {
+				*pptr() = '\0';
+				return _fixed;
+			}
+			_spilled.append(pbase(), pptr());
+			setp(_fixed, _fixed + sizeof(_fixed) - 1);
+			return _spilled.c_str();
+		}
+
+	protected:
+		// The fixed buffer is full: move its contents to _spilled and use it as a staging area.
+		int_type overflow(int_type c) override
+		{
+			_spilled.append(pbase(), pptr());
+			setp(_fixed, _fixed + sizeof(_fixed) - 1);
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				_spilled.push_back(traits_type::to_char_type(c));
+			}
+			return traits_type::not_eof(c);
+		}
+
+	private:
+		char        _fixed[LOGURU_STREAM_BUFFER_SIZE];
+		std::string _spilled;
+	};
+
+	class LogStream
+	{
+	public:
+		LogStream() : stream(&buf) {}
+
+		// Forget the text and any formatting state left behind by the previous message.
+		void reset()
+		{
+			buf.reset();
+			stream.clear();
+			stream.flags(std::ios_base::dec | std::ios_base::skipws);
+			stream.width(0);
+			stream.precision(6);
+			stream.fill(' ');
+		}
+
+		LogStreamBuf buf;
+		std::ostream stream;
+		bool         in_use = false;
+	};
+
+	LogStream* acquire_log_stream(std::ostream** out_stream)
+	{
+		LogStream*& thread_stream = thread_locals().log_stream;
+		if (thread_stream == nullptr) {
+			thread_stream = new LogStream();
+		}
+		// Nested LOG_S (e.g. inside an operator<<) gets a stream of its own.
+		LogStream* log_stream = thread_stream->in_use ? new LogStream() : thread_stream;
+		log_stream->in_use = true;
+		*out_stream = &log_stream->stream;
+		return log_stream;
+	}
+
+	void release_log_stream(LogStream* log_stream)
+	{
+		if (log_stream != thread_locals().log_stream) {
+			delete log_stream;
+			return;
+		}
+		log_stream->reset();
+		log_stream->in_use = false;
+	}
+
+	// Releases the stream even if a callback or the fatal handler throws.
+	struct LogStreamReleaser
+	{
+		LogStream* log_stream;
+		~LogStreamReleaser() { release_log_stream(log_stream); }
+	};
+
 	StreamLogger::~StreamLogger() noexcept(false)
 	{
-		auto message = _ss.str();
-		log(_verbosity, _file, _line, LOGURU_FMT(s), message.c_str());
+		LogStreamReleaser releaser{_log_stream};
+		log_to_everywhere(1, _verbosity, _file, _line, "", _log_stream->buf.c_str());
 	}
 
 	AbortLogger::~AbortLogger() noexcept(false)
 	{
-		auto message = _ss.str();
-		loguru::log_and_abort(1, _expr, _file, _line, LOGURU_FMT(s), message.c_str());
+		LogStreamReleaser releaser{_log_stream};
+		log_to_everywhere(1, Verbosity_FATAL, _file, _line, _expr, _log_stream->buf.c_str());
+		abort(); // log_to_everywhere already does this, but this makes the analyzer happy.
 	}
 
 	#endif // LOGURU_WITH_STREAMS
@@ -1709,46 +6082,86 @@ namespace loguru
 
 	// ----------------------------------------------------------------------------
 
-	using ECPtr = EcEntryBase*;
+	// Frees what ThreadLocals points to, when the thread exits.
+	// Leaves it empty, since the main thread may still log from an atexit handler afterwards.
+	static void release_thread_locals(ThreadLocals& locals)
+	{
+		delete locals.fields_text;
+		delete locals.hex_text;
+		delete locals.format_buffer;
+		delete locals.batch_lines;
+		delete locals.open_scopes;
+		trace_thread_exit(locals.trace_buffer);
+		scope_budgets_thread_exit(locals.scope_budgets);
+	#if LOGURU_WITH_STREAMS
+		delete locals.log_stream;
+	#endif
+		locals.fields_text_message = nullptr;
+		locals.fields_text       = nullptr;
+		locals.hex_text          = nullptr;
+		locals.format_buffer     = nullptr;
+		locals.batch_lines       = nullptr;
+		locals.open_scopes       = nullptr;
+		locals.trace_buffer      = nullptr;
+		locals.scope_budgets     = nullptr;
+		locals.log_stream        = nullptr;
+	}
 
 #if defined(_WIN32) || (defined(__APPLE__) && !TARGET_OS_IPHONE)
-	#ifdef __APPLE__
-		#define LOGURU_THREAD_LOCAL __thread
-	#else
-		#define LOGURU_THREAD_LOCAL thread_local
-	#endif
-	static LOGURU_THREAD_LOCAL ECPtr thread_ec_ptr = nullptr;
+	// thread_local rather than __thread, which cannot have a destructor.
+	struct ThreadLocalsOwner
+	{
+		ThreadLocals locals;
+		~ThreadLocalsOwner() { release_thread_locals(locals); }
+	};
+	static thread_local ThreadLocalsOwner s_thread_locals = {{nullptr, nullptr, nullptr, 0, 0, 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}};
 
-	ECPtr& get_thread_ec_head_ref()
+	ThreadLocals& thread_locals()
 	{
-		return thread_ec_ptr;
+		return s_thread_locals.locals;
 	}
 #else // !thread_local
-	static pthread_once_t s_ec_pthread_once = PTHREAD_ONCE_INIT;
-	static pthread_key_t  s_ec_pthread_key;
+	static pthread_once_t s_thread_locals_pthread_once = PTHREAD_ONCE_INIT;
+	static pthread_key_t  s_thread_locals_pthread_key;
 
-	void free_ec_head_ref(void* io_error_context)
+	void free_thread_locals(void* io_thread_locals)
 	{
-		delete reinterpret_cast<ECPtr*>(io_error_context);
+		ThreadLocals* locals = reinterpret_cast<ThreadLocals*>(io_thread_locals);
+		release_thread_locals(*locals);
+		delete locals;
 	}
 
-	void ec_make_pthread_key()
+	void thread_locals_make_pthread_key()
 	{
-		(void)pthread_key_create(&s_ec_pthread_key, free_ec_head_ref);
+		(void)pthread_key_create(&s_thread_locals_pthread_key, free_thread_locals);
 	}
 
-	ECPtr& get_thread_ec_head_ref()
+	ThreadLocals& thread_locals()
 	{
-		(void)pthread_once(&s_ec_pthread_once, ec_make_pthread_key);
-		auto ec = reinterpret_cast<ECPtr*>(pthread_getspecific(s_ec_pthread_key));
-		if (ec == nullptr) {
-			ec = new ECPtr(nullptr);
-			(void)pthread_setspecific(s_ec_pthread_key, ec);
+		(void)pthread_once(&s_thread_locals_pthread_once, thread_locals_make_pthread_key);
+		auto locals = reinterpret_cast<ThreadLocals*>(pthread_getspecific(s_thread_locals_pthread_key));
+		if (locals == nullptr) {
+			locals = new ThreadLocals{nullptr, nullptr, nullptr, 0, 0, 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+			(void)pthread_setspecific(s_thread_locals_pthread_key, locals);
 		}
-		return *ec;
+		return *locals;
 	}
 #endif // !thread_local
 
+#if LOGURU_INLINE_ERROR_CONTEXT
+	__thread EcEntryBase* g_thread_ec_head = nullptr;
+
+	EcEntryBase*& get_thread_ec_head_ref()
+	{
+		return g_thread_ec_head;
+	}
+#else
+	EcEntryBase*& get_thread_ec_head_ref()
+	{
+		return thread_locals().ec_head;
+	}
+#endif
+
 	// ----------------------------------------------------------------------------
 
 	EcHandle get_thread_ec_handle()
@@ -1761,7 +6174,8 @@ namespace loguru
 		return get_error_context_for(get_thread_ec_head_ref());
 	}
 
-	Text get_error_context_for(const EcEntryBase* ec_head)
+	// Without the values, this is safe to call for the entries of another thread, as long as they stay open.
+	static std::string error_context_as_stdstring(const EcEntryBase* ec_head, bool with_values)
 	{
 		std::vector<const EcEntryBase*> stack;
 		while (ec_head) {
@@ -1775,22 +6189,32 @@ namespace loguru
 			result.str += "------------------------------------------------\n";
 			for (auto entry : stack) {
 				const auto description = std::string(entry->_descr) + ":";
-#if LOGURU_USE_FMTLIB
-				auto prefix = textprintf("[ErrorContext] {.{}s}:{:-5u} {:-20s} ",
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
+				auto prefix = textprintf("[ErrorContext] {:>{}s}:{:<5d} {:<20s} ",
 					filename(entry->_file), LOGURU_FILENAME_WIDTH, entry->_line, description.c_str());
 #else
 				auto prefix = textprintf("[ErrorContext] %*s:%-5u %-20s ",
 					LOGURU_FILENAME_WIDTH, filename(entry->_file), entry->_line, description.c_str());
 #endif
 				result.str += prefix.c_str();
-				entry->print_value(result);
+				if (with_values) {
+					entry->print_value(result);
+				} else {
+					result.str.erase(result.str.find_last_not_of(' ') + 1);
+				}
 				result.str += "\n";
 			}
 			result.str += "------------------------------------------------";
 		}
-		return Text(STRDUP(result.str.c_str()));
+		return result.str;
+	}
+
+	Text get_error_context_for(const EcEntryBase* ec_head)
+	{
+		return Text(STRDUP(error_context_as_stdstring(ec_head, true).c_str()));
 	}
 
+#if !LOGURU_INLINE_ERROR_CONTEXT
 	EcEntryBase::EcEntryBase(const char* file, unsigned line, const char* descr)
 		: _file(file), _line(line), _descr(descr)
 	{
@@ -1803,6 +6227,34 @@ namespace loguru
 	{
 		get_thread_ec_head_ref() = _previous;
 	}
+#endif // !LOGURU_INLINE_ERROR_CONTEXT
+
+	// ------------------------------------------------------------------------
+
+	void ContextScope::push()
+	{
+		const ContextScope*& context_head = thread_locals().context_head;
+		_previous = context_head;
+		context_head = this;
+	}
+
+	ContextScope::~ContextScope()
+	{
+		thread_locals().context_head = _previous;
+	}
+
+	void ContextScope::store_string()
+	{
+		const size_t length = std::min<size_t>(static_cast<size_t>(_field.string_length), sizeof(_string_storage));
+		memcpy(_string_storage, _field.string_value, length);
+		_field.string_value = _string_storage;
+		_field.string_length = length;
+	}
+
+	const ContextScope* get_thread_context()
+	{
+		return thread_locals().context_head;
+	}
 
 	// ------------------------------------------------------------------------
 
@@ -1962,6 +6414,15 @@ namespace loguru
 			write_to_stderr(terminal_reset());
 		}
 
+		// The ring buffer is preallocated and lock-free, so this is safe too:
+		ring_consume([](const RingRecord& record) {
+			if (record.verbosity > g_stderr_verbosity) {
+				write_to_stderr(record.preamble);
+				write_to_stderr(record.text);
+				write_to_stderr("\n");
+			}
+		});
+
 		// --------------------------------------------------------------------
 
 		if (s_signal_options.unsafe_signal_handler) {
@@ -1974,7 +6435,7 @@ namespace loguru
 			flush();
 			char preamble_buff[LOGURU_PREAMBLE_WIDTH];
 			print_preamble(preamble_buff, sizeof(preamble_buff), Verbosity_FATAL, "", 0);
-			auto message = Message{Verbosity_FATAL, "", 0, preamble_buff, "", "Signal: ", signal_name};
+			auto message = Message{Verbosity_FATAL, "", 0, preamble_buff, "", "Signal: ", signal_name, 0, nullptr, 0, nullptr};
 			try {
 				log_message(1, message, false, false);
 			} catch (...) {
@@ -121,6 +121,38 @@ Website: www.ilikebigbits.com
 	#define LOGURU_SCOPE_TEXT_SIZE 196
 #endif
 
+#ifndef LOGURU_SCOPE_PROFILE_MAX_CALLSITES
+	// How many LOG_SCOPE_F callsites the scope profiler keeps statistics for (see set_scope_profiling).
+	// Scopes at further callsites are not profiled.
+	#define LOGURU_SCOPE_PROFILE_MAX_CALLSITES 1024
+#endif
+
+#ifndef LOGURU_CONTEXT_VALUE_SIZE
+	// Maximum length of a string value stored by a loguru::ContextScope.
+	#define LOGURU_CONTEXT_VALUE_SIZE 64
+#endif
+
+#ifndef LOGURU_RING_TEXT_SIZE
+	// Maximum length of a message kept by loguru::set_ring_buffer (longer ones are truncated).
+	#define LOGURU_RING_TEXT_SIZE 256
+#endif
+
+#ifndef LOGURU_STD_FORMAT_BUFFER_SIZE
+	// With LOGURU_USE_STD_FORMAT: messages up to this long are formatted into a per-thread buffer,
+	// longer ones into a std::string.
+	#define LOGURU_STD_FORMAT_BUFFER_SIZE 2048
+#endif
+
+#ifndef LOGURU_STREAM_BUFFER_SIZE
+	// LOG_S messages up to this long are written into a per-thread buffer, longer ones into a std::string.
+	#define LOGURU_STREAM_BUFFER_SIZE 1024
+#endif
+
+#ifndef LOGURU_HEX_DUMP_MAX_BYTES
+	// LOG_HEX dumps at most this many bytes, and says how many more there were.
+	#define LOGURU_HEX_DUMP_MAX_BYTES 4096
+#endif
+
 #ifndef LOGURU_FILENAME_WIDTH
 	// Width of the column containing the file name
 	#define LOGURU_FILENAME_WIDTH 23
@@ -175,6 +207,15 @@ Website: www.ilikebigbits.com
 	#define LOGURU_USE_FMTLIB 0
 #endif
 
+#ifndef LOGURU_USE_STD_FORMAT
+	// Use C++20 std::format instead of printf-style format strings.
+	#define LOGURU_USE_STD_FORMAT 0
+#endif
+
+#if LOGURU_USE_FMTLIB && LOGURU_USE_STD_FORMAT
+	#error "Define at most one of LOGURU_USE_FMTLIB and LOGURU_USE_STD_FORMAT"
+#endif
+
 #ifndef LOGURU_USE_LOCALE
         #define LOGURU_USE_LOCALE 0
 #endif
@@ -183,6 +224,16 @@ Website: www.ilikebigbits.com
 	#define LOGURU_WITH_FILEABS 0
 #endif
 
+#ifndef LOGURU_INLINE_ERROR_CONTEXT
+	// Keep the ERROR_CONTEXT chain in a native thread-local variable, so that an ERROR_CONTEXT is
+	// pushed and popped inline instead of through a pthread key lookup.
+	#if defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+		#define LOGURU_INLINE_ERROR_CONTEXT 1
+	#else
+		#define LOGURU_INLINE_ERROR_CONTEXT 0
+	#endif
+#endif
+
 #ifndef LOGURU_RTTI
 #if defined(__clang__)
 	#if __has_feature(cxx_rtti)
@@ -250,6 +301,19 @@ Website: www.ilikebigbits.com
 #if LOGURU_USE_FMTLIB
 	#include <fmt/format.h>
 	#define LOGURU_FMT(x) "{:" #x "}"
+	#if FMT_VERSION >= 80000
+		// Checked against the arguments at compile time: always with C++20, and with FMT_STRING("...") before that.
+		// Use fmt::runtime(str) for a format string that is not known at compile time.
+		#define LOGURU_FMT_FORMAT_STRING(Args) fmt::format_string<Args...>
+		#define LOGURU_FMT_FORMAT_STRING_NO_ARGS fmt::format_string<>
+	#else
+		#define LOGURU_FMT_FORMAT_STRING(Args) LOGURU_FORMAT_STRING_TYPE
+		#define LOGURU_FMT_FORMAT_STRING_NO_ARGS LOGURU_FORMAT_STRING_TYPE
+	#endif
+#elif LOGURU_USE_STD_FORMAT
+	#include <format>
+	#include <string_view>
+	#define LOGURU_FMT(x) "{:" #x "}"
 #else
 	#define LOGURU_FMT(x) "%" #x
 #endif
@@ -299,13 +363,22 @@ namespace loguru
 	// Like printf, but returns the formated text.
 #if LOGURU_USE_FMTLIB
 	LOGURU_EXPORT
-	Text vtextprintf(const char* format, fmt::format_args args);
+	Text vtextprintf(fmt::string_view format, fmt::format_args args);
 
 	template<typename... Args>
 	LOGURU_EXPORT
-	Text textprintf(LOGURU_FORMAT_STRING_TYPE format, const Args&... args) {
+	Text textprintf(LOGURU_FMT_FORMAT_STRING(Args) format, const Args&... args) {
 		return vtextprintf(format, fmt::make_format_args(args...));
 	}
+#elif LOGURU_USE_STD_FORMAT
+	LOGURU_EXPORT
+	Text vtextprintf(std::string_view format, std::format_args args);
+
+	template<typename... Args>
+	LOGURU_EXPORT
+	Text textprintf(std::format_string<Args...> format, const Args&... args) {
+		return vtextprintf(format.get(), std::make_format_args(args...));
+	}
 #else
 	LOGURU_EXPORT
 	Text textprintf(LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(1, 2);
@@ -357,6 +430,33 @@ namespace loguru
 		Verbosity_MAX     = +9,
 	};
 
+	enum FieldType : unsigned char
+	{
+		FieldType_Int,
+		FieldType_Double,
+		FieldType_Bool,
+		FieldType_String,
+		FieldType_Unsigned, // unsigned long (long), which may not fit in int_value.
+	};
+
+	// A typed key-value pair attached to a Message by LOG_KV. Never formatted unless a text sink asks for it.
+	struct Field
+	{
+		const char* key;
+		FieldType   type;
+		union
+		{
+			long long          int_value;
+			unsigned long long unsigned_value;
+			double             double_value;
+			bool               bool_value;
+			const char*        string_value; // NOT zero-terminated, see string_length.
+		};
+		unsigned long long string_length;
+	};
+
+	class ContextScope;
+
 	struct Message
 	{
 		// You would generally print a Message by just concatenating the buffers without spacing.
@@ -368,6 +468,10 @@ namespace loguru
 		const char* indentation; // Just a bunch of spacing.
 		const char* prefix;      // Assertion failure info goes here (or "").
 		const char* message;     // User message goes here.
+		unsigned    depth;       // Scope depth, i.e. the number of steps in `indentation`.
+		const Field* fields;     // Key-value pairs from LOG_KV, or nullptr.
+		unsigned    num_fields;  // Number of elements in `fields`.
+		const ContextScope* context; // Innermost ContextScope of the logging thread, or nullptr.
 	};
 
 	/* Everything with a verbosity equal or greater than g_stderr_verbosity will be
@@ -400,6 +504,9 @@ namespace loguru
 	typedef void (*close_handler_t)(void* user_data);
 	typedef void (*flush_handler_t)(void* user_data);
 
+	// Identifies a callback, see add_callback. Never 0 for a valid callback.
+	typedef int SinkHandle;
+
 	// May throw if that's how you'd like to handle your errors.
 	typedef void (*fatal_handler_t)(const Message& message);
 
@@ -501,6 +608,8 @@ namespace loguru
 	void init(int& argc, char* argv[], const Options& options = {});
 
 	// Will call remove_all_callbacks(). After calling this, logging will still go to stderr.
+	// Also stops the threads for periodic flushing, set_scope_profiling and set_scope_watchdog
+	// (call those again to restart them; flushing restarts on its own).
 	// You generally don't need to call this.
 	LOGURU_EXPORT
 	void shutdown();
@@ -559,6 +668,28 @@ namespace loguru
 	LOGURU_EXPORT
 	bool add_file(const char* path, FileMode mode, Verbosity verbosity);
 
+	/*  Will log to a file at the given path as JSON Lines (http://jsonlines.org),
+		one object per message, e.g.:
+			{"time":"2026-10-18T12:34:56.789Z","uptime":1.234,"verbosity":0,"level":"INFO",
+			 "thread":"main thread","file":"main.cpp","line":42,"depth":1,"message":"Hello"}
+		Key-value pairs from LOG_KV are added as a "fields" object, with their types intact.
+		The time is in UTC. Everything else works like add_file,
+		including removing it with loguru::remove_callback(path).
+	*/
+	LOGURU_EXPORT
+	bool add_json_file(const char* path, FileMode mode, Verbosity verbosity);
+
+	/*  Will write a trace in the Chrome trace event format to the given path, for chrome://tracing
+		or https://ui.perfetto.dev. Each LOG_SCOPE_F at or below the given verbosity becomes a complete
+		("X") event on its thread's track, with the nanosecond timestamps of the scope, and each log
+		message becomes an instant ("i") event. Events are buffered per thread, and written out when a
+		buffer fills up, on loguru::flush(), and when the thread exits.
+		Only one trace file can be written at a time. The file is truncated if it exists.
+		To stop, and finish the file, call loguru::remove_callback(path) with the same path.
+	*/
+	LOGURU_EXPORT
+	bool add_trace_file(const char* path, Verbosity verbosity);
+
 	LOGURU_EXPORT
 	// Send logs to syslog with LOG_USER facility (see next call)
 	bool add_syslog(const char* app_name, Verbosity verbosity);
@@ -567,6 +698,158 @@ namespace loguru
 	// see loguru.cpp: syslog_log() for more details.
 	bool add_syslog(const char* app_name, Verbosity verbosity, int facility);
 
+	/*  Send logs straight to the syslog daemon over its AF_UNIX datagram socket, bypassing libc syslog().
+		Messages are formatted per RFC 5424, with the time in UTC, and sent in batches
+		(with sendmmsg on Linux) by a background thread, so logging never waits for the daemon.
+		If more than a few thousand messages are waiting to be sent, new ones are dropped (except FATAL),
+		and so are those being sent if the daemon makes no room for them within a second.
+		Drops are reported to syslog once it catches up, and counted by get_callback_drop_count(socket_path).
+		facility is e.g. LOG_USER or LOG_LOCAL0. app_name defaults to argv0_filename() if nullptr.
+		To stop, call loguru::remove_callback(socket_path) with the same path.
+	*/
+	LOGURU_EXPORT
+	bool add_syslog_socket(const char* app_name, Verbosity verbosity, int facility, const char* socket_path = "/dev/log");
+
+	/*  Send logs to journald with its native protocol, without linking libsystemd.
+		Each message becomes a journal entry with MESSAGE, PRIORITY, CODE_FILE, CODE_LINE, TID,
+		LOGURU_VERBOSITY, LOGURU_THREAD and SYSLOG_IDENTIFIER fields,
+		plus one field per LOG_KV pair, with the key in uppercase.
+		To stop, call loguru::remove_callback(socket_path) with the same path.
+		Only available on Linux.
+	*/
+	LOGURU_EXPORT
+	bool add_journald(Verbosity verbosity, const char* socket_path = "/run/systemd/journal/socket");
+
+	/*  Will stream messages to a collector at the given url, "tcp://host:port" or "udp://host:port".
+		Each message is sent as a record: a 32-bit big-endian length followed by the line as add_file
+		would write it, without the newline. Records are queued in memory (new ones are dropped if
+		several megabytes are waiting) and sent in batches by a background thread: one send per batch
+		over TCP, one datagram of whole records per batch over UDP.
+		When the collector can't be reached, batches are appended to the spool file at spool_path
+		(or dropped, if spool_path is nullptr) and replayed in order once it can be reached again.
+		A spool file left over from a previous run is replayed too.
+		To stop, call loguru::remove_callback(url) with the same url.
+		Only available on POSIX systems.
+	*/
+	LOGURU_EXPORT
+	bool add_network_sink(const char* url, Verbosity verbosity, const char* spool_path);
+
+	/*  Will start `command` with /bin/sh and write messages to its stdin, as add_file would write them.
+		Use it to compress or ship logs on the fly, e.g. add_pipe_sink("zstd -q -o app.log.zst", ...).
+		Lines are written by a background thread through a large pipe buffer, so logging never waits for
+		the command. If several megabytes are waiting, or the command has exited, lines are dropped.
+		To stop, call loguru::remove_callback(command) with the same command; this closes its stdin
+		and waits for it to exit. After two seconds, the rest of the lines are dropped and it is killed.
+		Only available on POSIX systems.
+	*/
+	LOGURU_EXPORT
+	bool add_pipe_sink(const char* command, Verbosity verbosity);
+
+	/*  Will publish messages into a POSIX shared-memory ring (shm_open + mmap) with the given name,
+		e.g. "/my_service_log", for an out-of-process collector to format and write to disk.
+		See loguru_shm_reader/ for a reference collector, and ShmReader below for writing your own.
+		The ring is created with size_bytes (rounded up to a power of two) unless it already exists.
+		Any number of threads and processes can publish into the same ring without locking each other.
+		If the ring is full the message is dropped and counted (see ShmReader::num_dropped).
+		To stop publishing, call loguru::remove_callback(name) with the same name.
+		The ring is never removed by loguru; use shm_unlink(name) for that.
+		Only available on POSIX systems; returns false elsewhere.
+	*/
+	LOGURU_EXPORT
+	bool add_shm_sink(const char* name, unsigned long long size_bytes, Verbosity verbosity);
+
+	// A message read from a shared-memory ring by ShmReader.
+	struct ShmRecord
+	{
+		Verbosity   verbosity;
+		unsigned    line;
+		unsigned    depth;       // Scope depth, for indentation.
+		long long   time_us;     // Microseconds since the Unix epoch.
+		long long   pid;         // Id of the process that logged it.
+		const char* program;     // argv0_filename() of that process.
+		const char* thread_name;
+		const char* file;
+		const char* message;     // Prefix, message and LOG_KV fields, but no preamble or indentation.
+	};
+
+	// Reads the messages published with add_shm_sink. There should only be one reader per ring.
+	class LOGURU_EXPORT ShmReader
+	{
+	public:
+		ShmReader();
+		~ShmReader();
+
+		ShmReader(const ShmReader&) = delete;
+		ShmReader& operator=(const ShmReader&) = delete;
+
+		// Attach to the named ring, creating it with size_bytes if it does not exist yet.
+		bool open(const char* name, unsigned long long size_bytes);
+		void close();
+
+		// Returns false if there is no complete message to read.
+		// The strings in the record are valid until the next call to read.
+		bool read(ShmRecord* out_record);
+
+		// A message that stays unpublished for this long (e.g. because its writer crashed)
+		// is skipped so that read can move on. Its space is only reused once the writer
+		// publishes it after all or its process is gone. Default: 1000 ms.
+		void set_stall_timeout(unsigned timeout_ms);
+
+		// Number of messages the writers had to drop because the ring was full.
+		unsigned long long num_dropped() const;
+
+		// Number of unpublished messages skipped after the stall timeout.
+		unsigned long long num_skipped() const;
+
+	private:
+		// Frees the space of skipped messages whose writers are done with them.
+		void release_held();
+
+		static const unsigned MAX_HELD = 16; // Skipped messages we keep the space of; read waits beyond this.
+
+		void*              _memory;
+		unsigned long long _mapped_size;
+		char*              _buffer;
+		unsigned long long _buffer_size;
+		unsigned           _stall_timeout_ms;
+		unsigned long long _read_pos;         // Next message to read. read_pos in the ring stays on the first held one.
+		unsigned long long _stalled_pos;      // _read_pos we are waiting on, or ~0.
+		long long          _stalled_since_ms;
+		unsigned long long _held[MAX_HELD];   // Skipped messages that are still reserved, oldest first.
+		unsigned           _num_held;
+		unsigned long long _num_skipped;
+	};
+
+	/*  Keep the last `num_messages` messages with a verbosity less or equal to `verbosity`
+		in a preallocated in-memory ring, without writing them anywhere or taking any lock.
+		When an ERROR or FATAL is logged, the ring is first written to every output that didn't
+		already get those messages, oldest first, so you get the verbose lead-up to the problem.
+		On a signal they are written to stderr with plain write() calls before anything else.
+		Messages longer than LOGURU_RING_TEXT_SIZE are truncated.
+		Call this early, before other threads start logging. num_messages = 0 turns it off.
+
+		Example: keep the last 1000 messages of verbosity 9 or less, but only write INFO to stderr:
+			loguru::set_ring_buffer(1000, loguru::Verbosity_MAX);
+	*/
+	LOGURU_EXPORT
+	void set_ring_buffer(unsigned num_messages, Verbosity verbosity);
+
+	/*  Stop logging from ever blocking on a stderr that is not being read, e.g. a pipe to
+		a stalled supervisor. stderr is then written through a separate non-blocking file descriptor.
+		Lines it won't take are kept in a buffer of at most buffer_size bytes, written out as soon
+		as possible by a background thread. When the buffer is full, the new line is dropped,
+		unless buffered lines that are more verbose can be dropped to make room for it.
+		The number of dropped lines is written to stderr at most every report_interval_ms.
+		Lines still in the buffer when the process is aborted are lost.
+		Only available on POSIX systems. buffer_size = 0 turns it off.
+	*/
+	LOGURU_EXPORT
+	bool set_stderr_nonblocking(unsigned long long buffer_size, unsigned report_interval_ms = 1000);
+
+	// Total number of lines set_stderr_nonblocking has dropped.
+	LOGURU_EXPORT
+	unsigned long long stderr_lines_dropped();
+
 	/*  Will be called right before abort().
 		You can for instance use this to print custom error messages, or throw an exception.
 		Feel free to call LOG:ing function from this, but not FATAL ones! */
@@ -580,9 +863,10 @@ namespace loguru
 	/*  Will be called on each log messages with a verbosity less or equal to the given one.
 		Useful for displaying messages on-screen in a game, for example.
 		The given on_close is also expected to flush (if desired).
+		Returns a handle for remove_sink, cheaper than looking the callback up by id.
 	*/
 	LOGURU_EXPORT
-	void add_callback(
+	SinkHandle add_callback(
 		const char*     id,
 		log_handler_t   callback,
 		void*           user_data,
@@ -613,10 +897,74 @@ namespace loguru
 	LOGURU_EXPORT
 	Verbosity get_verbosity_from_name(const char* name);
 
+	// What an asynchronous callback does when its queue is full. See set_callback_async.
+	enum QueuePolicy
+	{
+		QueuePolicy_Block,             // Wait until there is room. Nothing is lost, unless one LogBatch (or the callback itself) logs more than max_queued messages at once.
+		QueuePolicy_DropNewest,        // Drop the message being logged.
+		QueuePolicy_DropOldest,        // Drop the oldest queued message.
+		QueuePolicy_DropBelowSeverity, // Drop messages more verbose than drop_verbosity, new or queued. Wait for the rest.
+		QueuePolicy_SpillToDisk,       // Write the overflow to spill_path, to be delivered in order later.
+	};
+
+	struct AsyncOptions
+	{
+		// How many messages can wait for the callback.
+		unsigned max_queued = 1024;
+
+		QueuePolicy policy = QueuePolicy_DropNewest;
+
+		// Messages at least this severe get their own lane, which the worker drains first,
+		// so they do not wait behind a backlog and are neither dropped nor spilled (within the same limit as QueuePolicy_Block).
+		// Verbosity_INVALID disables the lane.
+		Verbosity priority_verbosity = Verbosity_ERROR;
+
+		// For QueuePolicy_DropBelowSeverity.
+		Verbosity drop_verbosity = Verbosity_WARNING;
+
+		// For QueuePolicy_SpillToDisk.
+		const char* spill_path = nullptr;
+	};
+
+	/*  Give the callback with the given id (e.g. the path given to add_file) its own queue and
+		worker thread, so that a slow callback does not slow down logging or the other callbacks.
+		Messages are copied into the queue, and the callback and its flush handler are then only
+		called from the worker, in order. Its preamble still has the time and thread of the logging call.
+		When the queue is full, options.policy decides what happens. A logging call (or LogBatch) that
+		has to wait for room does so after Loguru's lock is released, so other threads can keep logging.
+		The worker itself never waits: what its callback logs is queued behind the full queue.
+		A FATAL message, with its stack trace and error context, is instead handed to the callback
+		directly by the logging thread (unless the worker is stuck in it), after which the worker is
+		given a moment to catch up before abort().
+		Returns false if there is no such callback.
+	*/
+	LOGURU_EXPORT
+	bool set_callback_async(const char* id, const AsyncOptions& options = {});
+
+	// Number of messages an asynchronous callback, or an add_syslog_socket sink, has dropped because its queue was full.
+	LOGURU_EXPORT
+	unsigned long long get_callback_drop_count(const char* id);
+
 	// Returns true iff the callback was found (and removed).
 	LOGURU_EXPORT
 	bool remove_callback(const char* id);
 
+	// Returns true iff the callback was found (and removed).
+	LOGURU_EXPORT
+	bool remove_sink(SinkHandle handle);
+
+	// The handle of the callback with the given id (e.g. the path given to add_file), or 0 if there is none.
+	LOGURU_EXPORT
+	SinkHandle get_sink_handle(const char* id);
+
+	/*  Change which messages a callback gets, without removing and re-adding it
+		(which for add_file would close and reopen the file). Scopes that are already open
+		are indented correctly in the callback from then on, since indentation is worked out
+		per message from the scopes open on the logging thread. Returns false if there is no such callback.
+	*/
+	LOGURU_EXPORT
+	bool set_sink_verbosity(SinkHandle handle, Verbosity verbosity);
+
 	// Shut down all file logging and any other callback hooks installed.
 	LOGURU_EXPORT
 	void remove_all_callbacks();
@@ -628,23 +976,44 @@ namespace loguru
 #if LOGURU_USE_FMTLIB
 	// Internal functions
     LOGURU_EXPORT
-	void vlog(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, fmt::format_args args);
+	void vlog(Verbosity verbosity, const char* file, unsigned line, fmt::string_view format, fmt::format_args args);
     LOGURU_EXPORT
-	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, fmt::format_args args);
+	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, fmt::string_view format, fmt::format_args args);
 
 	// Actual logging function. Use the LOG macro instead of calling this directly.
 	template <typename... Args>
 	LOGURU_EXPORT
-	void log(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, const Args &... args) {
+	void log(Verbosity verbosity, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING(Args) format, const Args &... args) {
 	    vlog(verbosity, file, line, format, fmt::make_format_args(args...));
 	}
 
 	// Log without any preamble or indentation.
 	template <typename... Args>
 	LOGURU_EXPORT
-	void raw_log(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, const Args &... args) {
+	void raw_log(Verbosity verbosity, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING(Args) format, const Args &... args) {
 	    raw_vlog(verbosity, file, line, format, fmt::make_format_args(args...));
 	}
+#elif LOGURU_USE_STD_FORMAT
+	// Internal functions
+	LOGURU_EXPORT
+	void vlog(Verbosity verbosity, const char* file, unsigned line, std::string_view format, std::format_args args);
+	LOGURU_EXPORT
+	void raw_vlog(Verbosity verbosity, const char* file, unsigned line, std::string_view format, std::format_args args);
+
+	// Actual logging function. Use the LOG macro instead of calling this directly.
+	// The format string is checked against the arguments at compile time.
+	template <typename... Args>
+	LOGURU_EXPORT
+	void log(Verbosity verbosity, const char* file, unsigned line, std::format_string<Args...> format, const Args &... args) {
+		vlog(verbosity, file, line, format.get(), std::make_format_args(args...));
+	}
+
+	// Log without any preamble or indentation.
+	template <typename... Args>
+	LOGURU_EXPORT
+	void raw_log(Verbosity verbosity, const char* file, unsigned line, std::format_string<Args...> format, const Args &... args) {
+		raw_vlog(verbosity, file, line, format.get(), std::make_format_args(args...));
+	}
 #else // LOGURU_USE_FMTLIB?
 	// Actual logging function. Use the LOG macro instead of calling this directly.
 	LOGURU_EXPORT
@@ -659,6 +1028,310 @@ namespace loguru
 	void raw_log(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(4, 5);
 #endif // !LOGURU_USE_FMTLIB
 
+	// True if there is nothing in the message for the formatter to do, e.g. "Connection closed".
+	// For a string literal the compiler can work this out at compile time.
+	inline bool is_plain_message(const char* message)
+	{
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
+		const char* const special = "{}";
+#else
+		const char* const special = "%";
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+		// Folded to a constant for string literals when optimizing.
+		return __builtin_strpbrk(message, special) == nullptr;
+#else
+		for (; *message != '\0'; ++message) {
+			for (const char* c = special; *c != '\0'; ++c) {
+				if (*message == *c) { return false; }
+			}
+		}
+		return true;
+#endif
+	}
+
+	// Log a message as-is, without formatting or allocating.
+	// LOG_F uses this for plain messages given without arguments.
+	LOGURU_EXPORT
+	void log_plain(Verbosity verbosity, const char* file, unsigned line, const char* message);
+
+	// Like log_plain, but without any preamble or indentation.
+	LOGURU_EXPORT
+	void raw_log_plain(Verbosity verbosity, const char* file, unsigned line, const char* message);
+
+	// LOG_F and RAW_LOG_F given only a message. It is evaluated once, and logged as-is if there is
+	// nothing to format. With printf-style formatting these are never given any arguments: the `...`
+	// is there so that the compiler checks the message like any other format string. With fmt and
+	// std::format, the message is a format string for no arguments, checked the same way.
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
+	inline const char* format_string_data(const char* format) { return format; }
+	#if LOGURU_USE_FMTLIB && FMT_VERSION >= 80000
+	inline const char* format_string_data(fmt::format_string<> format) { return fmt::string_view(format).data(); }
+	#elif LOGURU_USE_STD_FORMAT
+	inline const char* format_string_data(std::format_string<> format) { return format.get().data(); }
+	#endif
+
+	#if LOGURU_USE_FMTLIB
+	inline void log_one(Verbosity verbosity, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING_NO_ARGS format)
+	#else
+	inline void log_one(Verbosity verbosity, const char* file, unsigned line, std::format_string<> format)
+	#endif
+	{
+		const char* message = format_string_data(format);
+		if (is_plain_message(message)) {
+			log_plain(verbosity, file, line, message);
+		} else {
+	#if LOGURU_USE_FMTLIB
+			vlog(verbosity, file, line, message, fmt::format_args());
+	#else
+			vlog(verbosity, file, line, message, std::format_args());
+	#endif
+		}
+	}
+
+	#if LOGURU_USE_FMTLIB
+	inline void raw_log_one(Verbosity verbosity, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING_NO_ARGS format)
+	#else
+	inline void raw_log_one(Verbosity verbosity, const char* file, unsigned line, std::format_string<> format)
+	#endif
+	{
+		const char* message = format_string_data(format);
+		if (is_plain_message(message)) {
+			raw_log_plain(verbosity, file, line, message);
+		} else {
+	#if LOGURU_USE_FMTLIB
+			raw_vlog(verbosity, file, line, message, fmt::format_args());
+	#else
+			raw_vlog(verbosity, file, line, message, std::format_args());
+	#endif
+		}
+	}
+#else
+	inline void log_one(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(4, 5);
+	inline void log_one(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+	{
+		if (is_plain_message(format)) {
+			log_plain(verbosity, file, line, format);
+		} else {
+			log(verbosity, file, line, format);
+		}
+	}
+
+	inline void raw_log_one(Verbosity verbosity, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(4, 5);
+	inline void raw_log_one(Verbosity verbosity, const char* file, unsigned line, const char* format, ...)
+	{
+		if (is_plain_message(format)) {
+			raw_log_plain(verbosity, file, line, format);
+		} else {
+			raw_log(verbosity, file, line, format);
+		}
+	}
+#endif
+
+	// Log a message (used as-is, without formatting) with key-value pairs. Use the LOG_KV macro instead of calling this directly.
+	LOGURU_EXPORT
+	void log_fields(Verbosity verbosity, const char* file, unsigned line, const char* message, const Field* fields, unsigned num_fields);
+
+	// Log a hex dump of `size` bytes at `data`. Use the LOG_HEX macro instead of calling this directly.
+	LOGURU_EXPORT
+	void log_hex(Verbosity verbosity, const char* file, unsigned line, const void* data, unsigned long long size, const char* description);
+
+	// Renders the fields as " key=value" pairs (each with a leading space). Useful in custom text callbacks.
+	LOGURU_EXPORT
+	Text fields_as_text(const Field* fields, unsigned num_fields);
+
+	inline Field make_field(const char* key, long long value)
+	{
+		Field field;
+		field.key = key;
+		field.type = FieldType_Int;
+		field.int_value = value;
+		field.string_length = 0;
+		return field;
+	}
+
+	inline Field make_field(const char* key, int value)                { return make_field(key, static_cast<long long>(value)); }
+	inline Field make_field(const char* key, unsigned int value)       { return make_field(key, static_cast<long long>(value)); }
+	inline Field make_field(const char* key, long value)               { return make_field(key, static_cast<long long>(value)); }
+
+	inline Field make_field(const char* key, unsigned long long value)
+	{
+		Field field;
+		field.key = key;
+		field.type = FieldType_Unsigned;
+		field.unsigned_value = value;
+		field.string_length = 0;
+		return field;
+	}
+
+	inline Field make_field(const char* key, unsigned long value) { return make_field(key, static_cast<unsigned long long>(value)); }
+
+	inline Field make_field(const char* key, double value)
+	{
+		Field field;
+		field.key = key;
+		field.type = FieldType_Double;
+		field.double_value = value;
+		field.string_length = 0;
+		return field;
+	}
+
+	inline Field make_field(const char* key, bool value)
+	{
+		Field field;
+		field.key = key;
+		field.type = FieldType_Bool;
+		field.bool_value = value;
+		field.string_length = 0;
+		return field;
+	}
+
+	inline Field make_field(const char* key, const char* value, unsigned long long length)
+	{
+		Field field;
+		field.key = key;
+		field.type = FieldType_String;
+		field.string_value = value;
+		field.string_length = length;
+		return field;
+	}
+
+	inline Field make_field(const char* key, const char* value)
+	{
+		unsigned long long length = 0;
+		while (value[length] != '\0') { ++length; }
+		return make_field(key, value, length);
+	}
+
+	// Anything with data() and size(), e.g. std::string and std::string_view.
+	template<typename String>
+	inline auto make_field(const char* key, const String& value) -> decltype(value.data(), value.size(), Field())
+	{
+		return make_field(key, value.data(), static_cast<unsigned long long>(value.size()));
+	}
+
+	inline void fill_fields(Field*) {}
+
+	template<typename T, typename... Rest>
+	inline void fill_fields(Field* out, const char* key, const T& value, const Rest&... rest)
+	{
+		*out = make_field(key, value);
+		fill_fields(out + 1, rest...);
+	}
+
+	template<typename... Args>
+	inline void log_kv(Verbosity verbosity, const char* file, unsigned line, const char* message, const Args&... args)
+	{
+		static_assert(sizeof...(Args) % 2 == 0, "LOG_KV expects a message followed by key-value pairs");
+		Field fields[sizeof...(Args) / 2 + 1]; // +1 to avoid a zero-sized array.
+		fill_fields(fields, args...);
+		log_fields(verbosity, file, line, message, fields, sizeof...(Args) / 2);
+	}
+
+	/*  A key-value pair attached to every message logged by this thread while the scope is alive,
+		e.g. to tag everything done for a request with its id:
+
+			void handle(const Request& request)
+			{
+				loguru::ContextScope request_context("req", request.id);
+				loguru::ContextScope tenant_context("tenant", request.tenant);
+				LOG_F(INFO, "Handling request"); // ... | Handling request req=1234 tenant=acme
+			}
+
+		Logging only captures a pointer to the innermost scope (Message::context).
+		Text outputs render the chain as " key=value" after the message, the JSON sink as a "context" object.
+		String values are copied (truncated to LOGURU_CONTEXT_VALUE_SIZE), so temporaries are fine.
+	*/
+	class LOGURU_EXPORT ContextScope
+	{
+	public:
+		template<typename T>
+		ContextScope(const char* key, const T& value) : _field(make_field(key, value))
+		{
+			if (_field.type == FieldType_String) {
+				store_string();
+			}
+			push();
+		}
+		~ContextScope();
+		ContextScope(const ContextScope&) = delete;
+		ContextScope(ContextScope&&) = delete;
+		ContextScope& operator=(const ContextScope&) = delete;
+		ContextScope& operator=(ContextScope&&) = delete;
+
+		const Field& field() const { return _field; }
+
+		// The enclosing scope on the same thread, or nullptr.
+		const ContextScope* previous() const { return _previous; }
+
+	private:
+		void push();
+		void store_string();
+
+		Field               _field;
+		const ContextScope* _previous;
+		char                _string_storage[LOGURU_CONTEXT_VALUE_SIZE];
+	};
+
+	// The innermost ContextScope of the calling thread, or nullptr.
+	LOGURU_EXPORT
+	const ContextScope* get_thread_context();
+
+	// Renders the context chain as " key=value" pairs, outermost first. Useful in custom text callbacks.
+	LOGURU_EXPORT
+	Text context_as_text(const ContextScope* context);
+
+	struct ScopeProfilingOptions
+	{
+		// Time every LOG_SCOPE_F at or below this verbosity, even ones that are not logged,
+		// and keep a latency histogram for each callsite (file and line). Verbosity_OFF disables profiling.
+		Verbosity verbosity = Verbosity_OFF;
+
+		// If false, profiled scopes write no "{ name" and "} 0.123 s: name" lines, so they only cost
+		// two clock reads and a few atomic increments.
+		bool log_scopes = true;
+
+		// If non-zero, log the statistics (see ScopeStats) this often.
+		unsigned report_interval_ms = 0;
+		Verbosity report_verbosity = Verbosity_INFO;
+	};
+
+	// Turn the scope profiler on or off. Statistics already collected are kept (see reset_scope_stats).
+	LOGURU_EXPORT
+	void set_scope_profiling(const ScopeProfilingOptions& options);
+
+	// Scopes above this verbosity are neither logged nor profiled.
+	LOGURU_EXPORT
+	Verbosity current_scope_verbosity_cutoff();
+
+	// Latencies of the profiled scopes at one callsite.
+	// Percentiles are upper bounds, at most about 6% above the true value.
+	struct ScopeStats
+	{
+		const char*        file;
+		unsigned           line;
+		const char*        name; // The format string of the scope.
+		unsigned long long count;
+		long long          p50_ns;
+		long long          p99_ns;
+		long long          max_ns;
+	};
+
+	// Fills in the statistics of up to max_stats callsites, in no particular order,
+	// and returns the number of callsites with any profiled scopes.
+	LOGURU_EXPORT
+	unsigned get_scope_stats(ScopeStats* out_stats, unsigned max_stats);
+
+	// The statistics of all callsites as a table, one line per callsite, slowest p99 first.
+	LOGURU_EXPORT
+	Text scope_stats_report();
+
+	// Forget all statistics collected so far.
+	LOGURU_EXPORT
+	void reset_scope_stats();
+
+	struct ScopeCallsite;
+
 	// Helper class for LOG_SCOPE_F
 	class LOGURU_EXPORT LogScopeRAII
 	{
@@ -677,8 +1350,10 @@ namespace loguru
 			: _verbosity(other._verbosity)
 			, _file(other._file)
 			, _line(other._line)
-			, _indent_stderr(other._indent_stderr)
 			, _start_time_ns(other._start_time_ns)
+			, _logged(other._logged)
+			, _callsite(other._callsite)
+			, _traced(other._traced)
 		{
 			// Make sure the tmp object's destruction doesn't close the scope:
 			other._file = nullptr;
@@ -699,27 +1374,163 @@ namespace loguru
 		Verbosity   _verbosity;
 		const char* _file; // Set to null if we are disabled due to verbosity
 		unsigned    _line;
-		bool        _indent_stderr; // Did we?
 		long long   _start_time_ns;
+		bool        _logged;   // Did we write the "{" line?
+		ScopeCallsite* _callsite; // Where our duration is recorded, or nullptr.
+		bool        _traced;   // Do we go in the trace file (see add_trace_file)?
 		char        _name[LOGURU_SCOPE_TEXT_SIZE];
 	};
 
+	struct BatchLines;
+
+	/* Collects lines and logs them when it goes out of scope, all under one lock and with one preamble,
+	   so that they are contiguous in every sink and sinks are flushed once rather than per line.
+	   Use the LOG_BATCH macro, and keep it short-lived: other threads wait while it is logged.
+	   Do not use Verbosity_FATAL (use ABORT_F instead).
+
+		{
+			LOG_BATCH(INFO, table);
+			for (const auto& row : rows) {
+				table.add("%-10s %5d", row.name, row.count);
+			}
+		}
+	*/
+	class LOGURU_EXPORT LogBatch
+	{
+	public:
+		LogBatch(Verbosity verbosity, const char* file, unsigned line);
+		// Exceptions thrown by callbacks are caught, and the rest of the batch is dropped.
+		~LogBatch() noexcept;
+
+		LogBatch(const LogBatch&) = delete;
+		LogBatch& operator=(const LogBatch&) = delete;
+
+#if LOGURU_USE_FMTLIB
+		template <typename... Args>
+		void add(LOGURU_FMT_FORMAT_STRING(Args) format, const Args&... args) {
+			vadd(format, fmt::make_format_args(args...));
+		}
+		void vadd(fmt::string_view format, fmt::format_args args);
+#elif LOGURU_USE_STD_FORMAT
+		template <typename... Args>
+		void add(std::format_string<Args...> format, const Args&... args) {
+			vadd(format.get(), std::make_format_args(args...));
+		}
+		void vadd(std::string_view format, std::format_args args);
+#else
+		// Add a line. Not formatted if the batch's verbosity is cut off.
+		void add(LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(2, 3);
+#endif
+
+	private:
+		void write();
+
+		Verbosity   _verbosity;
+		const char* _file;
+		unsigned    _line;
+		BatchLines* _lines; // nullptr if our verbosity is cut off.
+	};
+
+	struct ScopeWatchdogOptions
+	{
+		// How often to look for LOG_SCOPE_BUDGET_F scopes that have been open for longer than their budget.
+		// Each is reported once, with the ERROR_CONTEXT:s open on its thread, but not their values,
+		// which that thread may be changing. 0 disables the watchdog.
+		unsigned interval_ms = 0;
+		Verbosity verbosity = Verbosity_WARNING;
+
+		// Also log the stack of the thread that is over budget. The thread captures it in a handler
+		// for LOGURU_WATCHDOG_SIGNAL (default: SIGUSR2), so this only works where loguru has stack traces,
+		// and if nothing else has a handler for that signal.
+		bool stacktraces = true;
+	};
+
+	// Start, change or pause the scope watchdog. Scopes opened while it is paused are not watched.
+	LOGURU_EXPORT
+	void set_scope_watchdog(const ScopeWatchdogOptions& options);
+
+	class EcEntryBase;
+	struct ScopeBudgets;
+
+	// Helper class for LOG_SCOPE_BUDGET_F
+	class LOGURU_EXPORT LogScopeBudgetRAII
+	{
+	public:
+		LogScopeBudgetRAII(Verbosity verbosity, const char* file, unsigned line, double budget_ms, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(6, 7);
+		~LogScopeBudgetRAII();
+
+		LogScopeBudgetRAII(const LogScopeBudgetRAII&) = delete;
+		LogScopeBudgetRAII& operator=(const LogScopeBudgetRAII&) = delete;
+
+	private:
+		friend struct ScopeWatchdog;
+
+		Verbosity          _verbosity;
+		const char*        _file; // Set to null if we are disabled due to verbosity
+		unsigned           _line;
+		long long          _budget_ns;
+		long long          _start_time_ns;
+		ScopeBudgets*      _budgets;   // Where the watchdog can find us, or nullptr.
+		const EcEntryBase* _ec_handle; // The error context outside of us, for the watchdog.
+		bool               _reported;  // By the watchdog. Guarded by _budgets->mutex.
+		char               _name[LOGURU_SCOPE_TEXT_SIZE];
+	};
+
 	// Marked as 'noreturn' for the benefit of the static analyzer and optimizer.
 	// stack_trace_skip is the number of extrace stack frames to skip above log_and_abort.
 #if LOGURU_USE_FMTLIB
 	LOGURU_EXPORT
-	LOGURU_NORETURN void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, fmt::format_args);
+	LOGURU_NORETURN void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, fmt::string_view format, fmt::format_args);
 	template <typename... Args>
 	LOGURU_EXPORT
-	LOGURU_NORETURN void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, const Args&... args) {
+	LOGURU_NORETURN void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING(Args) format, const Args&... args) {
 	    vlog_and_abort(stack_trace_skip, expr, file, line, format, fmt::make_format_args(args...));
 	}
+#elif LOGURU_USE_STD_FORMAT
+	LOGURU_EXPORT
+	LOGURU_NORETURN void vlog_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, std::string_view format, std::format_args);
+	template <typename... Args>
+	LOGURU_EXPORT
+	LOGURU_NORETURN void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, std::format_string<Args...> format, const Args&... args) {
+		vlog_and_abort(stack_trace_skip, expr, file, line, format.get(), std::make_format_args(args...));
+	}
 #else
 	LOGURU_EXPORT
 	LOGURU_NORETURN void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(5, 6);
 #endif
 	LOGURU_EXPORT
 	LOGURU_NORETURN void log_and_abort(int stack_trace_skip, const char* expr, const char* file, unsigned line);
+	LOGURU_EXPORT
+	LOGURU_NORETURN void log_and_abort_plain(int stack_trace_skip, const char* expr, const char* file, unsigned line, const char* message);
+
+	// ABORT_F given only a message, see log_one.
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
+	#if LOGURU_USE_FMTLIB
+	LOGURU_NORETURN inline void log_and_abort_one(const char* expr, const char* file, unsigned line, LOGURU_FMT_FORMAT_STRING_NO_ARGS format)
+	#else
+	LOGURU_NORETURN inline void log_and_abort_one(const char* expr, const char* file, unsigned line, std::format_string<> format)
+	#endif
+	{
+		const char* message = format_string_data(format);
+		if (is_plain_message(message)) {
+			log_and_abort_plain(0, expr, file, line, message);
+		}
+	#if LOGURU_USE_FMTLIB
+		vlog_and_abort(0, expr, file, line, message, fmt::format_args());
+	#else
+		vlog_and_abort(0, expr, file, line, message, std::format_args());
+	#endif
+	}
+#else
+	LOGURU_NORETURN inline void log_and_abort_one(const char* expr, const char* file, unsigned line, LOGURU_FORMAT_STRING_TYPE format, ...) LOGURU_PRINTF_LIKE(4, 5);
+	LOGURU_NORETURN inline void log_and_abort_one(const char* expr, const char* file, unsigned line, const char* format, ...)
+	{
+		if (is_plain_message(format)) {
+			log_and_abort_plain(0, expr, file, line, format);
+		}
+		log_and_abort(0, expr, file, line, format);
+	}
+#endif
 
 	// Flush output to stderr and files.
 	// If g_flush_interval_ms is set to non-zero, this will be called automatically this often.
@@ -733,7 +1544,7 @@ namespace loguru
 	template<>        inline Text format_value(const float& v)              { return textprintf(LOGURU_FMT(f),   v); }
 	template<>        inline Text format_value(const double& v)             { return textprintf(LOGURU_FMT(f),   v); }
 
-#if LOGURU_USE_FMTLIB
+#if LOGURU_USE_FMTLIB || LOGURU_USE_STD_FORMAT
 	template<>        inline Text format_value(const unsigned int& v)       { return textprintf(LOGURU_FMT(d), v); }
 	template<>        inline Text format_value(const long& v)               { return textprintf(LOGURU_FMT(d), v); }
 	template<>        inline Text format_value(const unsigned long& v)      { return textprintf(LOGURU_FMT(d), v); }
@@ -847,11 +1658,27 @@ namespace loguru
 	LOGURU_EXPORT
 	void stream_print(StringStream& out_string_stream, const char* text);
 
+	class EcEntryBase;
+
+#if LOGURU_INLINE_ERROR_CONTEXT
+	// The innermost ERROR_CONTEXT of this thread. Use get_thread_ec_handle() rather than this.
+	LOGURU_EXPORT extern __thread EcEntryBase* g_thread_ec_head;
+#endif
+
 	class LOGURU_EXPORT EcEntryBase
 	{
 	public:
+#if LOGURU_INLINE_ERROR_CONTEXT
+		EcEntryBase(const char* file, unsigned line, const char* descr)
+			: _file(file), _line(line), _descr(descr), _previous(g_thread_ec_head)
+		{
+			g_thread_ec_head = this;
+		}
+		~EcEntryBase() { g_thread_ec_head = _previous; }
+#else
 		EcEntryBase(const char* file, unsigned line, const char* descr);
 		~EcEntryBase();
+#endif
 		EcEntryBase(const EcEntryBase&) = delete;
 		EcEntryBase(EcEntryBase&&) = delete;
 		EcEntryBase& operator=(const EcEntryBase&) = delete;
@@ -1056,10 +1883,30 @@ LOGURU_ANONYMOUS_NAMESPACE_END
 // --------------------------------------------------------------------
 // Logging macros
 
+// LOGURU_DISPATCH(LOGURU_LOG_, args...) is LOGURU_LOG_ONE for a single argument (a message
+// without arguments), else LOGURU_LOG_MANY. Handles up to 64 arguments.
+#define LOGURU_EXPAND(x) x
+#define LOGURU_PICK_65TH(                                                                          \
+	_1,  _2,  _3,  _4,  _5,  _6,  _7,  _8,  _9,  _10, _11, _12, _13, _14, _15, _16,                \
+	_17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32,                \
+	_33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, _47, _48,                \
+	_49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, N, ...) N
+#define LOGURU_NUM_ARGS_KIND(...) LOGURU_EXPAND(LOGURU_PICK_65TH(__VA_ARGS__,                       \
+	MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY,      \
+	MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY,      \
+	MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY,      \
+	MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY, MANY,      \
+	MANY, MANY, MANY, ONE, unused))
+#define LOGURU_DISPATCH(prefix, ...) LOGURU_CONCATENATE(prefix, LOGURU_NUM_ARGS_KIND(__VA_ARGS__))
+
+// A message without arguments and without anything to format is logged as-is, see log_one.
+#define LOGURU_LOG_ONE(verbosity, message) loguru::log_one(verbosity, __FILE__, __LINE__, message)
+#define LOGURU_LOG_MANY(verbosity, ...) loguru::log(verbosity, __FILE__, __LINE__, __VA_ARGS__)
+
 // LOG_F(2, "Only logged if verbosity is 2 or higher: %d", some_number);
 #define VLOG_F(verbosity, ...)                                                                     \
 	((verbosity) > loguru::current_verbosity_cutoff()) ? (void)0                                   \
-									  : loguru::log(verbosity, __FILE__, __LINE__, __VA_ARGS__)
+		: LOGURU_EXPAND(LOGURU_DISPATCH(LOGURU_LOG_, __VA_ARGS__)(verbosity, __VA_ARGS__))
 
 // LOG_F(INFO, "Foo: %d", some_number);
 #define LOG_F(verbosity_name, ...) VLOG_F(loguru::Verbosity_ ## verbosity_name, __VA_ARGS__)
@@ -1067,34 +1914,76 @@ LOGURU_ANONYMOUS_NAMESPACE_END
 #define VLOG_IF_F(verbosity, cond, ...)                                                            \
 	((verbosity) > loguru::current_verbosity_cutoff() || (cond) == false)                          \
 		? (void)0                                                                                  \
-		: loguru::log(verbosity, __FILE__, __LINE__, __VA_ARGS__)
+		: LOGURU_EXPAND(LOGURU_DISPATCH(LOGURU_LOG_, __VA_ARGS__)(verbosity, __VA_ARGS__))
 
 #define LOG_IF_F(verbosity_name, cond, ...)                                                        \
 	VLOG_IF_F(loguru::Verbosity_ ## verbosity_name, cond, __VA_ARGS__)
 
 #define VLOG_SCOPE_F(verbosity, ...)                                                               \
 	loguru::LogScopeRAII LOGURU_ANONYMOUS_VARIABLE(error_context_RAII_) =                          \
-	((verbosity) > loguru::current_verbosity_cutoff()) ? loguru::LogScopeRAII() :                  \
+	((verbosity) > loguru::current_scope_verbosity_cutoff()) ? loguru::LogScopeRAII() :            \
 	loguru::LogScopeRAII(verbosity, __FILE__, __LINE__, __VA_ARGS__)
 
+#define LOGURU_RAW_LOG_ONE(verbosity, message) loguru::raw_log_one(verbosity, __FILE__, __LINE__, message)
+#define LOGURU_RAW_LOG_MANY(verbosity, ...) loguru::raw_log(verbosity, __FILE__, __LINE__, __VA_ARGS__)
+
 // Raw logging - no preamble, no indentation. Slightly faster than full logging.
 #define RAW_VLOG_F(verbosity, ...)                                                                 \
 	((verbosity) > loguru::current_verbosity_cutoff()) ? (void)0                                   \
-									  : loguru::raw_log(verbosity, __FILE__, __LINE__, __VA_ARGS__)
+		: LOGURU_EXPAND(LOGURU_DISPATCH(LOGURU_RAW_LOG_, __VA_ARGS__)(verbosity, __VA_ARGS__))
 
 #define RAW_LOG_F(verbosity_name, ...) RAW_VLOG_F(loguru::Verbosity_ ## verbosity_name, __VA_ARGS__)
 
-// Use to book-end a scope. Affects logging on all threads.
+// Structured logging. The message is used as-is and the values are stored with their types, so
+// only sinks that need text pay for formatting them, e.g. as " status=200 path=/index.html".
+// LOG_KV(INFO, "Request done", "status", status_code, "bytes", num_bytes, "path", path);
+#define VLOG_KV(verbosity, message, ...)                                                           \
+	((verbosity) > loguru::current_verbosity_cutoff()) ? (void)0                                   \
+									  : loguru::log_kv(verbosity, __FILE__, __LINE__, message, ##__VA_ARGS__)
+
+#define LOG_KV(verbosity_name, message, ...) VLOG_KV(loguru::Verbosity_ ## verbosity_name, message, ##__VA_ARGS__)
+
+// Offset/hex/ASCII dump in the style of `hexdump -C`, one message with a line per 16 bytes:
+// LOG_HEX(INFO, packet.data(), packet.size(), "Received packet");
+// Received packet (21 bytes):
+// 00000000  48 54 54 50 2f 31 2e 31  20 32 30 30 20 4f 4b 0d  |HTTP/1.1 200 OK.|
+// 00000010  0a 0d 0a 00 ff                                    |.....|
+#define VLOG_HEX(verbosity, data, size, description)                                               \
+	((verbosity) > loguru::current_verbosity_cutoff()) ? (void)0                                   \
+									  : loguru::log_hex(verbosity, __FILE__, __LINE__, data, size, description)
+
+#define LOG_HEX(verbosity_name, data, size, description)                                           \
+	VLOG_HEX(loguru::Verbosity_ ## verbosity_name, data, size, description)
+
+// Use to book-end a scope. Indents what this thread logs within it.
 #define LOG_SCOPE_F(verbosity_name, ...)                                                           \
 	VLOG_SCOPE_F(loguru::Verbosity_ ## verbosity_name, __VA_ARGS__)
 
 #define LOG_SCOPE_FUNCTION(verbosity_name) LOG_SCOPE_F(verbosity_name, __func__)
 
+// Times a scope, and only logs it (with the error context) if it takes longer than budget_ms milliseconds.
+// With set_scope_watchdog, scopes that are still open past their budget are reported too.
+// LOG_SCOPE_BUDGET_F(INFO, 50, "handle %d", id);
+#define VLOG_SCOPE_BUDGET_F(verbosity, budget_ms, ...)                                             \
+	loguru::LogScopeBudgetRAII LOGURU_ANONYMOUS_VARIABLE(scope_budget_RAII_)(                      \
+		verbosity, __FILE__, __LINE__, budget_ms, __VA_ARGS__)
+
+#define LOG_SCOPE_BUDGET_F(verbosity_name, budget_ms, ...)                                         \
+	VLOG_SCOPE_BUDGET_F(loguru::Verbosity_ ## verbosity_name, budget_ms, __VA_ARGS__)
+
+// Declares a loguru::LogBatch called `name`. See LogBatch.
+#define VLOG_BATCH(verbosity, name) loguru::LogBatch name(verbosity, __FILE__, __LINE__)
+
+#define LOG_BATCH(verbosity_name, name) VLOG_BATCH(loguru::Verbosity_ ## verbosity_name, name)
+
 // -----------------------------------------------
 // ABORT_F macro. Usage:  ABORT_F("Cause of error: %s", error_str);
 
+#define LOGURU_ABORT_ONE(message) loguru::log_and_abort_one("ABORT: ", __FILE__, __LINE__, message)
+#define LOGURU_ABORT_MANY(...) loguru::log_and_abort(0, "ABORT: ", __FILE__, __LINE__, __VA_ARGS__)
+
 // Message is optional
-#define ABORT_F(...) loguru::log_and_abort(0, "ABORT: ", __FILE__, __LINE__, __VA_ARGS__)
+#define ABORT_F(...) LOGURU_EXPAND(LOGURU_DISPATCH(LOGURU_ABORT_, __VA_ARGS__)(__VA_ARGS__))
 
 // --------------------------------------------------------------------
 // CHECK_F macros:
@@ -1234,58 +2123,76 @@ namespace loguru
 	LOGURU_EXPORT
 	std::string vstrprintf(LOGURU_FORMAT_STRING_TYPE format, va_list) LOGURU_PRINTF_LIKE(1, 0);
 
+	// A std::ostream writing into a fixed buffer, reused by all LOG_S on a thread
+	// so that they neither allocate nor set up a new stream.
+	class LogStream;
+
+	LOGURU_EXPORT
+	LogStream* acquire_log_stream(std::ostream** out_stream);
+
+	LOGURU_EXPORT
+	void release_log_stream(LogStream* log_stream);
+
 	class LOGURU_EXPORT StreamLogger
 	{
 	public:
-		StreamLogger(Verbosity verbosity, const char* file, unsigned line) : _verbosity(verbosity), _file(file), _line(line) {}
+		StreamLogger(Verbosity verbosity, const char* file, unsigned line)
+			: _verbosity(verbosity), _file(file), _line(line), _log_stream(acquire_log_stream(&_stream)) {}
 		~StreamLogger() noexcept(false);
+		StreamLogger(const StreamLogger&) = delete;
+		StreamLogger& operator=(const StreamLogger&) = delete;
 
 		template<typename T>
 		StreamLogger& operator<<(const T& t)
 		{
-			_ss << t;
+			*_stream << t;
 			return *this;
 		}
 
 		// std::endl and other iomanip:s.
 		StreamLogger& operator<<(std::ostream&(*f)(std::ostream&))
 		{
-			f(_ss);
+			f(*_stream);
 			return *this;
 		}
 
 	private:
-		Verbosity   _verbosity;
-		const char* _file;
-		unsigned    _line;
-		std::ostringstream _ss;
+		Verbosity     _verbosity;
+		const char*   _file;
+		unsigned      _line;
+		std::ostream* _stream;
+		LogStream*    _log_stream;
 	};
 
 	class LOGURU_EXPORT AbortLogger
 	{
 	public:
-		AbortLogger(const char* expr, const char* file, unsigned line) : _expr(expr), _file(file), _line(line) { }
+		AbortLogger(const char* expr, const char* file, unsigned line)
+			: _expr(expr), _file(file), _line(line), _log_stream(acquire_log_stream(&_stream)) { }
 		LOGURU_NORETURN ~AbortLogger() noexcept(false);
+		AbortLogger(const AbortLogger&) = delete;
+		AbortLogger& operator=(const AbortLogger&) = delete;
 
 		template<typename T>
 		AbortLogger& operator<<(const T& t)
 		{
-			_ss << t;
+			*_stream << t;
 			return *this;
 		}
 
 		// std::endl and other iomanip:s.
 		AbortLogger& operator<<(std::ostream&(*f)(std::ostream&))
 		{
-			f(_ss);
+			f(*_stream);
 			return *this;
 		}
 
 	private:
-		const char*        _expr;
-		const char*        _file;
-		unsigned           _line;
-		std::ostringstream _ss;
+		const char*   _expr;
+		const char*   _file;
+		unsigned      _line;
+		std::ostream* _stream;
+		LogStream*    _log_stream;
 	};
 
 	class LOGURU_EXPORT Voidify
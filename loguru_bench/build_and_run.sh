@@ -9,4 +9,10 @@ cd build
 cmake ..
 make
 
-./loguru_bench $@ 2>/dev/null
+# One binary per formatting backend that could be built:
+for bench in loguru_bench loguru_bench_fmt loguru_bench_std_format; do
+	if [ -x "$bench" ]; then
+		echo "--- $bench"
+		./$bench $@ 2>/dev/null
+	fi
+done
@@ -60,7 +60,7 @@ void format_strings(size_t num_iterations)
 void format_float(size_t num_iterations)
 {
 	for (size_t i = 0; i < num_iterations; ++i) {
-		LOG_F(WARNING, "%+05.3f", kPi);
+		LOG_F(WARNING, LOGURU_FMT(+05.3f), kPi);
 	}
 	loguru::flush();
 }
@@ -89,10 +89,19 @@ void raw_string_float(size_t num_iterations)
 	loguru::flush();
 }
 
+// Keeps the compiler from eliding an inlined ERROR_CONTEXT push and pop.
+static void clobber_memory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : : "memory");
+#endif
+}
+
 void error_context(size_t num_iterations)
 {
 	for (size_t i = 0; i < num_iterations; ++i) {
 		ERROR_CONTEXT("key", "value");
+		clobber_memory();
 	}
 }
 
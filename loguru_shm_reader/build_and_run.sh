@@ -0,0 +1,12 @@
+#!/bin/bash
+set -e # Fail on error
+
+ROOT_DIR=$(cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd)
+
+cd "$ROOT_DIR"
+mkdir -p build
+cd build
+cmake ..
+make
+
+./loguru_shm_reader $@
@@ -0,0 +1,136 @@
+// Reference collector for loguru::add_shm_sink.
+//
+// Drains a shared-memory ring into one log file per writing process, named
+// <output_dir>/<program>.<pid>.log, in the same format as loguru::add_file.
+// All formatting and file I/O happens here instead of in the logging processes.
+//
+// Usage: loguru_shm_reader name output_dir [size_bytes] [--once]
+//   name        The name given to add_shm_sink, e.g. /my_service_log
+//   output_dir  Where to write the log files. Created if needed.
+//   size_bytes  Size of the ring, if the reader starts before the writers. Default: 4 MiB.
+//   --once      Drain what is in the ring right now and exit, instead of running until SIGINT/SIGTERM.
+
+#include <csignal>
+#include <map>
+#include <string>
+
+#include "../loguru.cpp"
+
+static volatile std::sig_atomic_t s_quit = 0;
+
+static void on_signal(int)
+{
+	s_quit = 1;
+}
+
+static FILE* file_for(std::map<long long, FILE*>& files, const std::string& output_dir, const loguru::ShmRecord& record)
+{
+	auto it = files.find(record.pid);
+	if (it != files.end()) {
+		return it->second;
+	}
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s.%lld.log", output_dir.c_str(),
+		record.program[0] ? record.program : "unknown", record.pid);
+	loguru::create_directories(path);
+	FILE* file = fopen(path, "a");
+	if (!file) {
+		fprintf(stderr, "Failed to open '%s'\n", path);
+	}
+	files[record.pid] = file;
+	return file;
+}
+
+static void write_record(FILE* file, const loguru::ShmRecord& record)
+{
+	time_t sec_since_epoch = time_t(record.time_us / 1000000);
+	tm time_info;
+	localtime_r(&sec_since_epoch, &time_info);
+
+	char level_buff[6];
+	if (const char* level_name = loguru::get_verbosity_name(record.verbosity)) {
+		snprintf(level_buff, sizeof(level_buff) - 1, "%s", level_name);
+	} else {
+		snprintf(level_buff, sizeof(level_buff) - 1, "% 4d", static_cast<int8_t>(record.verbosity));
+	}
+
+	char shortened_filename[LOGURU_FILENAME_WIDTH + 1];
+	snprintf(shortened_filename, sizeof(shortened_filename), "%s", record.file);
+
+	fprintf(file, "%04d-%02d-%02d %02d:%02d:%02d.%03lld [%-*.*s]%*s:%-5u %4s| ",
+		1900 + time_info.tm_year, 1 + time_info.tm_mon, time_info.tm_mday,
+		time_info.tm_hour, time_info.tm_min, time_info.tm_sec, (record.time_us / 1000) % 1000,
+		LOGURU_THREADNAME_WIDTH, LOGURU_THREADNAME_WIDTH, record.thread_name,
+		LOGURU_FILENAME_WIDTH, shortened_filename, record.line, level_buff);
+	for (unsigned i = 0; i < record.depth; ++i) {
+		fputs(".   ", file);
+	}
+	fprintf(file, "%s\n", record.message);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s name output_dir [size_bytes] [--once]\n", argv[0]);
+		return 1;
+	}
+	const char* name = argv[1];
+	const std::string output_dir = argv[2];
+	unsigned long long size_bytes = 4 * 1024 * 1024;
+	bool once = false;
+	for (int i = 3; i < argc; ++i) {
+		if (strcmp(argv[i], "--once") == 0) {
+			once = true;
+		} else {
+			size_bytes = strtoull(argv[i], nullptr, 10);
+		}
+	}
+
+	loguru::ShmReader reader;
+	if (!reader.open(name, size_bytes)) {
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	std::map<long long, FILE*> files;
+	unsigned long long reported_dropped = 0;
+	unsigned long long reported_skipped = 0;
+	for (;;) {
+		loguru::ShmRecord record;
+		bool any = false;
+		while (reader.read(&record)) {
+			any = true;
+			if (FILE* file = file_for(files, output_dir, record)) {
+				write_record(file, record);
+			}
+		}
+
+		const unsigned long long dropped = reader.num_dropped();
+		if (dropped != reported_dropped) {
+			fprintf(stderr, "%llu messages dropped because the ring was full\n", dropped - reported_dropped);
+			reported_dropped = dropped;
+		}
+		const unsigned long long skipped = reader.num_skipped();
+		if (skipped != reported_skipped) {
+			fprintf(stderr, "%llu messages skipped because they were never published\n", skipped - reported_skipped);
+			reported_skipped = skipped;
+		}
+
+		if (any) {
+			for (auto& pair : files) {
+				if (pair.second) { fflush(pair.second); }
+			}
+		} else if (once || s_quit) {
+			break;
+		} else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	for (auto& pair : files) {
+		if (pair.second) { fclose(pair.second); }
+	}
+	return 0;
+}
@@ -48,6 +48,26 @@ test_failure "error_context"
 test_failure "throw_on_fatal"
 test_failure "throw_on_signal"
 test_success "callback"
+test_success "json"
+test_success "kv"
+test_success "ring_buffer"
+test_success "shm"
+test_success "nonblocking_stderr"
+test_success "syslog_socket"
+test_success "journald"
+test_success "network"
+test_success "pipe"
+test_success "async"
+test_success "sink_handles"
+test_success "sink_verbosity"
+test_success "stream_reuse"
+test_success "plain_messages"
+test_success "hex_dump"
+test_success "log_batch"
+test_success "scope_threads"
+test_success "scope_profiler"
+test_success "trace_file"
+test_success "scope_budget"
 echo "---------------------------------------------------------"
 echo "ALL TESTS PASSED!"
 echo "---------------------------------------------------------"
@@ -8,11 +8,18 @@
 // #define LOGURU_RTTI             1
 #include "../loguru.cpp"
 
+#include <atomic>
 #include <chrono>
 #include <string>
 #include <thread>
 
 #include <fstream>
+#include <iomanip>
+#include <map>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
 
 void the_one_where_the_problem_is(const std::vector<std::string>& v) {
 	ABORT_F("Abort deep in stack trace, msg: %s", v[0].c_str());
@@ -34,6 +41,23 @@ void sleep_ms(int ms)
 	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
+// The lines of a text file, e.g. one a test logged to.
+static std::vector<std::string> read_lines(const char* path)
+{
+	std::ifstream file(path);
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(file, line)) {
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+static bool ends_with(const std::string& str, const std::string& suffix)
+{
+	return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 void test_thread_names()
 {
 	LOG_SCOPE_FUNCTION(INFO);
@@ -307,6 +331,1367 @@ void test_log_callback()
 	CHECK_EQ_F(tester.num_close, 1u);
 }
 
+void test_json()
+{
+	CHECK_F(loguru::add_json_file("json_test.log", loguru::Truncate, loguru::Verbosity_INFO));
+	LOG_F(INFO, "Plain message");
+	{
+		LOG_SCOPE_F(INFO, "Scope");
+		LOG_F(WARNING, "Quote \" backslash \\ newline \n tab \t bell \a in a message longer than thirty-two bytes");
+	}
+	{
+		loguru::ContextScope request_context("req", std::string("abc"));
+		LOG_KV(INFO, "Request done", "status", 200, "path", std::string("/index.html"), "ok", true,
+			"id", 18446744073709551615ull);
+	}
+	loguru::remove_callback("json_test.log");
+
+	const std::vector<std::string> lines = read_lines("json_test.log");
+	CHECK_EQ_F(lines.size(), 6u); // Including the "Logging JSON to" line.
+	CHECK_F(lines[1].find("\"level\":\"INFO\"") != std::string::npos, "%s", lines[1].c_str());
+	CHECK_F(lines[1].find("\"depth\":0,\"message\":\"Plain message\"}") != std::string::npos, "%s", lines[1].c_str());
+	CHECK_F(lines[2].find("\"message\":\"{ Scope\"") != std::string::npos, "%s", lines[2].c_str());
+	CHECK_F(lines[3].find("\"depth\":1,") != std::string::npos, "%s", lines[3].c_str());
+	CHECK_F(lines[3].find("Quote \\\" backslash \\\\ newline \\n tab \\t bell \\u0007 in") != std::string::npos,
+		"%s", lines[3].c_str());
+	CHECK_F(lines[5].find("\"message\":\"Request done\",\"fields\":{\"status\":200,\"path\":\"/index.html\",\"ok\":true,\"id\":18446744073709551615},\"context\":{\"req\":\"abc\"}}") != std::string::npos,
+		"%s", lines[5].c_str());
+}
+
+void test_kv()
+{
+	CHECK_F(loguru::add_file("kv_test.log", loguru::Truncate, loguru::Verbosity_INFO));
+	const char* path = "/index.html";
+	LOG_KV(INFO, "Request done", "status", 200, "bytes", 512u, "path", path, "ok", true, "ratio", 0.5, "user", std::string("J. Doe"),
+		"id", static_cast<unsigned long long>(1) << 63);
+	LOG_KV(INFO, "No fields");
+	{
+		loguru::ContextScope request_context("req", std::string("abc-123"));
+		loguru::ContextScope shard_context("shard", 3);
+		LOG_F(INFO, "With context");
+	}
+	LOG_F(INFO, "Without context");
+	loguru::remove_callback("kv_test.log");
+
+	const std::vector<std::string> lines = read_lines("kv_test.log");
+	CHECK_GE_F(lines.size(), 4u);
+	const std::string& with_fields = lines[lines.size() - 4];
+	CHECK_F(ends_with(with_fields, "| Request done status=200 bytes=512 path=/index.html ok=true ratio=0.5 user=\"J. Doe\" id=9223372036854775808"),
+		"%s", with_fields.c_str());
+	CHECK_F(ends_with(lines[lines.size() - 3], "| No fields"), "%s", lines[lines.size() - 3].c_str());
+	CHECK_F(ends_with(lines[lines.size() - 2], "| With context req=abc-123 shard=3"), "%s", lines[lines.size() - 2].c_str());
+	CHECK_F(ends_with(lines[lines.size() - 1], "| Without context"), "%s", lines[lines.size() - 1].c_str());
+
+	// A callback that logs does not change the fields that the callbacks after it see:
+	std::vector<std::string> texts;
+	loguru::add_callback("kv_nested", [](void*, const loguru::Message& message) {
+		if (strcmp(message.message, "Outer") == 0) {
+			LOG_KV(INFO, "Inner", "inner", 1);
+		}
+	}, nullptr, loguru::Verbosity_INFO);
+	loguru::add_callback("kv_texts", [](void* user_data, const loguru::Message& message) {
+		static_cast<std::vector<std::string>*>(user_data)->push_back(std::string(message.message) + loguru::fields_text(message));
+	}, &texts, loguru::Verbosity_INFO);
+	LOG_KV(INFO, "Outer", "outer", 2);
+	loguru::remove_callback("kv_nested");
+	loguru::remove_callback("kv_texts");
+	CHECK_EQ_F(texts.size(), 2u);
+	CHECK_EQ_S(texts[0], "Inner inner=1");
+	CHECK_EQ_S(texts[1], "Outer outer=2");
+}
+
+void test_ring_buffer()
+{
+	loguru::set_ring_buffer(8, loguru::Verbosity_5);
+	CHECK_F(loguru::add_file("ring_test.log", loguru::Truncate, loguru::Verbosity_INFO));
+	LOG_F(3, "Verbose a");
+	LOG_F(4, "Verbose b");
+	LOG_F(9, "Too verbose for the ring");
+	LOG_F(INFO, "Info c");
+	LOG_F(ERROR, "Boom");
+	LOG_F(ERROR, "Boom again");
+	loguru::remove_callback("ring_test.log");
+	loguru::set_ring_buffer(0, loguru::Verbosity_OFF);
+
+	const std::vector<std::string> lines = read_lines("ring_test.log");
+	CHECK_GE_F(lines.size(), 5u);
+	const size_t n = lines.size();
+	CHECK_F(ends_with(lines[n - 5], "| Info c"), "%s", lines[n - 5].c_str());
+	CHECK_F(ends_with(lines[n - 4], "| Verbose a"), "%s", lines[n - 4].c_str());
+	CHECK_F(ends_with(lines[n - 3], "| Verbose b"), "%s", lines[n - 3].c_str());
+	CHECK_F(ends_with(lines[n - 2], "| Boom"), "%s", lines[n - 2].c_str());
+	CHECK_F(ends_with(lines[n - 1], "| Boom again"), "%s", lines[n - 1].c_str());
+
+	// Resizing the ring while other threads log to it frees the old ones safely:
+	std::atomic<bool> quit { false };
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&quit]() {
+			for (int i = 0; !quit; ++i) {
+				LOG_F(3, "Into the ring %d", i);
+			}
+		});
+	}
+	for (unsigned i = 0; i < 200; ++i) {
+		loguru::set_ring_buffer(8 + i % 5, loguru::Verbosity_5);
+	}
+	quit = true;
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	loguru::set_ring_buffer(0, loguru::Verbosity_OFF);
+}
+
+void test_shm()
+{
+#if LOGURU_SHM
+	const char* name = "/loguru_test_shm";
+	shm_unlink(name);
+	CHECK_F(loguru::add_shm_sink(name, 4096, loguru::Verbosity_INFO));
+	LOG_F(INFO, "Hello shared memory");
+	{
+		LOG_SCOPE_F(INFO, "Scope");
+		LOG_KV(WARNING, "Warning with fields", "answer", 42);
+	}
+	LOG_F(1, "Too verbose");
+
+	loguru::ShmReader reader;
+	CHECK_F(reader.open(name, 4096));
+	std::vector<std::string> messages;
+	loguru::ShmRecord record;
+	while (reader.read(&record)) {
+		CHECK_EQ_F(record.pid, static_cast<long long>(getpid()));
+		if (std::string(loguru::filename(record.file)) != "loguru_test.cpp") {
+			continue; // "Logging to shared memory..."
+		}
+		messages.push_back(record.message);
+		if (messages.back() == "Warning with fields answer=42") {
+			CHECK_EQ_F(record.verbosity, loguru::Verbosity_WARNING);
+			CHECK_EQ_F(record.depth, 1u);
+		}
+	}
+	CHECK_EQ_F(messages.size(), 4u);
+	CHECK_EQ_F(messages[0], std::string("Hello shared memory"));
+	CHECK_EQ_F(messages[1], std::string("{ Scope"));
+	CHECK_EQ_F(messages[2], std::string("Warning with fields answer=42"));
+	CHECK_EQ_F(reader.num_dropped(), 0u);
+
+	// Overflow the ring without reading:
+	for (int i = 0; i < 200; ++i) {
+		LOG_F(INFO, "Filling up the ring %d", i);
+	}
+	CHECK_GT_F(reader.num_dropped(), 0u);
+	int num_read = 0;
+	while (reader.read(&record)) { ++num_read; }
+	CHECK_GT_F(num_read, 0);
+	LOG_F(INFO, "There is room again");
+	CHECK_F(reader.read(&record));
+	CHECK_EQ_F(std::string(record.message), std::string("There is room again"));
+
+	// Writers that reserved space and then stalled: one that died before marking the record,
+	// one that died after, and one that is merely slow.
+	unsigned long long mapped_size = 0;
+	loguru::ShmHeader* header = loguru::shm_map(name, 4096, &mapped_size);
+	CHECK_NOTNULL_F(header);
+	reader.set_stall_timeout(50);
+	const pid_t dead_pid = fork();
+	if (dead_pid == 0) { _exit(0); }
+	waitpid(dead_pid, nullptr, 0);
+	const long long writer_pids[] = {0, dead_pid, getpid()};
+	for (int i = 0; i < 3; ++i) {
+		const unsigned long long pos = header->write_pos.fetch_add(64);
+		if (writer_pids[i] != 0) {
+			loguru::shm_commit_word(header, pos).store(loguru::shm_reservation(writer_pids[i], 64));
+		}
+		LOG_F(INFO, "After a stalled writer");
+		CHECK_F(!reader.read(&record));
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		CHECK_F(!reader.read(&record));
+		std::this_thread::sleep_for(std::chrono::milliseconds(60));
+		// Only the stalled record is skipped:
+		CHECK_F(reader.read(&record));
+		CHECK_EQ_F(reader.num_skipped(), i + 1u);
+		CHECK_EQ_F(std::string(record.message), std::string("After a stalled writer"));
+		CHECK_F(!reader.read(&record));
+		// ...and its space is only reused once the writer is gone or done:
+		CHECK_EQ_F(header->read_pos.load(), i == 2 ? pos : header->write_pos.load());
+		if (i == 2) {
+			loguru::shm_commit_word(header, pos).store(56);
+			CHECK_F(!reader.read(&record));
+			CHECK_EQ_F(header->read_pos.load(), header->write_pos.load());
+		}
+	}
+	munmap(header, static_cast<size_t>(mapped_size));
+
+	loguru::remove_callback(name);
+	reader.close();
+	shm_unlink(name);
+#endif
+}
+
+void test_nonblocking_stderr()
+{
+#ifndef _WIN32
+	int fds[2];
+	CHECK_EQ_F(pipe(fds), 0);
+	const int saved_stderr = dup(STDERR_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+
+	// Nobody reads the pipe, so this would block forever with a normal stderr:
+	CHECK_F(loguru::set_stderr_nonblocking(4096, 0));
+	for (int i = 0; i < 5000; ++i) {
+		LOG_F(INFO, "Nobody is reading this yet %d", i);
+	}
+	LOG_F(ERROR, "Important");
+	CHECK_GT_F(loguru::stderr_lines_dropped(), 0u);
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	std::string output;
+	char buff[4096];
+	for (int i = 0; i < 500; ++i) {
+		loguru::flush();
+		ssize_t bytes;
+		while ((bytes = read(fds[0], buff, sizeof(buff))) > 0) {
+			output.append(buff, static_cast<size_t>(bytes));
+		}
+		if (output.find("| Important") != std::string::npos && output.find("lines to stderr dropped") != std::string::npos) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	loguru::set_stderr_nonblocking(0);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stderr);
+	close(fds[0]);
+	close(fds[1]);
+
+	CHECK_F(output.find("| Important") != std::string::npos);
+	CHECK_F(output.find("lines to stderr dropped") != std::string::npos);
+#endif
+}
+
+void test_syslog_socket()
+{
+#if LOGURU_SYSLOG
+	// Stand-in for the syslog daemon:
+	const char* path = "syslog_test.sock";
+	unlink(path);
+	const int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	CHECK_EQ_F(bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+
+	CHECK_F(loguru::add_syslog_socket("loguru test", loguru::Verbosity_INFO, LOG_LOCAL0, path));
+	LOG_F(INFO, "Hello syslog");
+	LOG_F(WARNING, "Careful");
+	LOG_F(1, "Too verbose");
+	loguru::remove_callback(path); // Sends everything queued.
+
+	std::vector<std::string> datagrams;
+	char buff[2048];
+	ssize_t bytes;
+	while ((bytes = recv(fd, buff, sizeof(buff), MSG_DONTWAIT)) > 0) {
+		datagrams.push_back(std::string(buff, static_cast<size_t>(bytes)));
+	}
+	close(fd);
+	unlink(path);
+
+	CHECK_GE_F(datagrams.size(), 2u);
+	const std::string& info = datagrams[datagrams.size() - 2];
+	const std::string& warning = datagrams[datagrams.size() - 1];
+	char hostname[256] = {0};
+	gethostname(hostname, sizeof(hostname) - 1);
+	const std::string header = std::string(" ") + hostname + " loguru_test " + std::to_string(getpid()) + " - - ";
+	const std::regex timestamp("<\\d+>1 \\d{4}-\\d\\d-\\d\\dT\\d\\d:\\d\\d:\\d\\d\\.\\d{3}Z .*");
+	CHECK_F(std::regex_match(info, timestamp), "%s", info.c_str());
+	CHECK_EQ_F(info.substr(0, 5), std::string("<133>")); // LOG_LOCAL0 | Notice
+	CHECK_EQ_F(info.substr(31), header + "Hello syslog");
+	CHECK_EQ_F(warning.substr(0, 5), std::string("<132>")); // LOG_LOCAL0 | Warning
+	CHECK_EQ_F(warning.substr(31), header + "Careful");
+
+	// A daemon that stops reading makes the queue overflow:
+	const int stuck_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	CHECK_EQ_F(bind(stuck_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+	CHECK_F(loguru::add_syslog_socket("loguru test", loguru::Verbosity_INFO, LOG_LOCAL0, path));
+	for (int i = 0; i < 10000; ++i) {
+		LOG_F(INFO, "Nobody is reading this yet %d", i);
+	}
+	CHECK_GT_F(loguru::get_callback_drop_count(path), 0u);
+	// Neither hangs nor is dropped:
+	loguru::set_fatal_handler([](const loguru::Message& message){
+		throw std::runtime_error(message.message);
+	});
+	try {
+		LOG_F(FATAL, "Fatal while the daemon is stuck");
+	} catch (std::runtime_error&) {
+	}
+	loguru::set_fatal_handler(nullptr);
+	const std::string report = " messages dropped because the syslog daemon was not keeping up";
+	bool got_report = false, got_fatal = false;
+	for (int i = 0; i < 500 && !(got_report && got_fatal); ++i) {
+		while ((bytes = recv(stuck_fd, buff, sizeof(buff), MSG_DONTWAIT)) > 0) {
+			const std::string datagram(buff, static_cast<size_t>(bytes));
+			got_report |= datagram.substr(0, 5) == "<132>" && datagram.find(report) != std::string::npos;
+			got_fatal  |= datagram.find("Fatal while the daemon is stuck") != std::string::npos;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK_F(got_report);
+	CHECK_F(got_fatal);
+	loguru::remove_callback(path);
+	close(stuck_fd);
+	unlink(path);
+#endif
+}
+
+#ifdef __linux__
+// Parses a journald native protocol datagram into its fields.
+static std::map<std::string, std::string> parse_journal_entry(const std::string& datagram)
+{
+	std::map<std::string, std::string> fields;
+	size_t pos = 0;
+	while (pos < datagram.size()) {
+		const size_t end = datagram.find_first_of("=\n", pos);
+		CHECK_NE_F(end, std::string::npos);
+		const std::string key = datagram.substr(pos, end - pos);
+		if (datagram[end] == '=') {
+			const size_t newline = datagram.find('\n', end);
+			fields[key] = datagram.substr(end + 1, newline - end - 1);
+			pos = newline + 1;
+		} else {
+			unsigned long long size = 0;
+			for (int i = 0; i < 8; ++i) {
+				size |= static_cast<unsigned long long>(static_cast<unsigned char>(datagram[end + 1 + i])) << (8 * i);
+			}
+			fields[key] = datagram.substr(end + 9, static_cast<size_t>(size));
+			pos = end + 9 + static_cast<size_t>(size) + 1;
+		}
+	}
+	return fields;
+}
+#endif
+
+void test_journald()
+{
+#ifdef __linux__
+	// Stand-in for journald:
+	const char* path = "journald_test.sock";
+	unlink(path);
+	const int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	CHECK_EQ_F(bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+	int receive_buffer_size = 4 * 1024 * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+
+	CHECK_F(loguru::add_journald(loguru::Verbosity_INFO, path));
+	const unsigned warning_line = __LINE__ + 1;
+	LOG_F(WARNING, "Hello journal");
+	LOG_F(INFO, "Two\nlines");
+	LOG_KV(INFO, "With fields", "user_id", 7, "_hidden", true);
+	const std::string big(300 * 1024, 'x'); // Too big for a datagram.
+	LOG_F(INFO, "%s", big.c_str());
+	loguru::remove_callback(path);
+
+	std::vector<std::map<std::string, std::string>> entries;
+	for (;;) {
+		static char buff[512 * 1024];
+		char control[CMSG_SPACE(sizeof(int))];
+		iovec iov = {buff, sizeof(buff)};
+		msghdr header;
+		memset(&header, 0, sizeof(header));
+		header.msg_iov = &iov;
+		header.msg_iovlen = 1;
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		const ssize_t bytes = recvmsg(fd, &header, MSG_DONTWAIT);
+		if (bytes < 0) {
+			break;
+		}
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+		if (bytes == 0 && cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+			int memfd;
+			memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+			std::string datagram;
+			char chunk[4096];
+			ssize_t chunk_size;
+			while ((chunk_size = pread(memfd, chunk, sizeof(chunk), static_cast<off_t>(datagram.size()))) > 0) {
+				datagram.append(chunk, static_cast<size_t>(chunk_size));
+			}
+			close(memfd);
+			entries.push_back(parse_journal_entry(datagram));
+		} else {
+			entries.push_back(parse_journal_entry(std::string(buff, static_cast<size_t>(bytes))));
+		}
+	}
+	close(fd);
+	unlink(path);
+
+	CHECK_GE_F(entries.size(), 4u);
+	const size_t n = entries.size();
+	auto& warning = entries[n - 4];
+	CHECK_EQ_F(warning["MESSAGE"], std::string("Hello journal"));
+	CHECK_EQ_F(warning["PRIORITY"], std::string("4"));
+	CHECK_EQ_F(std::string(loguru::filename(warning["CODE_FILE"].c_str())), std::string("loguru_test.cpp"));
+	CHECK_EQ_F(warning["CODE_LINE"], std::to_string(warning_line));
+	CHECK_EQ_F(warning["TID"], std::to_string(syscall(SYS_gettid)));
+	CHECK_EQ_F(warning["LOGURU_VERBOSITY"], std::string("-1"));
+	CHECK_EQ_F(entries[n - 3]["MESSAGE"], std::string("Two\nlines"));
+	CHECK_EQ_F(entries[n - 3]["PRIORITY"], std::string("5"));
+	CHECK_EQ_F(entries[n - 2]["USER_ID"], std::string("7"));
+	CHECK_EQ_F(entries[n - 2]["HIDDEN"], std::string("true"));
+	CHECK_EQ_F(entries[n - 1]["MESSAGE"], big);
+#endif
+}
+
+#ifndef _WIN32
+// Splits length-prefixed records.
+static std::vector<std::string> parse_records(const std::string& data)
+{
+	std::vector<std::string> records;
+	size_t pos = 0;
+	while (pos + 4 <= data.size()) {
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data() + pos);
+		const size_t size = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+		records.push_back(data.substr(pos + 4, size));
+		pos += 4 + size;
+	}
+	return records;
+}
+
+static int bind_localhost(int type, int* out_port)
+{
+	const int fd = socket(AF_INET, type, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	CHECK_EQ_F(bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+	socklen_t size = sizeof(addr);
+	getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &size);
+	*out_port = ntohs(addr.sin_port);
+	return fd;
+}
+#endif
+
+void test_network()
+{
+#ifndef _WIN32
+	// TCP, with the collector down at first:
+	int port;
+	const int listener = bind_localhost(SOCK_STREAM, &port); // Bound, but not listening yet.
+	const std::string url = "tcp://127.0.0.1:" + std::to_string(port);
+	const char* spool_path = "network_spool.bin";
+	{
+		// Left over from last time: a record too long to replay, which is skipped.
+		std::ofstream spool(spool_path, std::ios::binary | std::ios::trunc);
+		const size_t size = 2 * 1024 * 1024;
+		const char header[4] = {0, static_cast<char>(size >> 16), 0, 0};
+		spool.write(header, sizeof(header));
+		spool << std::string(size, 'x');
+	}
+	CHECK_F(loguru::add_network_sink(url.c_str(), loguru::Verbosity_INFO, spool_path));
+	LOG_F(INFO, "Spooled 1");
+	LOG_F(INFO, "Spooled 2");
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	CHECK_EQ_F(listen(listener, 1), 0);
+	LOG_F(INFO, "Live 1");
+	std::string received;
+	pollfd poll_fd = {listener, POLLIN, 0};
+	CHECK_EQ_F(poll(&poll_fd, 1, 5000), 1, "The sink never reconnected");
+	const int connection = accept(listener, nullptr, nullptr);
+	for (int i = 0; i < 500 && received.find("| Live 1") == std::string::npos; ++i) {
+		char buff[4096];
+		const ssize_t bytes = recv(connection, buff, sizeof(buff), MSG_DONTWAIT);
+		if (bytes > 0) {
+			received.append(buff, static_cast<size_t>(bytes));
+		} else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	loguru::remove_callback(url.c_str());
+	close(connection);
+	close(listener);
+	remove(spool_path);
+
+	const auto records = parse_records(received); // Starts with "Logging to 'tcp://...".
+	CHECK_EQ_F(records.size(), 4u);
+	CHECK_F(ends_with(records[1], "| Spooled 1"), "%s", records[1].c_str());
+	CHECK_F(ends_with(records[2], "| Spooled 2"), "%s", records[2].c_str());
+	CHECK_F(ends_with(records[3], "| Live 1"), "%s", records[3].c_str());
+
+	// UDP:
+	const int udp_fd = bind_localhost(SOCK_DGRAM, &port);
+	const std::string udp_url = "udp://127.0.0.1:" + std::to_string(port);
+	CHECK_F(loguru::add_network_sink(udp_url.c_str(), loguru::Verbosity_INFO, nullptr));
+	LOG_F(INFO, "Datagram 1");
+	LOG_F(INFO, "%s", std::string(100 * 1024, 'x').c_str()); // Truncated to fit a datagram.
+	LOG_F(INFO, "Datagram 2");
+	loguru::remove_callback(udp_url.c_str());
+	std::vector<std::string> datagram_records;
+	char datagram[65536];
+	ssize_t bytes;
+	while ((bytes = recv(udp_fd, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0) {
+		const auto batch = parse_records(std::string(datagram, static_cast<size_t>(bytes)));
+		datagram_records.insert(datagram_records.end(), batch.begin(), batch.end());
+	}
+	close(udp_fd);
+	CHECK_GE_F(datagram_records.size(), 3u);
+	CHECK_F(ends_with(datagram_records[datagram_records.size() - 3], "| Datagram 1"));
+	CHECK_EQ_F(datagram_records[datagram_records.size() - 2].size(), 60 * 1024 - 4u);
+	CHECK_F(ends_with(datagram_records[datagram_records.size() - 1], "| Datagram 2"));
+#endif
+}
+
+void test_pipe()
+{
+#ifndef _WIN32
+	const char* command = "cat > pipe_test.log";
+	CHECK_F(loguru::add_pipe_sink(command, loguru::Verbosity_INFO));
+	for (int i = 0; i < 1000; ++i) {
+		LOG_F(INFO, "Through the pipe %d", i);
+	}
+	loguru::remove_callback(command); // Waits for cat to finish.
+
+	const std::vector<std::string> lines = read_lines("pipe_test.log");
+	CHECK_GE_F(lines.size(), 1000u);
+	CHECK_F(ends_with(lines[lines.size() - 1000], "| Through the pipe 0"));
+	CHECK_F(ends_with(lines.back(), "| Through the pipe 999"));
+
+	// A command that doesn't read must neither block nor kill us:
+	CHECK_F(loguru::add_pipe_sink("true", loguru::Verbosity_INFO));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (int i = 0; i < 10000; ++i) {
+		LOG_F(INFO, "Nobody is listening %d", i);
+	}
+	loguru::remove_callback("true");
+
+	// Nor can one that is alive but stuck:
+	CHECK_F(loguru::add_pipe_sink("sleep 60", loguru::Verbosity_INFO));
+	for (int i = 0; i < 50000; ++i) {
+		LOG_F(INFO, "Nobody is reading this %d", i);
+	}
+	const auto start = std::chrono::steady_clock::now();
+	loguru::remove_callback("sleep 60");
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	CHECK_LT_F(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 10000);
+#endif
+}
+
+struct AsyncTestSink
+{
+	std::atomic<bool>        entered{false};
+	std::atomic<bool>        released{false};
+	std::vector<std::string> messages;
+	std::vector<std::string> contexts;
+	std::vector<std::string> thread_names;
+	std::vector<std::thread::id> thread_ids;
+	unsigned                 num_fields = 0;
+	std::atomic<int>         num_inside{0};
+	bool                     overlapped = false;
+};
+
+static void async_test_callback(void* user_data, const loguru::Message& message)
+{
+	AsyncTestSink* sink = reinterpret_cast<AsyncTestSink*>(user_data);
+	if (++sink->num_inside > 1) {
+		sink->overlapped = true;
+	}
+	if (strcmp(message.message, "log from the callback") == 0) {
+		LOG_F(INFO, "logged by the callback");
+	}
+	if (strcmp(message.message, "first") == 0) {
+		// Hold up the worker while the test fills the queue.
+		sink->entered = true;
+		while (!sink->released) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+	loguru::get_thread_name(thread_name, sizeof(thread_name), false);
+	sink->messages.push_back(message.message);
+	sink->contexts.push_back(loguru::context_as_text(message.context).c_str());
+	sink->thread_names.push_back(thread_name);
+	sink->thread_ids.push_back(std::this_thread::get_id());
+	sink->num_fields += message.num_fields;
+	--sink->num_inside;
+}
+
+void test_async()
+{
+	char thread_name[LOGURU_THREADNAME_WIDTH + 1] = {0};
+	loguru::get_thread_name(thread_name, sizeof(thread_name), false);
+
+	{
+		// A stuck callback neither blocks us nor the other sinks; the overflow is counted.
+		AsyncTestSink sink;
+		loguru::add_callback("async_drop", async_test_callback, &sink, loguru::Verbosity_INFO);
+		loguru::AsyncOptions options;
+		options.max_queued = 4;
+		options.policy = loguru::QueuePolicy_DropNewest;
+		CHECK_F(loguru::set_callback_async("async_drop", options));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		for (int i = 0; i < 10; ++i) {
+			LOG_F(INFO, "queued %d", i);
+		}
+		CHECK_EQ_F(loguru::get_callback_drop_count("async_drop"), 6u);
+		sink.released = true;
+		loguru::remove_callback("async_drop"); // Delivers what is queued.
+		CHECK_EQ_F(sink.messages.size(), 5u);
+		CHECK_EQ_F(sink.messages[0], "first");
+		CHECK_EQ_F(sink.messages[4], "queued 3");
+	}
+
+	{
+		// Spilled messages are delivered in order, with their context, fields and thread.
+		AsyncTestSink sink;
+		loguru::add_callback("async_spill", async_test_callback, &sink, loguru::Verbosity_INFO);
+		loguru::AsyncOptions options;
+		options.max_queued = 2;
+		options.policy = loguru::QueuePolicy_SpillToDisk;
+		options.spill_path = "async_test.spill";
+		CHECK_F(loguru::set_callback_async("async_spill", options));
+		loguru::ContextScope request_context("req", std::string("abc-123"));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		for (int i = 0; i < 20; ++i) {
+			loguru::ContextScope index_context("i", i);
+			LOG_KV(INFO, "spilled", "i", i);
+		}
+		sink.released = true;
+		loguru::flush();
+		loguru::remove_callback("async_spill");
+		CHECK_EQ_F(loguru::get_callback_drop_count("async_spill"), 0u);
+		CHECK_EQ_F(sink.messages.size(), 21u);
+		CHECK_EQ_F(sink.num_fields, 20u);
+		CHECK_EQ_F(sink.contexts[0], " req=abc-123");
+		CHECK_EQ_F(sink.contexts[20], " req=abc-123 i=19");
+		for (int i = 0; i < 20; ++i) {
+			CHECK_EQ_F(sink.contexts[i + 1], " req=abc-123 i=" + std::to_string(i));
+		}
+		for (const auto& name : sink.thread_names) {
+			CHECK_EQ_F(name, std::string(thread_name));
+		}
+	}
+
+	{
+		// Removing a callback does not wait for its worker with Loguru's lock held, which the callback needs to log.
+		AsyncTestSink sink;
+		loguru::add_callback("async_logging", async_test_callback, &sink, loguru::Verbosity_INFO);
+		CHECK_F(loguru::set_callback_async("async_logging"));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		LOG_F(INFO, "log from the callback");
+		std::thread releaser([&sink]{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			sink.released = true;
+		});
+		loguru::remove_callback("async_logging");
+		releaser.join();
+		CHECK_EQ_F(sink.messages.size(), 2u);
+		CHECK_EQ_F(sink.messages[1], "log from the callback");
+	}
+
+	{
+		// A thread waiting for room does not hold up the other threads.
+		AsyncTestSink sink;
+		loguru::add_callback("async_block", async_test_callback, &sink, loguru::Verbosity_INFO);
+		loguru::AsyncOptions options;
+		options.max_queued = 1;
+		options.policy = loguru::QueuePolicy_Block;
+		CHECK_F(loguru::set_callback_async("async_block", options));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		LOG_F(INFO, "queued");
+		std::atomic<bool> logged{false};
+		std::thread blocked([&logged]{
+			LOG_F(INFO, "waited");
+			logged = true;
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK_F(!logged);
+		{
+			std::lock_guard<std::recursive_mutex> lock(loguru::s_mutex);
+		}
+		LOG_F(ERROR, "not held up"); // Skips the full queue.
+		sink.released = true;
+		blocked.join();
+		loguru::remove_callback("async_block");
+		CHECK_EQ_F(loguru::get_callback_drop_count("async_block"), 0u); // Removed.
+		CHECK_EQ_F(sink.messages.size(), 4u);
+		CHECK_EQ_F(sink.messages[1], "not held up");
+		CHECK_EQ_F(sink.messages[2], "queued");
+		CHECK_EQ_F(sink.messages[3], "waited");
+	}
+
+	{
+		// What waits for room is bounded too, even when logged all at once.
+		AsyncTestSink sink;
+		loguru::add_callback("async_batch", async_test_callback, &sink, loguru::Verbosity_INFO);
+		loguru::AsyncOptions options;
+		options.max_queued = 2;
+		options.policy = loguru::QueuePolicy_Block;
+		CHECK_F(loguru::set_callback_async("async_batch", options));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::thread releaser([&sink]{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			sink.released = true;
+		});
+		{
+			LOG_BATCH(INFO, batch);
+			for (int i = 0; i < 10; ++i) {
+				batch.add("batched %d", i);
+			}
+		}
+		releaser.join();
+		CHECK_EQ_F(loguru::get_callback_drop_count("async_batch"), 6u);
+		loguru::remove_callback("async_batch");
+		CHECK_EQ_F(sink.messages.size(), 5u);
+		CHECK_EQ_F(sink.messages[4], "batched 3");
+	}
+
+	{
+		// Errors skip the backlog.
+		AsyncTestSink sink;
+		loguru::add_callback("async_priority", async_test_callback, &sink, loguru::Verbosity_INFO);
+		loguru::AsyncOptions options;
+		options.max_queued = 4;
+		CHECK_F(loguru::set_callback_async("async_priority", options));
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		for (int i = 0; i < 10; ++i) {
+			LOG_F(INFO, "queued %d", i);
+		}
+		LOG_F(ERROR, "urgent");
+		sink.released = true;
+		loguru::remove_callback("async_priority");
+		CHECK_EQ_F(loguru::get_callback_drop_count("async_priority"), 0u); // Removed.
+		CHECK_EQ_F(sink.messages.size(), 6u);
+		CHECK_EQ_F(sink.messages[1], "urgent");
+		CHECK_EQ_F(sink.messages[2], "queued 0");
+	}
+
+	{
+		// FATAL and its error context are written by the logging thread itself.
+		AsyncTestSink sink;
+		sink.released = true;
+		loguru::add_callback("async_fatal", async_test_callback, &sink, loguru::Verbosity_INFO);
+		CHECK_F(loguru::set_callback_async("async_fatal"));
+		loguru::set_fatal_handler([](const loguru::Message& message){
+			throw std::runtime_error(message.message);
+		});
+		for (int i = 0; i < 100; ++i) {
+			LOG_F(INFO, "queued %d", i);
+		}
+		try {
+			ERROR_CONTEXT("async_key", "async_value");
+			LOG_F(FATAL, "boom");
+		} catch (std::runtime_error&) {
+		}
+		loguru::set_fatal_handler(nullptr);
+		loguru::remove_callback("async_fatal");
+		CHECK_GE_F(sink.messages.size(), 102u); // Plus the stack trace, if any.
+		unsigned num_emergency = 0;
+		for (size_t i = 0; i < sink.messages.size(); ++i) {
+			if (sink.messages[i].find("async_value") != std::string::npos || sink.messages[i] == "boom") {
+				++num_emergency;
+				CHECK_F(sink.thread_ids[i] == std::this_thread::get_id());
+			}
+		}
+		CHECK_EQ_F(num_emergency, 2u);
+		CHECK_F(!sink.overlapped);
+	}
+
+	{
+		// A callback that logs while FATAL is handed to it directly is not re-entered, nor deadlocked.
+		AsyncTestSink sink;
+		sink.released = true;
+		loguru::add_callback("async_fatal_logging", async_test_callback, &sink, loguru::Verbosity_INFO);
+		CHECK_F(loguru::set_callback_async("async_fatal_logging"));
+		loguru::set_fatal_handler([](const loguru::Message& message){
+			throw std::runtime_error(message.message);
+		});
+		try {
+			LOG_F(FATAL, "log from the callback");
+		} catch (std::runtime_error&) {
+		}
+		loguru::set_fatal_handler(nullptr);
+		CHECK_GE_F(loguru::get_callback_drop_count("async_fatal_logging"), 1u);
+		loguru::remove_callback("async_fatal_logging");
+		CHECK_F(std::find(sink.messages.begin(), sink.messages.end(), "log from the callback") != sink.messages.end());
+		CHECK_F(!sink.overlapped);
+	}
+
+	{
+		// A worker stuck in the callback is left to finish: FATAL is handed to it, not run alongside it.
+		AsyncTestSink sink;
+		loguru::add_callback("async_stuck", async_test_callback, &sink, loguru::Verbosity_INFO);
+		CHECK_F(loguru::set_callback_async("async_stuck"));
+		loguru::set_fatal_handler([](const loguru::Message& message){
+			throw std::runtime_error(message.message);
+		});
+		LOG_F(INFO, "first");
+		while (!sink.entered) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::thread releaser([&sink]{
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+			sink.released = true;
+		});
+		try {
+			LOG_F(FATAL, "boom");
+		} catch (std::runtime_error&) {
+		}
+		releaser.join();
+		loguru::set_fatal_handler(nullptr);
+		loguru::remove_callback("async_stuck");
+		CHECK_F(!sink.overlapped);
+		CHECK_GE_F(sink.messages.size(), 2u); // Plus the stack trace, if any.
+		CHECK_EQ_F(sink.messages.front(), "first");
+		CHECK_EQ_F(sink.messages.back(), "boom");
+		CHECK_F(sink.thread_ids.back() != std::this_thread::get_id());
+	}
+}
+
+static void count_callback(void* user_data, const loguru::Message&)
+{
+	++*reinterpret_cast<int*>(user_data);
+}
+
+void test_sink_handles()
+{
+	int num_errors = 0, num_info = 0, num_verbose = 0;
+	const auto errors  = loguru::add_callback("errors",  count_callback, &num_errors,  loguru::Verbosity_ERROR);
+	const auto info    = loguru::add_callback("info",    count_callback, &num_info,    loguru::Verbosity_INFO);
+	const auto verbose = loguru::add_callback("verbose", count_callback, &num_verbose, 12); // Beyond Verbosity_MAX.
+	CHECK_NE_F(errors, 0);
+	CHECK_NE_F(errors, info);
+	CHECK_EQ_F(loguru::get_sink_handle("info"), info);
+	CHECK_EQ_F(loguru::get_sink_handle("nope"), 0);
+
+	LOG_F(ERROR, "error");
+	LOG_F(WARNING, "warning");
+	LOG_F(INFO, "info");
+	VLOG_F(3, "verbose");
+	VLOG_F(12, "very verbose");
+	CHECK_EQ_F(num_errors, 1);
+	CHECK_EQ_F(num_info, 3);
+	CHECK_EQ_F(num_verbose, 5);
+
+	CHECK_F(loguru::remove_sink(info));
+	CHECK_F(!loguru::remove_sink(info));
+	CHECK_F(!loguru::remove_sink(0));
+	CHECK_F(!loguru::set_sink_verbosity(info, loguru::Verbosity_INFO));
+	CHECK_F(loguru::set_sink_verbosity(verbose, 12)); // Still found after an earlier sink is removed.
+	LOG_F(ERROR, "error");
+	CHECK_EQ_F(num_errors, 2);
+	CHECK_EQ_F(num_info, 3);
+	CHECK_EQ_F(num_verbose, 6);
+
+	CHECK_F(loguru::remove_sink(errors));
+	CHECK_F(loguru::remove_callback("verbose"));
+	CHECK_EQ_F(loguru::get_sink_handle("verbose"), 0);
+	CHECK_F(!loguru::remove_sink(verbose));
+}
+
+static void depth_callback(void* user_data, const loguru::Message& message)
+{
+	reinterpret_cast<std::vector<std::pair<std::string, unsigned>>*>(user_data)->emplace_back(
+		std::string(message.prefix) + message.message, message.depth);
+}
+
+void test_sink_verbosity()
+{
+	std::vector<std::pair<std::string, unsigned>> lines;
+	const auto handle = loguru::add_callback("depth", depth_callback, &lines, loguru::Verbosity_INFO);
+	int num_verbose = 0; // Some other sink, so that verbose scopes are opened.
+	const auto other = loguru::add_callback("other", count_callback, &num_verbose, 1);
+	{
+		LOG_SCOPE_F(INFO, "info scope");
+		{
+			LOG_SCOPE_F(1, "verbose scope");
+			VLOG_F(1, "not seen");
+			CHECK_F(loguru::set_sink_verbosity(handle, 1));
+			VLOG_F(1, "seen");
+			LOG_F(INFO, "also seen");
+		}
+		CHECK_F(loguru::set_sink_verbosity(handle, loguru::Verbosity_WARNING));
+		LOG_F(INFO, "not seen");
+		LOG_F(WARNING, "warning");
+	}
+	CHECK_F(loguru::set_sink_verbosity(handle, loguru::Verbosity_INFO));
+	LOG_F(INFO, "after");
+	CHECK_F(!loguru::set_sink_verbosity(0, loguru::Verbosity_INFO));
+	loguru::remove_sink(handle);
+	loguru::remove_sink(other);
+
+	const std::vector<std::pair<std::string, unsigned>> expected = {
+		{"{ info scope", 0},
+		{"seen", 2},
+		{"also seen", 2},
+		{"verbose scope", 1}, // The closing brace.
+		{"warning", 0},
+		{"after", 0},
+	};
+	CHECK_EQ_F(lines.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		CHECK_F(lines[i].first.find(expected[i].first) != std::string::npos, "%s", lines[i].first.c_str());
+		CHECK_EQ_F(lines[i].second, expected[i].second, "%s", lines[i].first.c_str());
+	}
+}
+
+static void message_callback(void* user_data, const loguru::Message& message)
+{
+	reinterpret_cast<std::vector<std::string>*>(user_data)->emplace_back(message.message);
+}
+
+struct LogsWhenPrinted
+{
+	int value;
+};
+
+std::ostream& operator<<(std::ostream& os, const LogsWhenPrinted& x)
+{
+	LOG_S(INFO) << "nested " << x.value;
+	return os << "printed " << x.value;
+}
+
+void test_stream_reuse()
+{
+	std::vector<std::string> messages;
+	const auto handle = loguru::add_callback("messages", message_callback, &messages, loguru::Verbosity_INFO);
+	LOG_S(INFO) << std::hex << std::setw(6) << std::setfill('*') << 255 << std::boolalpha << true;
+	LOG_S(INFO) << 255 << " " << true << " " << 1.0 / 3.0;
+	const std::string long_text(3 * LOGURU_STREAM_BUFFER_SIZE + 7, 'x');
+	LOG_S(INFO) << "long " << long_text << " end";
+	LOG_S(INFO) << "short";
+	LOG_S(INFO) << "outer " << LogsWhenPrinted{42} << " done";
+	LOG_S(INFO) << "";
+	loguru::remove_sink(handle);
+
+	const std::vector<std::string> expected = {
+		"****fftrue",
+		"255 1 0.333333",
+		"long " + long_text + " end",
+		"short",
+		"nested 42",
+		"outer printed 42 done",
+		"",
+	};
+	CHECK_EQ_F(messages.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		CHECK_EQ_S(messages[i], expected[i]);
+	}
+}
+
+void test_plain_messages()
+{
+	CHECK_F(loguru::is_plain_message("Connection closed"));
+	CHECK_F(loguru::is_plain_message(""));
+	CHECK_F(!loguru::is_plain_message("Connection " LOGURU_FMT(s) " closed"));
+
+	std::vector<std::string> messages;
+	const auto handle = loguru::add_callback("messages", message_callback, &messages, loguru::Verbosity_INFO);
+	LOG_F(INFO, "Connection closed");
+	RAW_LOG_F(INFO, "Raw and plain");
+	LOG_IF_F(INFO, true, "Conditional");
+	const std::string runtime_message = "Connection closed";
+	LOG_F(INFO, runtime_message.c_str());
+	LOG_F(INFO, LOGURU_FMT(s) " closed", "Connection");
+	int num_evaluations = 0;
+	const auto next_message = [&]() { ++num_evaluations; return "Evaluated once"; };
+	LOG_F(INFO, next_message());
+	RAW_LOG_F(INFO, next_message());
+	CHECK_EQ_F(num_evaluations, 2);
+	loguru::remove_sink(handle);
+
+	const std::vector<std::string> expected = {
+		"Connection closed",
+		"Raw and plain",
+		"Conditional",
+		"Connection closed",
+		"Connection closed",
+		"Evaluated once",
+		"Evaluated once",
+	};
+	CHECK_EQ_F(messages.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		CHECK_EQ_S(messages[i], expected[i]);
+	}
+}
+
+void test_hex_dump()
+{
+	std::vector<std::string> messages;
+	const auto handle = loguru::add_callback("messages", message_callback, &messages, loguru::Verbosity_INFO);
+
+	const char packet[] = "HTTP/1.1 200 OK\r\n\r\n\0\xff";
+	LOG_HEX(INFO, packet, sizeof(packet) - 1, "Received packet");
+	CHECK_EQ_S(messages.back(),
+		"Received packet (21 bytes):\n"
+		"00000000  48 54 54 50 2f 31 2e 31  20 32 30 30 20 4f 4b 0d  |HTTP/1.1 200 OK.|\n"
+		"00000010  0a 0d 0a 00 ff                                    |.....|");
+
+	LOG_HEX(INFO, nullptr, 0, "Nothing");
+	CHECK_EQ_S(messages.back(), "Nothing (0 bytes):");
+
+	std::vector<unsigned char> all_bytes(LOGURU_HEX_DUMP_MAX_BYTES + 5);
+	for (size_t i = 0; i < all_bytes.size(); ++i) {
+		all_bytes[i] = static_cast<unsigned char>(i);
+	}
+	LOG_HEX(INFO, all_bytes.data(), all_bytes.size(), "All bytes");
+	std::istringstream lines(messages.back());
+	std::string line;
+	std::getline(lines, line);
+	CHECK_EQ_S(line, loguru::strprintf("All bytes (%d bytes):", LOGURU_HEX_DUMP_MAX_BYTES + 5));
+	for (size_t offset = 0; offset < LOGURU_HEX_DUMP_MAX_BYTES; offset += 16) {
+		std::getline(lines, line);
+		std::string expected = loguru::strprintf("%08x ", static_cast<unsigned>(offset));
+		for (size_t i = 0; i < 16; ++i) {
+			expected += loguru::strprintf(i == 8 ? "  %02x" : " %02x", all_bytes[offset + i]);
+		}
+		CHECK_EQ_S(line.substr(0, expected.size()), expected);
+	}
+	std::getline(lines, line);
+	CHECK_EQ_S(line, "... 5 more bytes");
+	CHECK_F(!std::getline(lines, line));
+
+	loguru::remove_sink(handle);
+}
+
+struct BatchTestSink
+{
+	std::vector<std::string> messages;
+	std::vector<std::string> preambles;
+	int num_flushes = 0;
+};
+
+void test_log_batch()
+{
+	BatchTestSink sink;
+	const auto handle = loguru::add_callback("batch", [](void* user_data, const loguru::Message& message) {
+		auto sink = reinterpret_cast<BatchTestSink*>(user_data);
+		sink->messages.emplace_back(message.message);
+		sink->preambles.emplace_back(message.preamble);
+	}, &sink, loguru::Verbosity_INFO, nullptr, [](void* user_data) {
+		++reinterpret_cast<BatchTestSink*>(user_data)->num_flushes;
+	});
+
+	std::atomic<bool> done{false};
+	std::thread other([&]() {
+		while (!done) {
+			LOG_F(INFO, "other thread");
+		}
+	});
+
+	const int kNumLines = 100;
+	{
+		LOG_BATCH(INFO, table);
+		for (int i = 0; i < kNumLines; ++i) {
+			table.add("row %d", i);
+			std::this_thread::yield();
+		}
+		table.add("%s", std::string(1000, 'x').c_str()); // Longer than the stack buffer.
+		table.add("%s", "");
+
+		LOG_BATCH(9, cut_off);
+		cut_off.add("never logged");
+	}
+	done = true;
+	other.join();
+
+	const auto first = std::find(sink.messages.begin(), sink.messages.end(), "row 0") - sink.messages.begin();
+	CHECK_LT_F(first, static_cast<long>(sink.messages.size()));
+	CHECK_LE_F(first + kNumLines + 2, static_cast<long>(sink.messages.size()));
+	for (int i = 0; i < kNumLines; ++i) {
+		CHECK_EQ_S(sink.messages[first + i], loguru::strprintf("row %d", i));
+		CHECK_EQ_S(sink.preambles[first + i], sink.preambles[first]);
+	}
+	CHECK_EQ_S(sink.messages[first + kNumLines], std::string(1000, 'x'));
+	CHECK_EQ_S(sink.messages[first + kNumLines + 1], "");
+	CHECK_F(std::find(sink.messages.begin(), sink.messages.end(), "never logged") == sink.messages.end());
+
+	const int num_flushes = sink.num_flushes;
+	{
+		LOG_BATCH(INFO, batch);
+		batch.add("one");
+		batch.add("two");
+	}
+	CHECK_EQ_F(sink.num_flushes, num_flushes + 1);
+	loguru::remove_sink(handle);
+
+	// A throwing callback does not escape the destructor.
+	const auto throwing = loguru::add_callback("throwing", [](void*, const loguru::Message&) {
+		throw std::runtime_error("callback");
+	}, nullptr, loguru::Verbosity_INFO);
+	{
+		LOG_BATCH(INFO, batch);
+		batch.add("lost");
+	}
+	loguru::remove_sink(throwing);
+}
+
+void test_scope_threads()
+{
+	std::vector<std::pair<std::string, unsigned>> lines;
+	const auto handle = loguru::add_callback("depth", depth_callback, &lines, loguru::Verbosity_INFO);
+	{
+		LOG_SCOPE_F(INFO, "main scope");
+		std::thread([]() {
+			LOG_F(INFO, "other thread");
+			LOG_SCOPE_F(INFO, "other scope");
+			LOG_F(INFO, "other thread in scope");
+		}).join();
+		LOG_F(INFO, "main thread in scope");
+	}
+	LOG_F(INFO, "main thread after");
+	loguru::remove_sink(handle);
+
+	const std::vector<std::pair<std::string, unsigned>> expected = {
+		{"{ main scope", 0},
+		{"other thread", 0},
+		{"{ other scope", 0},
+		{"other thread in scope", 1},
+		{"other scope", 0}, // The closing brace.
+		{"main thread in scope", 1},
+		{"main scope", 0},
+		{"main thread after", 0},
+	};
+	CHECK_EQ_F(lines.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		CHECK_F(lines[i].first.find(expected[i].first) != std::string::npos, "%s", lines[i].first.c_str());
+		CHECK_EQ_F(lines[i].second, expected[i].second, "%s", lines[i].first.c_str());
+	}
+}
+
+void test_scope_profiler()
+{
+	std::vector<std::string> messages;
+	const auto handle = loguru::add_callback("messages", message_callback, &messages, loguru::Verbosity_INFO);
+
+	loguru::ScopeProfilingOptions options;
+	options.verbosity = 1; // Above what is logged.
+	options.log_scopes = false;
+	loguru::set_scope_profiling(options);
+
+	unsigned scope_line = 0;
+	for (int i = 0; i < 100; ++i) {
+		scope_line = __LINE__ + 1;
+		VLOG_SCOPE_F(1, "profiled %d", i);
+		if (i == 50) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	}
+	{
+		LOG_SCOPE_F(INFO, "also profiled, not logged");
+	}
+	CHECK_EQ_F(messages.size(), 0u);
+
+	loguru::ScopeStats stats[4];
+	CHECK_EQ_F(loguru::get_scope_stats(stats, 4), 2u);
+	if (stats[0].line != scope_line) {
+		std::swap(stats[0], stats[1]);
+	}
+	CHECK_EQ_F(stats[0].line, scope_line);
+	CHECK_EQ_S(std::string(stats[0].name), "profiled %d");
+	CHECK_EQ_F(stats[0].count, 100u);
+	CHECK_LE_F(stats[0].p50_ns, stats[0].p99_ns);
+	CHECK_LT_F(stats[0].p99_ns, 20000000ll);
+	CHECK_GE_F(stats[0].max_ns, 20000000ll);
+	CHECK_EQ_F(stats[1].count, 1u);
+
+	const std::string report = loguru::scope_stats_report().c_str();
+	CHECK_F(report.find(loguru::strprintf("loguru_test.cpp:%u profiled %%d", scope_line)) != std::string::npos, "%s", report.c_str());
+
+	options.report_interval_ms = 10;
+	loguru::set_scope_profiling(options);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	options.report_interval_ms = 0;
+	loguru::set_scope_profiling(options);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	{
+		std::lock_guard<std::recursive_mutex> lock(loguru::s_mutex);
+		CHECK_F(std::find(messages.begin(), messages.end(), "     count        p50        p99        max  scope") != messages.end());
+	}
+
+	loguru::reset_scope_stats();
+	CHECK_EQ_F(loguru::get_scope_stats(stats, 4), 0u);
+
+	options.log_scopes = true;
+	loguru::set_scope_profiling(options);
+	{
+		LOG_SCOPE_F(INFO, "profiled and logged");
+	}
+	CHECK_EQ_F(loguru::get_scope_stats(stats, 4), 1u);
+	CHECK_EQ_S(messages[messages.size() - 2], "profiled and logged");
+
+	options.verbosity = loguru::Verbosity_OFF;
+	loguru::set_scope_profiling(options);
+	loguru::remove_sink(handle);
+}
+
+void test_trace_file()
+{
+	CHECK_F(loguru::add_trace_file("trace_test_0.json", loguru::Verbosity_INFO));
+	{
+		LOG_SCOPE_F(INFO, "Spans two traces"); // Starts at 0 in the second one.
+		loguru::remove_callback("trace_test_0.json");
+		CHECK_F(loguru::add_trace_file("trace_test.json", loguru::Verbosity_INFO));
+	}
+	CHECK_F(!loguru::add_trace_file("trace_test_2.json", loguru::Verbosity_INFO));
+	{
+		LOG_SCOPE_F(INFO, "Outer \"scope\"");
+		LOG_F(INFO, "Inside");
+		VLOG_SCOPE_F(1, "Not traced");
+	}
+	// Events are buffered until an explicit flush, not written out after every message:
+	CHECK_LE_F(read_lines("trace_test.json").size(), 1u);
+	loguru::flush();
+	CHECK_GT_F(read_lines("trace_test.json").size(), 1u);
+	const loguru::SinkHandle trace = loguru::get_sink_handle("trace_test.json");
+	CHECK_F(loguru::set_sink_verbosity(trace, loguru::Verbosity_WARNING));
+	{
+		LOG_SCOPE_F(INFO, "Not traced either");
+	}
+	CHECK_F(loguru::set_sink_verbosity(trace, loguru::Verbosity_INFO));
+#ifdef __linux__
+	// Messages delivered by an async worker still go on the track of the thread that logged them.
+	CHECK_F(loguru::set_callback_async("trace_test.json"));
+#endif
+	std::thread other([]() {
+		loguru::set_thread_name("tracer");
+		LOG_SCOPE_F(INFO, "Other thread");
+		LOG_F(INFO, "From the tracer");
+	});
+	other.join();
+	loguru::remove_callback("trace_test.json");
+	{
+		LOG_SCOPE_F(INFO, "After the trace");
+	}
+
+	const std::vector<std::string> lines = read_lines("trace_test.json");
+	CHECK_GE_F(lines.size(), 3u);
+	CHECK_EQ_S(lines.front(), "[");
+	CHECK_EQ_S(lines.back(), "]");
+	CHECK_F(lines[lines.size() - 2].find("\"process_name\"") != std::string::npos, "%s", lines[lines.size() - 2].c_str());
+	const auto tid_of = [](const std::string& event) {
+		const size_t start = event.find("\"tid\":");
+		return event.substr(start, event.find(',', start) - start);
+	};
+	std::string tracer_tid, traced_message_tid;
+	int num_scopes = 0;
+	bool found_instant = false, found_thread = false;
+	for (size_t i = 1; i + 1 < lines.size(); ++i) {
+		const std::string& event = lines[i];
+		CHECK_F(event.front() == '{', "%s", event.c_str());
+		CHECK_F(event.back() == (i + 2 < lines.size() ? ',' : '}'), "%s", event.c_str());
+		CHECK_F(event.find("Not traced") == std::string::npos, "%s", event.c_str());
+		CHECK_F(event.find("\"ts\":-") == std::string::npos, "%s", event.c_str());
+		CHECK_F(event.find("After the trace") == std::string::npos, "%s", event.c_str());
+		if (event.find("\"ph\":\"X\"") != std::string::npos) {
+			CHECK_F(event.find("\"dur\":") != std::string::npos, "%s", event.c_str());
+			CHECK_F(event.find("loguru_test.cpp") != std::string::npos, "%s", event.c_str());
+			++num_scopes;
+		}
+		if (event.find("\"ph\":\"i\"") != std::string::npos && event.find("Inside") != std::string::npos) {
+			found_instant = true;
+		}
+		if (event.find("\"name\":\"Outer \\\"scope\\\"\"") != std::string::npos) {
+			CHECK_F(event.find("\"ph\":\"X\"") != std::string::npos, "%s", event.c_str());
+		}
+		if (event.find("\"thread_name\"") != std::string::npos && event.find("tracer") != std::string::npos) {
+			found_thread = true;
+		}
+		if (event.find("\"name\":\"Other thread\"") != std::string::npos) {
+			tracer_tid = tid_of(event);
+		}
+		if (event.find("\"name\":\"From the tracer\"") != std::string::npos) {
+			traced_message_tid = tid_of(event);
+		}
+	}
+	CHECK_EQ_F(num_scopes, 3);
+	CHECK_F(found_instant);
+	CHECK_F(found_thread);
+	CHECK_F(!tracer_tid.empty());
+	CHECK_EQ_S(traced_message_tid, tracer_tid);
+}
+
+void test_scope_budget()
+{
+	std::vector<std::string> messages;
+	const auto handle = loguru::add_callback("messages", message_callback, &messages, loguru::Verbosity_INFO);
+	const auto find_message = [&](const char* text) {
+		std::lock_guard<std::recursive_mutex> lock(loguru::s_mutex);
+		for (const std::string& message : messages) {
+			if (message.find(text) != std::string::npos) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	{
+		LOG_SCOPE_BUDGET_F(INFO, 1000, "fast %d", 1);
+	}
+	{
+		VLOG_SCOPE_BUDGET_F(1, 0, "not logged");
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	CHECK_EQ_F(messages.size(), 0u);
+
+	{
+		ERROR_CONTEXT("request", 42);
+		LOG_SCOPE_BUDGET_F(INFO, 5, "slow %d", 2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	CHECK_EQ_F(messages.size(), 2u);
+	CHECK_F(messages[0].find("'slow 2' took 0.0") == 0, "%s", messages[0].c_str());
+	CHECK_F(messages[0].find("over its budget of 5 ms") != std::string::npos, "%s", messages[0].c_str());
+	CHECK_F(messages[1].find("request:") != std::string::npos, "%s", messages[1].c_str());
+
+	loguru::ScopeWatchdogOptions options;
+	options.interval_ms = 5;
+	loguru::set_scope_watchdog(options);
+	std::thread other([]() {
+		loguru::set_thread_name("stuck");
+		ERROR_CONTEXT("item", 7);
+		LOG_SCOPE_BUDGET_F(INFO, 10, "stuck scope");
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	});
+	other.join();
+	options.interval_ms = 0;
+	loguru::set_scope_watchdog(options);
+
+	CHECK_F(find_message("'stuck scope' has been open for 0.0"));
+	CHECK_F(find_message("over its budget of 10 ms on thread 'stuck'"));
+	CHECK_F(find_message("item:\n"), "Expected the error context of the stuck thread, without its value");
+	CHECK_F(find_message("'stuck scope' took 0.1"));
+#if defined(__GLIBC__)
+	CHECK_F(find_message("sleep"), "Expected the stack trace of the sleeping thread");
+#endif
+	loguru::remove_sink(handle);
+	loguru::shutdown(); // Stops the watchdog thread.
+}
+
 #if defined _WIN32 && defined _DEBUG
 #define USE_WIN_DBG_HOOK
 static int winDbgHook(int reportType, char *message, int *)
@@ -422,9 +1807,55 @@ int main(int argc, char* argv[])
 			throw_on_signal();
 		} else if (test == "callback") {
 			test_log_callback();
+		} else if (test == "json") {
+			test_json();
+		} else if (test == "kv") {
+			test_kv();
+		} else if (test == "ring_buffer") {
+			test_ring_buffer();
+		} else if (test == "shm") {
+			test_shm();
+		} else if (test == "nonblocking_stderr") {
+			test_nonblocking_stderr();
+		} else if (test == "syslog_socket") {
+			test_syslog_socket();
+		} else if (test == "journald") {
+			test_journald();
+		} else if (test == "network") {
+			test_network();
+		} else if (test == "pipe") {
+			test_pipe();
+		} else if (test == "async") {
+			test_async();
+		} else if (test == "sink_handles") {
+			test_sink_handles();
+		} else if (test == "sink_verbosity") {
+			test_sink_verbosity();
+		} else if (test == "stream_reuse") {
+			test_stream_reuse();
+		} else if (test == "plain_messages") {
+			test_plain_messages();
+		} else if (test == "hex_dump") {
+			test_hex_dump();
+		} else if (test == "log_batch") {
+			test_log_batch();
+		} else if (test == "scope_threads") {
+			test_scope_threads();
+		} else if (test == "scope_profiler") {
+			test_scope_profiler();
+		} else if (test == "trace_file") {
+			test_trace_file();
+		} else if (test == "scope_budget") {
+			test_scope_budget();
 		} else if (test == "hang") {
 			loguru::add_file("hang.log", loguru::Truncate, loguru::Verbosity_INFO);
 			test_hang_2();
+		} else if (test == "hang_budget") {
+			loguru::ScopeWatchdogOptions options;
+			options.interval_ms = 100;
+			loguru::set_scope_watchdog(options);
+			LOG_SCOPE_BUDGET_F(INFO, 1000, "hang");
+			test_hang_2();
 		} else {
 			LOG_F(ERROR, "Unknown test: '%s'", test.c_str());
 		}